@@ -1,28 +1,181 @@
 #include "ime_session.h"
 #include "../schemes/quanpin_scheme.h"
 #include "../schemes/shuangpin_scheme.h"
+#include "../shuangpin/utf8_utils.h"
+#include <algorithm>
 #include <stdexcept>
+#include <utility>
 
-ImeSession::ImeSession(SchemeType scheme_type) : scheme_(create_scheme(scheme_type))
+ImeSession::ImeSession(SchemeType scheme_type, ProviderRegistry::EngineMode engine_mode)
+    : provider_registry_(engine_mode), scheme_(create_scheme(scheme_type))
 {
 }
 
 void ImeSession::handle_key(UINT vk, UINT modifiers_down, WCHAR wch)
 {
     scheme_->handle_key(vk, modifiers_down, wch);
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool coalesce = should_coalesce(now);
+    last_key_time_ = now;
+    if (coalesce)
+    {
+        state_.preedit = scheme_->get_preedit();
+        refresh_pending_ = true;
+        refine_pending_ = false;
+        return;
+    }
+    refresh_candidates();
+}
+
+void ImeSession::handle_keys(const KeyStroke *key_strokes, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        scheme_->handle_key(key_strokes[i].vk, key_strokes[i].modifiers_down, key_strokes[i].wch);
+    }
+    last_key_time_ = std::chrono::steady_clock::now();
     refresh_candidates();
 }
 
+void ImeSession::handle_keys(const std::vector<KeyStroke> &key_strokes)
+{
+    handle_keys(key_strokes.data(), key_strokes.size());
+}
+
 void ImeSession::switch_scheme(SchemeType scheme_type)
 {
     scheme_ = create_scheme(scheme_type);
     state_ = CompositionState{};
+    invalidate_utf16_page();
+    context_.clear();
+    last_key_time_.reset();
+    refresh_pending_ = false;
+    refine_pending_ = false;
 }
 
 void ImeSession::reset()
 {
     scheme_->reset();
     state_ = CompositionState{};
+    invalidate_utf16_page();
+    context_.clear();
+    last_key_time_.reset();
+    refresh_pending_ = false;
+    refine_pending_ = false;
+}
+
+void ImeSession::commit(const std::string &text)
+{
+    scheme_->reset();
+    context_ = text;
+    last_key_time_.reset();
+    refresh_candidates();
+}
+
+void ImeSession::set_coalesce_threshold(std::chrono::microseconds threshold)
+{
+    coalesce_threshold_ = threshold;
+    if (coalesce_threshold_.count() <= 0)
+    {
+        flush();
+    }
+}
+
+std::chrono::microseconds ImeSession::get_coalesce_threshold() const
+{
+    return coalesce_threshold_;
+}
+
+bool ImeSession::has_pending_refresh() const
+{
+    return refresh_pending_;
+}
+
+void ImeSession::flush()
+{
+    if (refresh_pending_)
+    {
+        refresh_candidates();
+    }
+}
+
+void ImeSession::set_latency_budget(std::chrono::microseconds budget)
+{
+    latency_budget_ = budget;
+    if (latency_budget_.count() <= 0)
+    {
+        refine();
+    }
+}
+
+std::chrono::microseconds ImeSession::get_latency_budget() const
+{
+    return latency_budget_;
+}
+
+void ImeSession::set_typo_correction(bool enabled)
+{
+    if (typo_correction_ == enabled)
+    {
+        return;
+    }
+    typo_correction_ = enabled;
+    if (!state_.preedit.empty())
+    {
+        refresh_candidates();
+    }
+}
+
+bool ImeSession::get_typo_correction() const
+{
+    return typo_correction_;
+}
+
+bool ImeSession::has_pending_refinement() const
+{
+    return refine_pending_;
+}
+
+/**
+ * @brief Complete the first page of the last refresh
+ *
+ * Meant for the host's idle time, like flush(). A key arriving first makes the refinement moot, the next refresh
+ * starts over with its own first page.
+ */
+void ImeSession::refine()
+{
+    if (!refine_pending_)
+    {
+        return;
+    }
+    refine_pending_ = false;
+    invalidate_utf16_page();
+    state_.request.deadline.reset();
+    state_.candidates = provider_registry_.merged(state_.request.scheme).query(state_.request);
+    if (update_callback_)
+    {
+        update_callback_();
+    }
+}
+
+void ImeSession::set_update_callback(std::function<void()> callback)
+{
+    update_callback_ = std::move(callback);
+}
+
+bool ImeSession::reload_dictionary()
+{
+    return provider_registry_.resolve(scheme_->type()).reload();
+}
+
+bool ImeSession::is_reloading_dictionary()
+{
+    return provider_registry_.resolve(scheme_->type()).reloading();
 }
 
 SchemeType ImeSession::current_scheme_type() const
@@ -45,18 +198,69 @@ const std::vector<WordItem> &ImeSession::get_candidates() const
     return state_.candidates;
 }
 
+const std::vector<std::u16string_view> &ImeSession::get_candidate_page_utf16(size_t offset, size_t count)
+{
+    const auto &candidates = state_.candidates;
+    offset = std::min(offset, candidates.size());
+    count = std::min(count, candidates.size() - offset);
+    if (page_valid_ && page_offset_ == offset && page_count_ == count)
+    {
+        return page_views_;
+    }
+    page_text_.clear();
+    page_spans_.clear();
+    for (size_t i = offset; i < offset + count; ++i)
+    {
+        const size_t begin = page_text_.size();
+        Utf8Utils::append_utf16(std::get<1>(candidates[i]), page_text_);
+        page_spans_.emplace_back(begin, page_text_.size() - begin);
+    }
+    /* 全部追加完再取视图，追加过程中缓冲区可能搬家 */
+    page_views_.clear();
+    for (const auto &[begin, length] : page_spans_)
+    {
+        page_views_.emplace_back(page_text_.data() + begin, length);
+    }
+    page_offset_ = offset;
+    page_count_ = count;
+    page_valid_ = true;
+    return page_views_;
+}
+
+const std::string &ImeSession::get_context() const
+{
+    return context_;
+}
+
 void ImeSession::refresh_candidates()
 {
+    refresh_pending_ = false;
+    invalidate_utf16_page();
     state_.preedit = scheme_->get_preedit();
     state_.request = scheme_->build_request();
-
-    if (!state_.request.valid)
+    state_.request.context = context_;
+    state_.request.typo_correction = typo_correction_;
+    if (latency_budget_.count() > 0)
     {
-        state_.candidates.clear();
-        return;
+        state_.request.deadline = std::chrono::steady_clock::now() + latency_budget_;
     }
+    auto &merged = provider_registry_.merged(state_.request.scheme);
+    state_.candidates = merged.query(state_.request);
+    refine_pending_ = merged.partial();
+}
 
-    state_.candidates = provider_registry_.resolve(state_.request.scheme).query(state_.request);
+void ImeSession::invalidate_utf16_page()
+{
+    page_valid_ = false;
+}
+
+bool ImeSession::should_coalesce(std::chrono::steady_clock::time_point now) const
+{
+    if (coalesce_threshold_.count() <= 0 || !last_key_time_)
+    {
+        return false;
+    }
+    return now - *last_key_time_ < coalesce_threshold_;
 }
 
 std::unique_ptr<IInputScheme> ImeSession::create_scheme(SchemeType scheme_type) const
@@ -4,28 +4,89 @@
 #include "scheme_type.h"
 #include "../providers/provider_registry.h"
 #include "../schemes/input_scheme.h"
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 class ImeSession
 {
   public:
-    explicit ImeSession(SchemeType scheme_type = SchemeType::Shuangpin);
+    explicit ImeSession(SchemeType scheme_type = SchemeType::Shuangpin,
+                        ProviderRegistry::EngineMode engine_mode = ProviderRegistry::configured_mode());
 
     void handle_key(UINT vk, UINT modifiers_down = 0, WCHAR wch = 0);
+    // Apply a burst of keys (paste, auto-repeat, replay) and query the provider once for the final state
+    void handle_keys(const KeyStroke *key_strokes, size_t count);
+    void handle_keys(const std::vector<KeyStroke> &key_strokes);
     void switch_scheme(SchemeType scheme_type);
     void reset();
+    // Commit text to the host, clears the composition and shows next-word associations for it
+    void commit(const std::string &text);
+    // Reload the dictionary of the current scheme in the background, typing keeps using the old one until it is done
+    bool reload_dictionary();
+    // Whether the reload started by reload_dictionary() is still running
+    bool is_reloading_dictionary();
+
+    // Keys arriving closer together than threshold only update the preedit, candidates are refreshed by flush().
+    // A zero threshold (the default) refreshes on every key.
+    void set_coalesce_threshold(std::chrono::microseconds threshold);
+    std::chrono::microseconds get_coalesce_threshold() const;
+    bool has_pending_refresh() const;
+    void flush();
+
+    // Every refresh gets budget for a first page, sources that did not fit are left for refine(). A zero budget
+    // (the default) waits for all sources.
+    void set_latency_budget(std::chrono::microseconds budget);
+    std::chrono::microseconds get_latency_budget() const;
+    bool has_pending_refinement() const;
+    // Query the current input again without a deadline and replace the first page
+    void refine();
+    // Called whenever refine() replaced the candidates
+    void set_update_callback(std::function<void()> callback);
+
+    // Also offer the words of codes one mistyped key away, after the exact candidates. Off by default.
+    void set_typo_correction(bool enabled);
+    bool get_typo_correction() const;
 
     SchemeType current_scheme_type() const;
     const std::string &get_preedit() const;
     const QueryRequest &get_request() const;
     const std::vector<WordItem> &get_candidates() const;
+    // UTF-16 text of candidates [offset, offset + count), for the page the UI renders. Transcoded once per page
+    // into a buffer the session reuses, the views stay valid until the candidates or the requested page change.
+    const std::vector<std::u16string_view> &get_candidate_page_utf16(size_t offset, size_t count);
+    const std::string &get_context() const;
 
   private:
     void refresh_candidates();
+    void invalidate_utf16_page();
+    bool should_coalesce(std::chrono::steady_clock::time_point now) const;
     std::unique_ptr<IInputScheme> create_scheme(SchemeType scheme_type) const;
 
   private:
     ProviderRegistry provider_registry_;
     std::unique_ptr<IInputScheme> scheme_;
     CompositionState state_;
+    std::string context_;
+
+    std::chrono::microseconds coalesce_threshold_{0};
+    std::optional<std::chrono::steady_clock::time_point> last_key_time_;
+    bool refresh_pending_ = false;
+
+    std::chrono::microseconds latency_budget_{0};
+    bool refine_pending_ = false; // 当前候选是截止时间内的首屏，还缺慢的来源
+    std::function<void()> update_callback_;
+    bool typo_correction_ = false;
+
+    /* 当前页的 UTF-16 文本，缓冲区在刷新之间复用 */
+    std::u16string page_text_;
+    std::vector<std::pair<size_t, size_t>> page_spans_; // offset, length into page_text_
+    std::vector<std::u16string_view> page_views_;
+    size_t page_offset_ = 0;
+    size_t page_count_ = 0;
+    bool page_valid_ = false;
 };
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One syllable of a shuangpin sequence, two keys when complete, one key when only the initial is typed
+struct SyllableSpan
+{
+    uint16_t begin = 0;
+    uint16_t length = 0;
+
+    bool complete() const
+    {
+        return length == 2;
+    }
+};
+
+enum class HelpcodeMode : uint8_t
+{
+    None,
+    Single, // Odd length, complete pinyin before the last key, which is the helpcode
+    Full,   // Even length, complete pinyin before the last two keys, the last one typed in upper case
+};
+
+// Everything derived from the typed keys, computed once per key by the scheme and only read downstream
+struct PinyinAnalysis
+{
+    std::string pinyin;                  // Lower case keys
+    std::string pinyin_with_cases;       // Keys as typed, upper case marks the helpcode of full help mode
+    std::vector<SyllableSpan> syllables; // Forward greedy segmentation of pinyin
+    bool all_complete = false;           // Even length and every syllable complete
+    HelpcodeMode helpcode_mode = HelpcodeMode::None;
+    size_t helpcode_pos = 0;                  // pinyin[helpcode_pos, end) are helpcodes, size() when there are none
+    std::vector<SyllableSpan> pure_syllables; // Segmentation of pinyin[0, helpcode_pos)
+    bool pure_all_complete = false;
+
+    bool upper_case(size_t pos) const
+    {
+        return pinyin_with_cases[pos] >= 'A' && pinyin_with_cases[pos] <= 'Z';
+    }
+
+    std::string_view pure_pinyin() const
+    {
+        return std::string_view(pinyin).substr(0, helpcode_pos);
+    }
+
+    std::string_view helpcodes() const
+    {
+        return std::string_view(pinyin).substr(helpcode_pos);
+    }
+
+    // Segmentation joined with ', e.g. ni'h'k
+    std::string segmentation() const
+    {
+        return join(syllables);
+    }
+
+    std::string pure_segmentation() const
+    {
+        return join(pure_syllables);
+    }
+
+  private:
+    std::string join(const std::vector<SyllableSpan> &spans) const
+    {
+        std::string res;
+        res.reserve(pinyin.size() + spans.size());
+        for (const auto &span : spans)
+        {
+            if (!res.empty())
+            {
+                res += '\'';
+            }
+            res.append(pinyin, span.begin, span.length);
+        }
+        return res;
+    }
+};
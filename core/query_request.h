@@ -1,7 +1,15 @@
 #pragma once
 
+#include "pinyin_analysis.h"
 #include "scheme_type.h"
+#ifdef _WIN32
 #include <Windows.h>
+#else
+using UINT = unsigned int;
+using WCHAR = wchar_t;
+#endif
+#include <chrono>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -19,5 +27,11 @@ struct QueryRequest
     std::string normalized_input;
     std::string segmentation;
     std::vector<KeyStroke> key_strokes;
+    PinyinAnalysis analysis; // Shuangpin only, filled by the scheme, empty when the request came from elsewhere
+    std::string context; // Last committed text, drives association when there is no input
+    // Past this point providers only finish their cheap sources and report partial(), empty to wait for all sources
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    // Shuangpin only, also offer the words of dictionary keys one mistyped key away, after the exact ones
+    bool typo_correction = false;
     bool valid = false;
 };
@@ -0,0 +1,45 @@
+#include "association_provider.h"
+#include "../shuangpin/pinyin_utils.h"
+#include <fmt/core.h>
+
+AssociationProvider::AssociationProvider()
+    : AssociationProvider(
+          fmt::format("{}\\{}\\bigram.dat", PinyinUtil::get_local_appdata_path(), PinyinUtil::app_name))
+{
+}
+
+AssociationProvider::AssociationProvider(const std::string &table_path)
+{
+    bigram_table_.open(table_path);
+}
+
+std::vector<WordItem> AssociationProvider::query(const QueryRequest &request)
+{
+    std::vector<WordItem> result;
+    if (!accepts(request))
+    {
+        return result;
+    }
+
+    const auto associations = bigram_table_.next_words(request.context, limit_);
+    result.reserve(associations.size());
+    for (const auto &[word, score] : associations)
+    {
+        result.emplace_back("", std::string(word), static_cast<int>(score));
+    }
+    return result;
+}
+
+bool AssociationProvider::accepts(const QueryRequest &request) const
+{
+    return !request.context.empty() && request.raw_input.empty();
+}
+
+void AssociationProvider::reset_cache()
+{
+}
+
+bool AssociationProvider::is_ready() const
+{
+    return bigram_table_.is_open();
+}
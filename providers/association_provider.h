@@ -0,0 +1,22 @@
+#pragma once
+
+#include "candidate_provider.h"
+#include "../shuangpin/bigram_table.h"
+#include <string>
+
+class AssociationProvider : public ICandidateProvider
+{
+  public:
+    AssociationProvider();
+    explicit AssociationProvider(const std::string &table_path);
+
+    std::vector<WordItem> query(const QueryRequest &request) override;
+    bool accepts(const QueryRequest &request) const override;
+    void reset_cache() override;
+
+    bool is_ready() const;
+
+  private:
+    BigramTable bigram_table_;
+    size_t limit_ = 16;
+};
@@ -0,0 +1,245 @@
+#include "candidate_merger.h"
+#include "../shuangpin/task_pool.h"
+#include <algorithm>
+#include <queue>
+#include <string_view>
+
+namespace
+{
+uint64_t hash_word(std::string_view word)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : word)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+struct Cursor
+{
+    double score;
+    size_t source;
+    size_t rank;
+};
+
+// Higher score first, ties go to the earlier source, so the merge is stable
+struct CursorOrder
+{
+    bool operator()(const Cursor &a, const Cursor &b) const
+    {
+        if (a.score != b.score)
+            return a.score < b.score;
+        return a.source > b.source;
+    }
+};
+} // namespace
+
+CandidateMerger::CandidateMerger(size_t limit) : limit_(limit)
+{
+}
+
+void CandidateMerger::add_source(ICandidateProvider &provider, double weight)
+{
+    sources_.push_back(Source{&provider, weight});
+}
+
+void CandidateMerger::set_limit(size_t limit)
+{
+    limit_ = limit;
+}
+
+void CandidateMerger::set_parallel(bool parallel)
+{
+    parallel_ = parallel;
+}
+
+std::vector<WordItem> CandidateMerger::query(const QueryRequest &request)
+{
+    std::vector<std::vector<WordItem>> lists = collect(request);
+    partial_ = false;
+    for (const auto &source : sources_)
+    {
+        partial_ = partial_ || (source.provider->accepts(request) && source.provider->partial());
+    }
+
+    size_t total = 0;
+    std::priority_queue<Cursor, std::vector<Cursor>, CursorOrder> heads;
+    for (size_t i = 0; i < lists.size(); ++i)
+    {
+        total += lists[i].size();
+        if (!lists[i].empty())
+        {
+            heads.push(Cursor{score(i, 0), i, 0});
+        }
+    }
+    if (heads.size() <= 1)
+    { /* 只有一个来源有结果，没有可交错的，保持原来的顺序，只去掉重复的词 */
+        return heads.empty() ? std::vector<WordItem>{} : deduplicate(lists[heads.top().source]);
+    }
+
+    std::vector<WordItem> result;
+    result.reserve(std::min(total, limit_));
+    reset_seen(std::min(total, limit_));
+    while (!heads.empty() && result.size() < limit_)
+    {
+        Cursor head = heads.top();
+        heads.pop();
+        WordItem &item = lists[head.source][head.rank];
+        if (insert_seen(hash_word(std::get<1>(item))))
+        {
+            result.push_back(std::move(item));
+        }
+        if (++head.rank < lists[head.source].size())
+        {
+            head.score = score(head.source, head.rank);
+            heads.push(head);
+        }
+    }
+    return result;
+}
+
+bool CandidateMerger::accepts(const QueryRequest &request) const
+{
+    for (const auto &source : sources_)
+    {
+        if (source.provider->accepts(request))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CandidateMerger::partial() const
+{
+    return partial_;
+}
+
+void CandidateMerger::reset_cache()
+{
+    for (const auto &source : sources_)
+    {
+        source.provider->reset_cache();
+    }
+}
+
+bool CandidateMerger::reload()
+{
+    bool reloaded = false;
+    for (const auto &source : sources_)
+    {
+        reloaded = source.provider->reload() || reloaded;
+    }
+    return reloaded;
+}
+
+bool CandidateMerger::reloading() const
+{
+    return std::any_of(sources_.begin(), sources_.end(),
+                       [](const Source &source) { return source.provider->reloading(); });
+}
+
+std::vector<std::vector<WordItem>> CandidateMerger::collect(const QueryRequest &request)
+{
+    std::vector<std::vector<WordItem>> lists(sources_.size());
+    std::vector<size_t> active;
+    for (size_t i = 0; i < sources_.size(); ++i)
+    {
+        if (sources_[i].provider->accepts(request))
+        {
+            active.push_back(i);
+        }
+    }
+    if (!parallel_ || active.size() < 2)
+    {
+        for (size_t i : active)
+        {
+            lists[i] = sources_[i].provider->query(request);
+        }
+        return lists;
+    }
+
+    /* The first active source runs on the calling thread, which helps with the others while it waits */
+    TaskPool::Group group(TaskPool::shared());
+    for (size_t i = 1; i < active.size(); ++i)
+    {
+        ICandidateProvider *provider = sources_[active[i]].provider;
+        group.run([provider, &request, &list = lists[active[i]]]() { list = provider->query(request); });
+    }
+    lists[active[0]] = sources_[active[0]].provider->query(request);
+    group.wait();
+    return lists;
+}
+
+/**
+ * @brief Keep the first occurrence of every word, in one pass over the list
+ *
+ * @param list Moved from
+ * @return std::vector<WordItem> At most limit_ words
+ */
+std::vector<WordItem> CandidateMerger::deduplicate(std::vector<WordItem> &list)
+{
+    std::vector<WordItem> result;
+    result.reserve(std::min(list.size(), limit_));
+    reset_seen(std::min(list.size(), limit_));
+    for (auto &item : list)
+    {
+        if (result.size() >= limit_)
+        {
+            break;
+        }
+        if (insert_seen(hash_word(std::get<1>(item))))
+        {
+            result.push_back(std::move(item));
+        }
+    }
+    return result;
+}
+
+double CandidateMerger::score(size_t source, size_t rank) const
+{
+    return sources_[source].weight / (static_cast<double>(rank) + kRankOffset);
+}
+
+void CandidateMerger::reset_seen(size_t expected)
+{
+    size_t capacity = 16;
+    while (capacity < expected * 2)
+    {
+        capacity <<= 1;
+    }
+    seen_.assign(capacity, 0);
+    seen_mask_ = capacity - 1;
+    seen_count_ = 0;
+}
+
+// Returns false if the hash was already present. Grows at half load, the merge may pop more words than expected
+bool CandidateMerger::insert_seen(uint64_t word_hash)
+{
+    size_t slot = word_hash & seen_mask_;
+    while (seen_[slot] != 0)
+    {
+        if (seen_[slot] == word_hash)
+        {
+            return false;
+        }
+        slot = (slot + 1) & seen_mask_;
+    }
+    seen_[slot] = word_hash;
+    if (++seen_count_ * 2 > seen_.size())
+    {
+        std::vector<uint64_t> old;
+        old.swap(seen_);
+        reset_seen(old.size());
+        for (uint64_t hash : old)
+        {
+            if (hash != 0)
+            {
+                insert_seen(hash);
+            }
+        }
+    }
+    return true;
+}
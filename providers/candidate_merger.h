@@ -0,0 +1,59 @@
+#pragma once
+
+#include "candidate_provider.h"
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Merges the lists of several providers into one ranked page. Sources are queried in parallel on the shared task
+// pool, a candidate scores weight / (rank + kRankOffset) within its source, so every source keeps its own order while
+// weights decide how the sources interleave. The lists are merged lazily by score and the merge stops after limit
+// unique words, duplicates keep their best-scoring occurrence. When only one source answers, its list keeps its order
+// and only the later occurrences of a word are dropped, e.g. a word the series cache got by
+// insert_word_to_cached_buffer_series that the code's own rows return again.
+//
+// The merged list is partial if any source stopped at the request's deadline.
+//
+// Sources must not share mutable state, they run on different threads.
+class CandidateMerger : public ICandidateProvider
+{
+  public:
+    static constexpr size_t kNoLimit = std::numeric_limits<size_t>::max();
+
+    explicit CandidateMerger(size_t limit = kNoLimit);
+
+    void add_source(ICandidateProvider &provider, double weight = 1.0);
+    void set_limit(size_t limit);
+    void set_parallel(bool parallel);
+
+    std::vector<WordItem> query(const QueryRequest &request) override;
+    bool accepts(const QueryRequest &request) const override;
+    bool partial() const override;
+    void reset_cache() override;
+    bool reload() override;
+    bool reloading() const override;
+
+  private:
+    struct Source
+    {
+        ICandidateProvider *provider;
+        double weight;
+    };
+
+    static constexpr double kRankOffset = 60.0;
+
+    std::vector<std::vector<WordItem>> collect(const QueryRequest &request);
+    std::vector<WordItem> deduplicate(std::vector<WordItem> &list);
+    double score(size_t source, size_t rank) const;
+    void reset_seen(size_t expected);
+    bool insert_seen(uint64_t word_hash);
+
+  private:
+    std::vector<Source> sources_;
+    size_t limit_;
+    bool parallel_ = true;
+    bool partial_ = false;
+    std::vector<uint64_t> seen_; // Open addressing set of word hashes, 0 marks an empty slot
+    uint64_t seen_mask_ = 0;
+    size_t seen_count_ = 0;
+};
@@ -10,5 +10,26 @@ class ICandidateProvider
     virtual ~ICandidateProvider() = default;
 
     virtual std::vector<WordItem> query(const QueryRequest &request) = 0;
+    // Whether query can return anything for the request, lets a merger skip the source
+    virtual bool accepts(const QueryRequest &request) const
+    {
+        return request.valid;
+    }
+    // Whether the last query stopped at the request's deadline and left sources out, querying again without a
+    // deadline gives the complete list
+    virtual bool partial() const
+    {
+        return false;
+    }
     virtual void reset_cache() = 0;
+    // Start reloading the provider's data in the background, false if not supported or already running
+    virtual bool reload()
+    {
+        return false;
+    }
+    // Whether a reload started by reload() is still running
+    virtual bool reloading() const
+    {
+        return false;
+    }
 };
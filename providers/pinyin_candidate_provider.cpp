@@ -5,6 +5,8 @@
 
 std::vector<WordItem> PinyinCandidateProvider::query(const QueryRequest &request)
 {
+    /* 只有双拼的查询会按截止时间截断，全拼整句不能沿用上一次双拼查询的状态 */
+    partial_ = false;
     if (!request.valid)
     {
         return {};
@@ -13,12 +15,22 @@ std::vector<WordItem> PinyinCandidateProvider::query(const QueryRequest &request
     if (request.scheme == SchemeType::Shuangpin)
     {
         shuangpin_engine_.reset_state();
-        for (const auto &key_stroke : request.key_strokes)
+        shuangpin_engine_.set_deadline(request.deadline);
+        shuangpin_engine_.set_typo_correction(request.typo_correction);
+        if (request.analysis.pinyin.size() == request.key_strokes.size())
+        { /* 分析结果由 scheme 算好，直接用，不再逐键重放 */
+            shuangpin_engine_.handle_analysis(request.analysis);
+        }
+        else
         {
-            fmt::println("Handling keystroke: vk={}", key_stroke.vk);
-            shuangpin_engine_.handleVkCode(key_stroke.vk, key_stroke.modifiers_down, key_stroke.wch);
+            for (const auto &key_stroke : request.key_strokes)
+            {
+                fmt::println("Handling keystroke: vk={}", key_stroke.vk);
+                shuangpin_engine_.handleVkCode(key_stroke.vk, key_stroke.modifiers_down, key_stroke.wch);
+            }
         }
         fmt::println("length: {}", shuangpin_engine_.get_cur_candiate_list().size());
+        partial_ = shuangpin_engine_.is_partial();
         return shuangpin_engine_.get_cur_candiate_list();
     }
 
@@ -36,7 +48,27 @@ std::vector<WordItem> PinyinCandidateProvider::query(const QueryRequest &request
     return {};
 }
 
+bool PinyinCandidateProvider::partial() const
+{
+    return partial_;
+}
+
 void PinyinCandidateProvider::reset_cache()
 {
     shuangpin_engine_.reset_cache();
 }
+
+const SentenceStream::Stats &PinyinCandidateProvider::sentence_stream_stats() const
+{
+    return shuangpin_engine_.get_sentence_stream_stats();
+}
+
+bool PinyinCandidateProvider::reload()
+{
+    return shuangpin_engine_.reload_async();
+}
+
+bool PinyinCandidateProvider::reloading() const
+{
+    return shuangpin_engine_.is_reloading();
+}
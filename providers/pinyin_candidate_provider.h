@@ -7,8 +7,14 @@ class PinyinCandidateProvider : public ICandidateProvider
 {
   public:
     std::vector<WordItem> query(const QueryRequest &request) override;
+    bool partial() const override;
     void reset_cache() override;
+    bool reload() override;
+    bool reloading() const override;
+
+    const SentenceStream::Stats &sentence_stream_stats() const;
 
   private:
     DictionaryUlPb shuangpin_engine_;
+    bool partial_ = false;
 };
@@ -1,5 +1,30 @@
 #include "provider_registry.h"
+#include "remote_candidate_provider.h"
+#include <cstdlib>
 #include <stdexcept>
+#include <string_view>
+
+ProviderRegistry::EngineMode ProviderRegistry::configured_mode()
+{
+    const char *engine = std::getenv("METASEQUOIA_ENGINE");
+    return engine && std::string_view(engine) == "server" ? EngineMode::Server : EngineMode::InProcess;
+}
+
+ProviderRegistry::ProviderRegistry(EngineMode mode) : mode_(mode)
+{
+    /* 服务模式下不在本进程加载词库，服务不可用时 RemoteCandidateProvider 自己退回进程内查询 */
+    if (mode == EngineMode::Server)
+        pinyin_provider_ = std::make_unique<RemoteCandidateProvider>();
+    else
+        pinyin_provider_ = std::make_unique<PinyinCandidateProvider>();
+    pinyin_merger_.add_source(*pinyin_provider_, 1.0);
+    pinyin_merger_.add_source(association_provider_, 0.5);
+}
+
+ProviderRegistry::EngineMode ProviderRegistry::mode() const
+{
+    return mode_;
+}
 
 ICandidateProvider &ProviderRegistry::resolve(SchemeType scheme_type)
 {
@@ -7,7 +32,26 @@ ICandidateProvider &ProviderRegistry::resolve(SchemeType scheme_type)
     {
     case SchemeType::Quanpin:
     case SchemeType::Shuangpin:
-        return pinyin_provider_;
+        return *pinyin_provider_;
+    case SchemeType::Wubi:
+        throw std::runtime_error("Wubi provider is not implemented yet.");
+    default:
+        throw std::runtime_error("Unknown scheme type.");
+    }
+}
+
+ICandidateProvider &ProviderRegistry::association()
+{
+    return association_provider_;
+}
+
+ICandidateProvider &ProviderRegistry::merged(SchemeType scheme_type)
+{
+    switch (scheme_type)
+    {
+    case SchemeType::Quanpin:
+    case SchemeType::Shuangpin:
+        return pinyin_merger_;
     case SchemeType::Wubi:
         throw std::runtime_error("Wubi provider is not implemented yet.");
     default:
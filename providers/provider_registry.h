@@ -1,13 +1,34 @@
 #pragma once
 
+#include "association_provider.h"
+#include "candidate_merger.h"
 #include "pinyin_candidate_provider.h"
 #include "../core/scheme_type.h"
+#include <memory>
 
 class ProviderRegistry
 {
   public:
+    enum class EngineMode
+    {
+        InProcess, // Every host process loads its own dictionary
+        Server,    // Pinyin queries go to the engine server, in-process only while it does not answer
+    };
+
+    // METASEQUOIA_ENGINE=server selects the engine server, anything else runs in-process
+    static EngineMode configured_mode();
+
+    explicit ProviderRegistry(EngineMode mode = configured_mode());
+
+    EngineMode mode() const;
     ICandidateProvider &resolve(SchemeType scheme_type);
+    ICandidateProvider &association();
+    // All sources of the scheme merged into one deduplicated, ranked list
+    ICandidateProvider &merged(SchemeType scheme_type);
 
   private:
-    PinyinCandidateProvider pinyin_provider_;
+    EngineMode mode_;
+    std::unique_ptr<ICandidateProvider> pinyin_provider_;
+    AssociationProvider association_provider_;
+    CandidateMerger pinyin_merger_;
 };
@@ -0,0 +1,152 @@
+#include "remote_candidate_provider.h"
+#include "pinyin_candidate_provider.h"
+#include <spdlog/spdlog.h>
+
+using EngineProtocol::MessageType;
+
+RemoteCandidateProvider::RemoteCandidateProvider() : RemoteCandidateProvider(EngineProtocol::default_socket_path())
+{
+}
+
+RemoteCandidateProvider::RemoteCandidateProvider(std::string socket_path) : socket_path_(std::move(socket_path))
+{
+}
+
+std::vector<WordItem> RemoteCandidateProvider::query(const QueryRequest &request)
+{
+    std::vector<WordItem> result;
+    scheme_ = request.scheme;
+    if (server_usable())
+    {
+        EngineProtocol::encode_request(request, request_buffer_);
+        MessageType reply_type;
+        if (round_trip(MessageType::Query, request_buffer_, reply_type, reply_buffer_) &&
+            reply_type == MessageType::Candidates &&
+            EngineProtocol::decode_candidates(reply_buffer_, result, server_partial_))
+        {
+            retry_at_.reset();
+            last_fallback_ = false;
+            return result;
+        }
+        mark_server_down();
+    }
+    last_fallback_ = true;
+    return fallback().query(request);
+}
+
+bool RemoteCandidateProvider::partial() const
+{
+    return last_fallback_ ? fallback_->partial() : server_partial_;
+}
+
+void RemoteCandidateProvider::reset_cache()
+{
+    MessageType reply_type;
+    if (server_usable() &&
+        !round_trip(MessageType::ResetCache, std::string(1, static_cast<char>(scheme_)), reply_type, reply_buffer_))
+    {
+        mark_server_down();
+    }
+    if (fallback_)
+    {
+        fallback_->reset_cache();
+    }
+}
+
+bool RemoteCandidateProvider::reload()
+{
+    bool reloaded = false;
+    MessageType reply_type;
+    if (server_usable())
+    {
+        if (round_trip(MessageType::Reload, std::string(1, static_cast<char>(scheme_)), reply_type, reply_buffer_))
+        {
+            reloaded = reply_type == MessageType::Ack && reply_buffer_.size() == 1 && reply_buffer_[0] == 1;
+        }
+        else
+        {
+            mark_server_down();
+        }
+    }
+    if (fallback_)
+    {
+        reloaded = fallback_->reload() || reloaded;
+    }
+    return reloaded;
+}
+
+bool RemoteCandidateProvider::reloading() const
+{
+    /* A reload on the server runs in its own process, only the in-process fallback can be observed */
+    return fallback_ && fallback_->reloading();
+}
+
+bool RemoteCandidateProvider::is_connected() const
+{
+    return socket_.valid();
+}
+
+bool RemoteCandidateProvider::is_fallback() const
+{
+    return last_fallback_;
+}
+
+bool RemoteCandidateProvider::server_usable() const
+{
+    return !retry_at_ || std::chrono::steady_clock::now() >= *retry_at_;
+}
+
+void RemoteCandidateProvider::mark_server_down()
+{
+    if (!retry_at_)
+    {
+        spdlog::warn("Engine server {} is not answering, querying in-process.", socket_path_);
+    }
+    retry_at_ = std::chrono::steady_clock::now() + kRetryInterval;
+}
+
+ICandidateProvider &RemoteCandidateProvider::fallback()
+{
+    if (!fallback_)
+    {
+        fallback_ = std::make_unique<PinyinCandidateProvider>();
+    }
+    return *fallback_;
+}
+
+/**
+ * @brief One request and its reply within kTimeout, reconnecting once if the connection was dropped
+ *
+ * A reply that arrives after the timeout would be read as the reply of the next request, so the connection is
+ * closed on every failure.
+ */
+bool RemoteCandidateProvider::round_trip(MessageType type, const std::string &payload, MessageType &reply_type,
+                                         std::string &reply)
+{
+    const auto deadline = std::chrono::steady_clock::now() + kTimeout;
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        const auto remaining =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+        {
+            break;
+        }
+        if (!socket_.valid())
+        {
+            socket_ = LocalSocket::connect(socket_path_);
+            if (!socket_.valid())
+            {
+                return false;
+            }
+        }
+        if (socket_.set_timeout(remaining) && EngineProtocol::send_message(socket_, type, payload) &&
+            EngineProtocol::recv_message(socket_, reply_type, reply))
+        {
+            return true;
+        }
+        /* Server restarted, dropped the connection or timed out, reconnect once */
+        socket_.close();
+    }
+    return false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "candidate_provider.h"
+#include "../server/local_socket.h"
+#include "../server/engine_protocol.h"
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Thin client of the engine server, every query is one request/response round trip over a local socket. The
+// connection is opened lazily and re-opened once per call if the server went away. A call gets kTimeout for its
+// round trip; when the server cannot be reached or does not answer in time, queries are answered by an in-process
+// PinyinCandidateProvider, created on first use, and the server is only tried again after kRetryInterval.
+class RemoteCandidateProvider : public ICandidateProvider
+{
+  public:
+    static constexpr std::chrono::milliseconds kTimeout{200};
+    static constexpr std::chrono::milliseconds kRetryInterval{5000};
+
+    RemoteCandidateProvider();
+    explicit RemoteCandidateProvider(std::string socket_path);
+
+    std::vector<WordItem> query(const QueryRequest &request) override;
+    bool partial() const override;
+    void reset_cache() override;
+    bool reload() override;
+    bool reloading() const override;
+
+    bool is_connected() const;
+    // Whether the last query was answered in-process
+    bool is_fallback() const;
+
+  private:
+    bool server_usable() const;
+    void mark_server_down();
+    ICandidateProvider &fallback();
+    bool round_trip(EngineProtocol::MessageType type, const std::string &payload,
+                    EngineProtocol::MessageType &reply_type, std::string &reply);
+
+  private:
+    std::string socket_path_;
+    LocalSocket socket_;
+    SchemeType scheme_ = SchemeType::Shuangpin; // Scheme of the last query, target of reset_cache and reload
+    std::string request_buffer_;
+    std::string reply_buffer_;
+
+    std::unique_ptr<ICandidateProvider> fallback_;
+    std::optional<std::chrono::steady_clock::time_point> retry_at_; // Set while the server is considered down
+    bool last_fallback_ = false;
+    bool server_partial_ = false; // Reported with the last reply of the server
+};
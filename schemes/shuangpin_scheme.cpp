@@ -14,6 +14,7 @@ void ShuangpinScheme::reset()
 {
     raw_input_.clear();
     key_strokes_.clear();
+    analyzer_.reset();
 }
 
 void ShuangpinScheme::handle_key(UINT vk, UINT modifiers_down, WCHAR wch)
@@ -28,6 +29,7 @@ void ShuangpinScheme::handle_key(UINT vk, UINT modifiers_down, WCHAR wch)
         {
             key_strokes_.pop_back();
         }
+        analyzer_.pop();
         return;
     }
 
@@ -55,6 +57,7 @@ void ShuangpinScheme::handle_key(UINT vk, UINT modifiers_down, WCHAR wch)
     {
         raw_input_.push_back(static_cast<char>(vk + ('a' - 'A')));
     }
+    analyzer_.push(raw_input_.back());
 }
 
 QueryRequest ShuangpinScheme::build_request() const
@@ -70,8 +73,8 @@ QueryRequest ShuangpinScheme::build_request() const
         return request;
     }
 
-    const std::string segmentation = PinyinUtil::pinyin_segmentation(raw_input_);
-    request.segmentation = PinyinUtil::convert_seg_shuangpin_to_seg_complete_pinyin(segmentation);
+    request.analysis = analyzer_.analysis();
+    request.segmentation = PinyinUtil::convert_seg_shuangpin_to_seg_complete_pinyin(request.analysis.segmentation());
     request.normalized_input = boost::replace_all_copy(request.segmentation, "'", "");
     return request;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "input_scheme.h"
+#include "../shuangpin/pinyin_analyzer.h"
 #include <string>
 #include <vector>
 
@@ -16,4 +17,5 @@ class ShuangpinScheme : public IInputScheme
   private:
     std::string raw_input_;
     std::vector<KeyStroke> key_strokes_;
+    PinyinAnalyzer analyzer_;
 };
@@ -0,0 +1,337 @@
+#include "engine_protocol.h"
+#include "local_socket.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace EngineProtocol
+{
+namespace
+{
+void put_u8(std::string &out, uint8_t value)
+{
+    out.push_back(static_cast<char>(value));
+}
+
+void put_u16(std::string &out, uint16_t value)
+{
+    out.push_back(static_cast<char>(value & 0xff));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void put_u32(std::string &out, uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        out.push_back(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+void put_string(std::string &out, std::string_view value)
+{
+    const size_t size = std::min<size_t>(value.size(), UINT16_MAX);
+    put_u16(out, static_cast<uint16_t>(size));
+    out.append(value.data(), size);
+}
+
+void put_spans(std::string &out, const std::vector<SyllableSpan> &spans)
+{
+    const size_t count = std::min<size_t>(spans.size(), UINT16_MAX);
+    put_u16(out, static_cast<uint16_t>(count));
+    for (size_t i = 0; i < count; ++i)
+    {
+        put_u16(out, spans[i].begin);
+        put_u16(out, spans[i].length);
+    }
+}
+
+// Bounds-checked cursor over a payload, every read fails once the payload is exhausted
+class Reader
+{
+  public:
+    explicit Reader(std::string_view data) : data_(data)
+    {
+    }
+
+    bool u8(uint8_t &value)
+    {
+        if (data_.size() - pos_ < 1)
+            return false;
+        value = static_cast<uint8_t>(data_[pos_++]);
+        return true;
+    }
+
+    bool u16(uint16_t &value)
+    {
+        if (data_.size() - pos_ < 2)
+            return false;
+        value = static_cast<uint16_t>(byte(0) | byte(1) << 8);
+        pos_ += 2;
+        return true;
+    }
+
+    bool u32(uint32_t &value)
+    {
+        if (data_.size() - pos_ < 4)
+            return false;
+        value = byte(0) | byte(1) << 8 | byte(2) << 16 | byte(3) << 24;
+        pos_ += 4;
+        return true;
+    }
+
+    bool string(std::string &value)
+    {
+        uint16_t size;
+        if (!u16(size) || data_.size() - pos_ < size)
+            return false;
+        value.assign(data_.data() + pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    // Spans must lie within a sequence of size keys
+    bool spans(std::vector<SyllableSpan> &value, size_t size)
+    {
+        uint16_t count;
+        if (!u16(count))
+            return false;
+        value.resize(count);
+        for (auto &span : value)
+        {
+            if (!u16(span.begin) || !u16(span.length) || size_t{span.begin} + span.length > size)
+                return false;
+        }
+        return true;
+    }
+
+    bool done() const
+    {
+        return pos_ == data_.size();
+    }
+
+  private:
+    uint32_t byte(size_t offset) const
+    {
+        return static_cast<uint8_t>(data_[pos_ + offset]);
+    }
+
+  private:
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+/**
+ * @brief The scheme's analysis, so that the server skips the per-key replay just like an in-process provider
+ */
+void put_analysis(std::string &out, const PinyinAnalysis &analysis)
+{
+    put_string(out, analysis.pinyin);
+    put_string(out, analysis.pinyin_with_cases);
+    put_spans(out, analysis.syllables);
+    put_u8(out, analysis.all_complete ? 1 : 0);
+    put_u8(out, static_cast<uint8_t>(analysis.helpcode_mode));
+    put_u16(out, static_cast<uint16_t>(std::min<size_t>(analysis.helpcode_pos, UINT16_MAX)));
+    put_spans(out, analysis.pure_syllables);
+    put_u8(out, analysis.pure_all_complete ? 1 : 0);
+}
+
+bool read_analysis(Reader &reader, PinyinAnalysis &analysis)
+{
+    uint8_t all_complete, helpcode_mode, pure_all_complete;
+    uint16_t helpcode_pos;
+    if (!reader.string(analysis.pinyin) || !reader.string(analysis.pinyin_with_cases) ||
+        analysis.pinyin_with_cases.size() != analysis.pinyin.size() ||
+        !reader.spans(analysis.syllables, analysis.pinyin.size()) || !reader.u8(all_complete) ||
+        !reader.u8(helpcode_mode) || helpcode_mode > static_cast<uint8_t>(HelpcodeMode::Full) ||
+        !reader.u16(helpcode_pos) || helpcode_pos > analysis.pinyin.size() ||
+        !reader.spans(analysis.pure_syllables, helpcode_pos) || !reader.u8(pure_all_complete))
+        return false;
+    analysis.all_complete = all_complete != 0;
+    analysis.helpcode_mode = static_cast<HelpcodeMode>(helpcode_mode);
+    analysis.helpcode_pos = helpcode_pos;
+    analysis.pure_all_complete = pure_all_complete != 0;
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Create dir with mode 0700, or accept an existing one only if it is a real directory of this user that
+ * nobody else can enter
+ *
+ * Another user could otherwise create the directory first and bind, or swap in, the socket clients connect to.
+ */
+bool ensure_private_directory(const std::string &dir)
+{
+    if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+        return false;
+    struct stat info;
+    if (::lstat(dir.c_str(), &info) != 0)
+        return false;
+    return S_ISDIR(info.st_mode) && info.st_uid == ::getuid() && (info.st_mode & 077) == 0;
+}
+#endif
+} // namespace
+
+std::string default_socket_path()
+{
+#ifdef _WIN32
+    /* The profile directory is only accessible to its user */
+    const char *local_appdata = std::getenv("LOCALAPPDATA");
+    if (!local_appdata || !*local_appdata)
+        return std::string();
+    return std::string(local_appdata) + "\\MetasequoiaImeTsf\\engine.sock";
+#else
+    const char *runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    const std::string dir = runtime_dir && *runtime_dir ? std::string(runtime_dir)
+                                                        : "/tmp/metasequoia-ime-" + std::to_string(::getuid());
+    if (!ensure_private_directory(dir))
+        return std::string();
+    return dir + "/metasequoia-ime-engine.sock";
+#endif
+}
+
+void encode_request(const QueryRequest &request, std::string &payload)
+{
+    payload.clear();
+    put_u8(payload, static_cast<uint8_t>(request.scheme));
+    put_u8(payload, request.valid ? 1 : 0);
+    put_string(payload, request.raw_input);
+    put_string(payload, request.normalized_input);
+    put_string(payload, request.segmentation);
+    put_string(payload, request.context);
+    const size_t key_count = std::min<size_t>(request.key_strokes.size(), UINT16_MAX);
+    put_u16(payload, static_cast<uint16_t>(key_count));
+    for (size_t i = 0; i < key_count; ++i)
+    {
+        const KeyStroke &key_stroke = request.key_strokes[i];
+        put_u32(payload, static_cast<uint32_t>(key_stroke.vk));
+        put_u32(payload, static_cast<uint32_t>(key_stroke.modifiers_down));
+        put_u16(payload, static_cast<uint16_t>(key_stroke.wch));
+    }
+    put_analysis(payload, request.analysis);
+    /* The deadline travels as the remaining budget, the two processes need not share a steady_clock epoch */
+    put_u8(payload, request.deadline ? 1 : 0);
+    if (request.deadline)
+    {
+        const auto remaining =
+            std::chrono::duration_cast<std::chrono::microseconds>(*request.deadline - std::chrono::steady_clock::now());
+        put_u32(payload, static_cast<uint32_t>(std::clamp<long long>(remaining.count(), 0, UINT32_MAX)));
+    }
+    put_u8(payload, request.typo_correction ? 1 : 0);
+}
+
+bool decode_request(std::string_view payload, QueryRequest &request)
+{
+    Reader reader(payload);
+    uint8_t scheme, valid;
+    uint16_t key_count;
+    if (!reader.u8(scheme) || !reader.u8(valid) || scheme > static_cast<uint8_t>(SchemeType::Wubi))
+        return false;
+    if (!reader.string(request.raw_input) || !reader.string(request.normalized_input) ||
+        !reader.string(request.segmentation) || !reader.string(request.context) || !reader.u16(key_count))
+        return false;
+    request.scheme = static_cast<SchemeType>(scheme);
+    request.valid = valid != 0;
+    request.key_strokes.resize(key_count);
+    for (auto &key_stroke : request.key_strokes)
+    {
+        uint32_t vk, modifiers_down;
+        uint16_t wch;
+        if (!reader.u32(vk) || !reader.u32(modifiers_down) || !reader.u16(wch))
+            return false;
+        key_stroke.vk = vk;
+        key_stroke.modifiers_down = modifiers_down;
+        key_stroke.wch = static_cast<WCHAR>(wch);
+    }
+    uint8_t has_deadline;
+    if (!read_analysis(reader, request.analysis) || !reader.u8(has_deadline))
+        return false;
+    request.deadline.reset();
+    if (has_deadline)
+    {
+        uint32_t budget_us;
+        if (!reader.u32(budget_us))
+            return false;
+        request.deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+    }
+    uint8_t typo_correction;
+    if (!reader.u8(typo_correction))
+        return false;
+    request.typo_correction = typo_correction != 0;
+    return reader.done();
+}
+
+void encode_candidates(const std::vector<WordItem> &candidates, bool partial, std::string &payload)
+{
+    payload.clear();
+    put_u8(payload, partial ? 1 : 0);
+    put_u32(payload, static_cast<uint32_t>(candidates.size()));
+    for (const auto &[code, word, weight] : candidates)
+    {
+        put_string(payload, code);
+        put_string(payload, word);
+        put_u32(payload, static_cast<uint32_t>(weight));
+    }
+}
+
+bool decode_candidates(std::string_view payload, std::vector<WordItem> &candidates, bool &partial)
+{
+    Reader reader(payload);
+    uint8_t partial_flag;
+    uint32_t count;
+    if (!reader.u8(partial_flag) || !reader.u32(count) || count > payload.size())
+        return false;
+    partial = partial_flag != 0;
+    candidates.clear();
+    candidates.reserve(count);
+    std::string code, word;
+    uint32_t weight;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!reader.string(code) || !reader.string(word) || !reader.u32(weight))
+            return false;
+        candidates.emplace_back(code, word, static_cast<int>(weight));
+    }
+    return reader.done();
+}
+
+bool send_message(LocalSocket &socket, MessageType type, std::string_view payload)
+{
+    if (payload.size() > kMaxPayloadSize)
+        return false;
+    /* Header and payload in one write, a reply is a single send on the wire */
+    std::string message;
+    message.reserve(kHeaderSize + payload.size());
+    put_u16(message, kMagic);
+    put_u8(message, kVersion);
+    put_u8(message, static_cast<uint8_t>(type));
+    put_u32(message, static_cast<uint32_t>(payload.size()));
+    message.append(payload.data(), payload.size());
+    return socket.send_all(message.data(), message.size());
+}
+
+bool recv_message(LocalSocket &socket, MessageType &type, std::string &payload)
+{
+    char header[kHeaderSize];
+    if (!socket.recv_all(header, sizeof(header)))
+        return false;
+    Reader reader(std::string_view(header, sizeof(header)));
+    uint16_t magic;
+    uint8_t version, raw_type;
+    uint32_t payload_size;
+    reader.u16(magic);
+    reader.u8(version);
+    reader.u8(raw_type);
+    reader.u32(payload_size);
+    if (magic != kMagic || version != kVersion || payload_size > kMaxPayloadSize)
+        return false;
+    type = static_cast<MessageType>(raw_type);
+    payload.resize(payload_size);
+    return payload_size == 0 || socket.recv_all(&payload[0], payload_size);
+}
+} // namespace EngineProtocol
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../core/query_request.h"
+#include "../core/word_item.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class LocalSocket;
+
+// Wire format between the engine server and RemoteCandidateProvider. Every message is an 8-byte header (magic,
+// version, type, payload size) followed by the payload. Integers are little-endian, strings are a u16 byte length
+// followed by UTF-8 bytes.
+namespace EngineProtocol
+{
+constexpr uint16_t kMagic = 0x534d; // "MS"
+constexpr uint8_t kVersion = 4;
+constexpr size_t kHeaderSize = 8;
+constexpr uint32_t kMaxPayloadSize = 1u << 20;
+
+enum class MessageType : uint8_t
+{
+    Query = 1,      // QueryRequest with the scheme's PinyinAnalysis and the deadline as a budget -> Candidates
+    Candidates = 2, // u8 partial, then the list
+    ResetCache = 3, // scheme -> Ack
+    Reload = 4,     // scheme -> Ack
+    Ack = 5,        // u8 result
+    Error = 6,      // string
+};
+
+// In a directory only the current user can enter, empty if there is none
+std::string default_socket_path();
+
+void encode_request(const QueryRequest &request, std::string &payload);
+bool decode_request(std::string_view payload, QueryRequest &request);
+void encode_candidates(const std::vector<WordItem> &candidates, bool partial, std::string &payload);
+bool decode_candidates(std::string_view payload, std::vector<WordItem> &candidates, bool &partial);
+
+bool send_message(LocalSocket &socket, MessageType type, std::string_view payload);
+bool recv_message(LocalSocket &socket, MessageType &type, std::string &payload);
+} // namespace EngineProtocol
@@ -0,0 +1,162 @@
+#include "engine_server.h"
+#include "engine_protocol.h"
+#include <exception>
+#include <spdlog/spdlog.h>
+
+using EngineProtocol::MessageType;
+
+EngineServer::EngineServer(std::string socket_path, ProviderResolver resolver)
+    : socket_path_(std::move(socket_path)), resolver_(std::move(resolver))
+{
+}
+
+EngineServer::~EngineServer()
+{
+    stop();
+}
+
+bool EngineServer::open()
+{
+    listener_ = LocalSocket::listen(socket_path_);
+    if (!listener_.valid())
+    {
+        spdlog::error("Failed to listen on {}, is another engine server running?", socket_path_);
+        return false;
+    }
+    running_ = true;
+    return true;
+}
+
+void EngineServer::run()
+{
+    while (running_)
+    {
+        LocalSocket socket = listener_.accept();
+        if (!running_)
+        {
+            break;
+        }
+        if (!socket.valid())
+        {
+            continue;
+        }
+        reap_finished_connections();
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        auto connection = std::make_unique<Connection>();
+        connection->socket = std::move(socket);
+        Connection &ref = *connection;
+        connections_.push_back(std::move(connection));
+        ref.thread = std::thread([this, &ref]() { serve(ref); });
+    }
+
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    for (auto &connection : connections_)
+    {
+        connection->socket.shutdown();
+    }
+    for (auto &connection : connections_)
+    {
+        connection->thread.join();
+    }
+    connections_.clear();
+    listener_.close();
+    /* The path is ours unless another server took it over in the meantime */
+    LocalSocket::remove_if_stale(socket_path_);
+}
+
+void EngineServer::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+    /* Wake up the blocking accept, run() then sees running_ == false and cleans up */
+    LocalSocket::connect(socket_path_);
+}
+
+const std::string &EngineServer::socket_path() const
+{
+    return socket_path_;
+}
+
+size_t EngineServer::client_count() const
+{
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    size_t count = 0;
+    for (const auto &connection : connections_)
+    {
+        count += connection->finished ? 0 : 1;
+    }
+    return count;
+}
+
+void EngineServer::serve(Connection &connection)
+{
+    MessageType type;
+    std::string payload;
+    std::string reply;
+    QueryRequest request;
+    std::vector<WordItem> candidates;
+    while (running_ && EngineProtocol::recv_message(connection.socket, type, payload))
+    {
+        try
+        {
+            if (type == MessageType::Query)
+            {
+                if (!EngineProtocol::decode_request(payload, request))
+                {
+                    EngineProtocol::send_message(connection.socket, MessageType::Error, "Malformed query.");
+                    continue;
+                }
+                bool partial;
+                {
+                    std::lock_guard<std::mutex> lock(engine_mutex_);
+                    ICandidateProvider &provider = resolver_(request.scheme);
+                    candidates = provider.query(request);
+                    partial = provider.partial();
+                }
+                EngineProtocol::encode_candidates(candidates, partial, reply);
+                EngineProtocol::send_message(connection.socket, MessageType::Candidates, reply);
+            }
+            else if ((type == MessageType::ResetCache || type == MessageType::Reload) && payload.size() == 1)
+            {
+                bool result = true;
+                {
+                    std::lock_guard<std::mutex> lock(engine_mutex_);
+                    ICandidateProvider &provider = resolver_(static_cast<SchemeType>(payload[0]));
+                    if (type == MessageType::ResetCache)
+                        provider.reset_cache();
+                    else
+                        result = provider.reload();
+                }
+                EngineProtocol::send_message(connection.socket, MessageType::Ack, std::string(1, result ? 1 : 0));
+            }
+            else
+            {
+                EngineProtocol::send_message(connection.socket, MessageType::Error, "Unknown message.");
+            }
+        }
+        catch (const std::exception &e)
+        {
+            EngineProtocol::send_message(connection.socket, MessageType::Error, e.what());
+        }
+    }
+    connection.finished = true;
+}
+
+void EngineServer::reap_finished_connections()
+{
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    for (auto it = connections_.begin(); it != connections_.end();)
+    {
+        if ((*it)->finished)
+        {
+            (*it)->thread.join();
+            it = connections_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
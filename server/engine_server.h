@@ -0,0 +1,53 @@
+#pragma once
+
+#include "local_socket.h"
+#include "../core/scheme_type.h"
+#include "../providers/candidate_provider.h"
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Serves candidate queries to every IME client on the machine from one warm engine. Each client connection gets a
+// thread, queries are serialized on the shared providers, so caches and dictionary memory exist once per machine
+// instead of once per host process.
+class EngineServer
+{
+  public:
+    using ProviderResolver = std::function<ICandidateProvider &(SchemeType)>;
+
+    EngineServer(std::string socket_path, ProviderResolver resolver);
+    ~EngineServer();
+
+    bool open();
+    // Accept clients until stop() is called, blocks the calling thread and closes all connections on return
+    void run();
+    void stop();
+
+    const std::string &socket_path() const;
+    size_t client_count() const;
+
+  private:
+    struct Connection
+    {
+        LocalSocket socket;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    void serve(Connection &connection);
+    void reap_finished_connections();
+
+  private:
+    std::string socket_path_;
+    ProviderResolver resolver_;
+    LocalSocket listener_;
+    std::atomic<bool> running_{false};
+
+    std::mutex engine_mutex_;
+    mutable std::mutex connections_mutex_;
+    std::list<std::unique_ptr<Connection>> connections_;
+};
@@ -0,0 +1,25 @@
+//
+// 引擎服务进程，所有输入法客户端通过本地 socket 共享同一个已经预热的引擎。
+//
+#include "engine_server.h"
+#include "engine_protocol.h"
+#include "../providers/provider_registry.h"
+#include <spdlog/spdlog.h>
+
+int main(int argc, char *argv[])
+{
+    const std::string socket_path = argc > 1 ? argv[1] : EngineProtocol::default_socket_path();
+    /* 服务自己总是在进程内查询 */
+    ProviderRegistry provider_registry(ProviderRegistry::EngineMode::InProcess);
+    EngineServer server(socket_path,
+                        [&provider_registry](SchemeType scheme) -> ICandidateProvider & {
+                            return provider_registry.resolve(scheme);
+                        });
+    if (!server.open())
+    {
+        return 1;
+    }
+    spdlog::info("Engine server listening on {}.", socket_path);
+    server.run();
+    return 0;
+}
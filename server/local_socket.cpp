@@ -0,0 +1,266 @@
+#include "local_socket.h"
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+using NativeSocket = SOCKET;
+
+bool startup_sockets()
+{
+    static const bool started = []() {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+
+void close_native(NativeSocket socket)
+{
+    closesocket(socket);
+}
+
+bool connection_refused()
+{
+    return WSAGetLastError() == WSAECONNREFUSED;
+}
+#else
+using NativeSocket = int;
+
+bool startup_sockets()
+{
+    return true;
+}
+
+void close_native(NativeSocket socket)
+{
+    ::close(socket);
+}
+
+bool connection_refused()
+{
+    return errno == ECONNREFUSED;
+}
+#endif
+
+NativeSocket native(intptr_t handle)
+{
+    return static_cast<NativeSocket>(handle);
+}
+
+bool make_address(const std::string &path, sockaddr_un &address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    return true;
+}
+} // namespace
+
+LocalSocket::LocalSocket(intptr_t handle) : handle_(handle)
+{
+}
+
+LocalSocket::~LocalSocket()
+{
+    close();
+}
+
+LocalSocket::LocalSocket(LocalSocket &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+LocalSocket &LocalSocket::operator=(LocalSocket &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(handle_, other.handle_);
+    }
+    return *this;
+}
+
+LocalSocket LocalSocket::listen(const std::string &path)
+{
+    sockaddr_un address;
+    if (!startup_sockets() || !make_address(path, address))
+    {
+        return LocalSocket();
+    }
+    NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    LocalSocket result(static_cast<intptr_t>(socket));
+    if (!result.valid())
+    {
+        return LocalSocket();
+    }
+    /* A socket file left behind by a previous server that did not exit cleanly, a running server keeps its path */
+    if (!remove_if_stale(path))
+    {
+        return LocalSocket();
+    }
+    if (::bind(socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(socket, 16) != 0)
+    {
+        return LocalSocket();
+    }
+    return result;
+}
+
+LocalSocket LocalSocket::connect(const std::string &path)
+{
+    sockaddr_un address;
+    if (!startup_sockets() || !make_address(path, address))
+    {
+        return LocalSocket();
+    }
+    NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    LocalSocket result(static_cast<intptr_t>(socket));
+    if (!result.valid() || ::connect(socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        return LocalSocket();
+    }
+    return result;
+}
+
+LocalSocket LocalSocket::accept()
+{
+    if (!valid())
+    {
+        return LocalSocket();
+    }
+    NativeSocket socket = ::accept(native(handle_), nullptr, nullptr);
+    return LocalSocket(static_cast<intptr_t>(socket));
+}
+
+/**
+ * @brief Probe the path with a connect, only a refused connection means the file has no server behind it
+ *
+ * A missing file, or any other error, leaves the path alone, bind then reports the problem.
+ *
+ * @param path
+ * @return bool
+ */
+bool LocalSocket::remove_if_stale(const std::string &path)
+{
+    sockaddr_un address;
+    if (!startup_sockets() || !make_address(path, address))
+    {
+        return false;
+    }
+    NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    LocalSocket probe(static_cast<intptr_t>(socket));
+    if (!probe.valid())
+    {
+        return false;
+    }
+    if (::connect(socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0)
+    {
+        return false;
+    }
+    if (connection_refused())
+    {
+        std::remove(path.c_str());
+    }
+    return true;
+}
+
+bool LocalSocket::valid() const
+{
+    return handle_ != kInvalidHandle;
+}
+
+bool LocalSocket::set_timeout(std::chrono::milliseconds timeout)
+{
+    if (!valid())
+    {
+        return false;
+    }
+#ifdef _WIN32
+    const DWORD value = static_cast<DWORD>(timeout.count());
+#else
+    timeval value;
+    value.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    value.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+#endif
+    const char *option = reinterpret_cast<const char *>(&value);
+    return ::setsockopt(native(handle_), SOL_SOCKET, SO_RCVTIMEO, option, sizeof(value)) == 0 &&
+           ::setsockopt(native(handle_), SOL_SOCKET, SO_SNDTIMEO, option, sizeof(value)) == 0;
+}
+
+bool LocalSocket::send_all(const void *data, size_t size)
+{
+    const char *cursor = static_cast<const char *>(data);
+    while (size > 0)
+    {
+#ifdef _WIN32
+        int sent = ::send(native(handle_), cursor, static_cast<int>(size), 0);
+#else
+        ssize_t sent = ::send(native(handle_), cursor, size, MSG_NOSIGNAL);
+#endif
+        if (sent <= 0)
+        {
+            return false;
+        }
+        cursor += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool LocalSocket::recv_all(void *data, size_t size)
+{
+    char *cursor = static_cast<char *>(data);
+    while (size > 0)
+    {
+#ifdef _WIN32
+        int received = ::recv(native(handle_), cursor, static_cast<int>(size), 0);
+#else
+        ssize_t received = ::recv(native(handle_), cursor, size, 0);
+#endif
+        if (received <= 0)
+        {
+            return false;
+        }
+        cursor += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void LocalSocket::shutdown()
+{
+    if (valid())
+    {
+#ifdef _WIN32
+        ::shutdown(native(handle_), SD_BOTH);
+#else
+        ::shutdown(native(handle_), SHUT_RDWR);
+#endif
+    }
+}
+
+void LocalSocket::close()
+{
+    if (valid())
+    {
+        close_native(native(handle_));
+        handle_ = kInvalidHandle;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Stream socket bound to a filesystem path (AF_UNIX). Windows 10 1803 and later support AF_UNIX as well, so the
+// server and the client use the same code on every platform.
+class LocalSocket
+{
+  public:
+    LocalSocket() = default;
+    ~LocalSocket();
+    LocalSocket(const LocalSocket &) = delete;
+    LocalSocket &operator=(const LocalSocket &) = delete;
+    LocalSocket(LocalSocket &&other) noexcept;
+    LocalSocket &operator=(LocalSocket &&other) noexcept;
+
+    // Fails while another server listens on path
+    static LocalSocket listen(const std::string &path);
+    static LocalSocket connect(const std::string &path);
+    LocalSocket accept();
+    // Unlink the socket file at path if connecting to it is refused, false if a server still accepts on it
+    static bool remove_if_stale(const std::string &path);
+
+    bool valid() const;
+    // Every later send or recv on the socket fails once it has waited this long, zero waits forever
+    bool set_timeout(std::chrono::milliseconds timeout);
+    bool send_all(const void *data, size_t size);
+    bool recv_all(void *data, size_t size);
+    // Stop both directions, a thread blocked in recv_all on this socket returns false
+    void shutdown();
+    void close();
+
+  private:
+    explicit LocalSocket(intptr_t handle);
+
+  private:
+    static constexpr intptr_t kInvalidHandle = -1;
+    intptr_t handle_ = kInvalidHandle;
+};
@@ -0,0 +1,57 @@
+#include "atomic_file.h"
+#include <fmt/core.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+std::atomic<unsigned> next_temp{0}; // Threads of one process saving the same file get different temporaries
+
+unsigned long process_id()
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+} // namespace
+
+namespace AtomicFile
+{
+bool replace(const std::string &path, const std::function<bool(std::ostream &)> &writer)
+{
+    const std::string tmp_path = fmt::format("{}.{}.{}.tmp", path, process_id(), next_temp++);
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        const bool written = writer(file);
+        file.close();
+        if (!written || !file)
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+#ifdef _WIN32
+    const bool replaced =
+        MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    const bool replaced = std::rename(tmp_path.c_str(), path.c_str()) == 0;
+#endif
+    if (!replaced)
+    {
+        std::remove(tmp_path.c_str());
+    }
+    return replaced;
+}
+} // namespace AtomicFile
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+/**
+ * @brief Replace a file so that readers see either the old or the new content, never a half-written one
+ *
+ * The content goes to a temporary next to the target, named after the process and the call, so host processes
+ * saving the same file at once never write into each other's temporary. The temporary then takes the target's
+ * place in one step, MoveFileEx on Windows and rename on POSIX, so the target never goes missing in between.
+ */
+namespace AtomicFile
+{
+// writer fills the stream, if it returns false or the stream fails the target is left untouched
+bool replace(const std::string &path, const std::function<bool(std::ostream &)> &writer);
+} // namespace AtomicFile
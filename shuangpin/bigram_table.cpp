@@ -0,0 +1,264 @@
+#include "bigram_table.h"
+#include "utf8_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace
+{
+constexpr char kMagic[4] = {'M', 'S', 'B', 'G'};
+constexpr uint32_t kVersion = 1;
+} // namespace
+
+/**
+ * @brief Map a table built by BigramTable::build
+ *
+ * @param path
+ * @return bool
+ */
+bool BigramTable::open(const std::string &path)
+{
+    close();
+    if (!file_.open(path) || file_.size() < sizeof(Header))
+    {
+        file_.close();
+        return false;
+    }
+    const Header *header = reinterpret_cast<const Header *>(file_.data());
+    const size_t expected = sizeof(Header)                                    //
+                            + sizeof(WordEntry) * size_t{header->word_count}  //
+                            + sizeof(Posting) * size_t{header->posting_count} //
+                            + header->pool_size;                              //
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion ||
+        file_.size() < expected)
+    {
+        file_.close();
+        return false;
+    }
+    header_ = header;
+    words_ = reinterpret_cast<const WordEntry *>(file_.data() + sizeof(Header));
+    postings_ = reinterpret_cast<const Posting *>(words_ + header->word_count);
+    pool_ = reinterpret_cast<const char *>(postings_ + header->posting_count);
+    if (!validate())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void BigramTable::close()
+{
+    file_.close();
+    header_ = nullptr;
+    words_ = nullptr;
+    postings_ = nullptr;
+    pool_ = nullptr;
+}
+
+bool BigramTable::is_open() const
+{
+    return header_ != nullptr;
+}
+
+/**
+ * @brief Most likely words following context
+ *
+ * Tries the whole context first, then backs off to its last character.
+ *
+ * @param context Last committed text
+ * @param limit
+ * @return vector<Association> Views into the mapping, sorted by score desc
+ */
+std::vector<BigramTable::Association> BigramTable::next_words(std::string_view context, size_t limit) const
+{
+    std::vector<Association> res;
+    if (!is_open() || context.empty())
+    {
+        return res;
+    }
+    const WordEntry *entry = find(context);
+    if (!entry || entry->posting_count == 0)
+    {
+        entry = find(Utf8Utils::last_char(context));
+    }
+    if (!entry)
+    {
+        return res;
+    }
+    const size_t count = std::min<size_t>(limit, entry->posting_count);
+    res.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Posting &posting = postings_[entry->posting_begin + i];
+        res.emplace_back(text_of(posting.word_id), posting.score);
+    }
+    return res;
+}
+
+size_t BigramTable::word_count() const
+{
+    return is_open() ? header_->word_count : 0;
+}
+
+/**
+ * @brief Build a table from bigram counts
+ *
+ * @param bigrams (previous word, next word, count), duplicates are summed
+ * @param path
+ * @param max_postings Postings kept per previous word
+ * @return bool
+ */
+bool BigramTable::build(const std::vector<BigramCount> &bigrams, const std::string &path, size_t max_postings)
+{
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> texts;
+    auto id_of = [&](const std::string &word) {
+        auto it = ids.find(word);
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+        const uint32_t id = static_cast<uint32_t>(texts.size());
+        ids.emplace(word, id);
+        texts.push_back(word);
+        return id;
+    };
+
+    std::unordered_map<uint64_t, uint32_t> counts; // (prev id << 32 | next id) -> count
+    for (const auto &[prev, next, count] : bigrams)
+    {
+        if (prev.empty() || next.empty())
+        {
+            continue;
+        }
+        const uint64_t pair_key = (uint64_t{id_of(prev)} << 32) | id_of(next);
+        counts[pair_key] += count;
+    }
+
+    /* Word ids in the file follow hash order */
+    std::vector<uint32_t> order(texts.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::vector<uint64_t> hashes(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        hashes[i] = hash_word(texts[i]);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return hashes[a] < hashes[b]; });
+    std::vector<uint32_t> file_id(texts.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        file_id[order[i]] = i;
+    }
+
+    std::vector<std::vector<Posting>> grouped(texts.size());
+    for (const auto &[pair_key, count] : counts)
+    {
+        grouped[file_id[pair_key >> 32]].push_back({file_id[pair_key & 0xffffffffu], count});
+    }
+
+    std::vector<WordEntry> words(texts.size());
+    std::vector<Posting> postings;
+    std::string pool;
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        const std::string &text = texts[order[i]];
+        auto &group = grouped[i];
+        std::sort(group.begin(), group.end(), [](const Posting &a, const Posting &b) {
+            return a.score != b.score ? a.score > b.score : a.word_id < b.word_id;
+        });
+        if (group.size() > max_postings)
+        {
+            group.resize(max_postings);
+        }
+        words[i] = WordEntry{hashes[order[i]], static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(text.size()),
+                             static_cast<uint32_t>(postings.size()), static_cast<uint32_t>(group.size())};
+        pool += text;
+        postings.insert(postings.end(), group.begin(), group.end());
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.word_count = static_cast<uint32_t>(words.size());
+    header.posting_count = static_cast<uint32_t>(postings.size());
+    header.pool_size = static_cast<uint32_t>(pool.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(words.data()), sizeof(WordEntry) * words.size());
+    file.write(reinterpret_cast<const char *>(postings.data()), sizeof(Posting) * postings.size());
+    file.write(pool.data(), pool.size());
+    return static_cast<bool>(file);
+}
+
+uint64_t BigramTable::hash_word(std::string_view word)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char ch : word)
+    {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Check that every entry stays inside the mapping, next_words and find index it without checks
+ *
+ * @return bool
+ */
+bool BigramTable::validate() const
+{
+    for (uint32_t i = 0; i < header_->word_count; ++i)
+    {
+        const WordEntry &entry = words_[i];
+        if (uint64_t{entry.text_offset} + entry.text_length > header_->pool_size ||
+            uint64_t{entry.posting_begin} + entry.posting_count > header_->posting_count)
+        {
+            return false;
+        }
+        if (i > 0 && words_[i - 1].hash > entry.hash)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header_->posting_count; ++i)
+    {
+        if (postings_[i].word_id >= header_->word_count)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const BigramTable::WordEntry *BigramTable::find(std::string_view word) const
+{
+    const uint64_t hash = hash_word(word);
+    const WordEntry *end = words_ + header_->word_count;
+    const WordEntry *it =
+        std::lower_bound(words_, end, hash, [](const WordEntry &entry, uint64_t value) { return entry.hash < value; });
+    for (; it != end && it->hash == hash; ++it)
+    {
+        if (std::string_view(pool_ + it->text_offset, it->text_length) == word)
+        {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+std::string_view BigramTable::text_of(uint32_t word_id) const
+{
+    const WordEntry &entry = words_[word_id];
+    return std::string_view(pool_ + entry.text_offset, entry.text_length);
+}
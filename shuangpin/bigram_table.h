@@ -0,0 +1,75 @@
+#pragma once
+
+#include "mapped_file.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Memory-mapped next-word table for association (联想)
+ *
+ * File layout, all little-endian:
+ *   Header
+ *   WordEntry[word_count]      sorted by hash, the index is the word id
+ *   Posting[posting_count]     grouped by previous word, each group sorted by score desc
+ *   char[pool_size]            UTF-8 text of all words
+ *
+ * A lookup is a binary search over the word entries plus a slice of the postings, nothing is copied out of the
+ * mapping.
+ */
+class BigramTable
+{
+  public:
+    using Association = std::pair<std::string_view, uint32_t>; // word, score
+    using BigramCount = std::tuple<std::string, std::string, uint32_t>; // previous word, next word, count
+
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const;
+
+    std::vector<Association> next_words(std::string_view context, size_t limit) const;
+    size_t word_count() const;
+
+    static bool build(const std::vector<BigramCount> &bigrams, const std::string &path, size_t max_postings = 32);
+    static uint64_t hash_word(std::string_view word);
+
+  private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t word_count;
+        uint32_t posting_count;
+        uint32_t pool_size;
+        uint32_t reserved; // Keeps the word entries 8-byte aligned
+    };
+
+    struct WordEntry
+    {
+        uint64_t hash;
+        uint32_t text_offset;
+        uint32_t text_length;
+        uint32_t posting_begin;
+        uint32_t posting_count;
+    };
+
+    struct Posting
+    {
+        uint32_t word_id;
+        uint32_t score;
+    };
+
+    bool validate() const;
+    const WordEntry *find(std::string_view word) const;
+    std::string_view text_of(uint32_t word_id) const;
+
+  private:
+    MappedFile file_;
+    const Header *header_ = nullptr;
+    const WordEntry *words_ = nullptr;
+    const Posting *postings_ = nullptr;
+    const char *pool_ = nullptr;
+};
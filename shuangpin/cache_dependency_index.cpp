@@ -0,0 +1,158 @@
+#include "cache_dependency_index.h"
+#include <algorithm>
+
+using namespace std;
+
+void CacheDependencyIndex::add(Cache cache, const PackedKey &key, string_view segmentation)
+{
+    string jp;
+    bool has_empty_segment = segmentation.empty();
+    size_t begin = 0;
+    while (begin <= segmentation.size())
+    {
+        const size_t end = min(segmentation.find('\'', begin), segmentation.size());
+        if (end == begin)
+            has_empty_segment = true;
+        else
+            jp += segmentation[begin];
+        begin = end + 1;
+    }
+    if (has_empty_segment)
+    {
+        put(loose_, Record{Dependent{cache, key}, "", false});
+        return;
+    }
+    put(by_jp_[PackedKey(jp)], Record{Dependent{cache, key}, string(segmentation), false});
+}
+
+void CacheDependencyIndex::add_corrections(Cache cache, const PackedKey &key, string_view code)
+{
+    put(loose_, Record{Dependent{cache, key}, string(code), true});
+}
+
+vector<CacheDependencyIndex::Dependent> CacheDependencyIndex::take(string_view key)
+{
+    vector<Dependent> dependents;
+    auto take_from = [&](vector<Record> &records) {
+        auto kept = records.begin();
+        for (auto &record : records)
+        {
+            if (matches(record, key))
+            {
+                dependents.push_back(record.dependent);
+                continue;
+            }
+            if (&*kept != &record)
+                *kept = std::move(record);
+            ++kept;
+        }
+        size_ -= records.end() - kept;
+        records.erase(kept, records.end());
+    };
+
+    string jp;
+    for (size_t i = 0; i < key.size(); i += 2)
+        jp += key[i];
+    const auto it = by_jp_.find(PackedKey(jp));
+    if (it != by_jp_.end())
+    {
+        take_from(it->second);
+        if (it->second.empty())
+            by_jp_.erase(it);
+    }
+    take_from(loose_);
+    return dependents;
+}
+
+void CacheDependencyIndex::prune(const function<bool(const Dependent &)> &cached)
+{
+    auto prune_records = [&](vector<Record> &records) {
+        const auto kept = remove_if(records.begin(), records.end(),
+                                    [&cached](const Record &record) { return !cached(record.dependent); });
+        size_ -= records.end() - kept;
+        records.erase(kept, records.end());
+    };
+    for (auto it = by_jp_.begin(); it != by_jp_.end();)
+    {
+        prune_records(it->second);
+        it = it->second.empty() ? by_jp_.erase(it) : next(it);
+    }
+    prune_records(loose_);
+}
+
+void CacheDependencyIndex::clear()
+{
+    by_jp_.clear();
+    loose_.clear();
+    size_ = 0;
+}
+
+size_t CacheDependencyIndex::size() const
+{
+    return size_;
+}
+
+/**
+ * @brief Same rule as the queries of build_sql: a complete segment must match both keys of a syllable, a jianpin
+ * segment only its initial
+ *
+ * @param segmentation
+ * @param key
+ * @return bool
+ */
+bool CacheDependencyIndex::covers(string_view segmentation, string_view key)
+{
+    size_t pos = 0;
+    size_t begin = 0;
+    while (begin <= segmentation.size())
+    {
+        const size_t end = min(segmentation.find('\'', begin), segmentation.size());
+        const string_view segment = segmentation.substr(begin, end - begin);
+        if (segment.empty() || pos + 2 > key.size() || key[pos] != segment[0])
+            return false;
+        if (segment.size() == 2 && key[pos + 1] != segment[1])
+            return false;
+        pos += 2;
+        begin = end + 1;
+    }
+    return pos == key.size();
+}
+
+bool CacheDependencyIndex::within_one_edit(string_view a, string_view b)
+{
+    if (a.size() > b.size())
+        swap(a, b);
+    if (b.size() - a.size() > 1)
+        return false;
+    size_t prefix = 0;
+    while (prefix < a.size() && a[prefix] == b[prefix])
+        ++prefix;
+    if (a.size() < b.size())
+        return a.substr(prefix) == b.substr(prefix + 1); // Insertion
+    if (prefix == a.size())
+        return true;
+    if (a.substr(prefix + 1) == b.substr(prefix + 1))
+        return true; // Substitution
+    return prefix + 1 < a.size() && a[prefix] == b[prefix + 1] && a[prefix + 1] == b[prefix] &&
+           a.substr(prefix + 2) == b.substr(prefix + 2); // Swap
+}
+
+void CacheDependencyIndex::put(vector<Record> &records, Record record)
+{
+    const bool known = any_of(records.begin(), records.end(), [&record](const Record &each) {
+        return each.dependent.cache == record.dependent.cache && each.dependent.key == record.dependent.key &&
+               each.code == record.code && each.correction == record.correction;
+    });
+    if (!known)
+    {
+        records.push_back(std::move(record));
+        ++size_;
+    }
+}
+
+bool CacheDependencyIndex::matches(const Record &record, string_view key)
+{
+    if (record.correction)
+        return within_one_edit(record.code, key);
+    return record.code.empty() || covers(record.code, key);
+}
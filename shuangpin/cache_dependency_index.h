@@ -0,0 +1,74 @@
+#pragma once
+
+#include "packed_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Reverse index from dictionary keys to the cached candidate lists that may contain them
+ *
+ * A cached list is registered with the segmentations it was queried with, under the jianpin of each segmentation:
+ * every query shape returns rows of a single jp, so a word under key K can only show up in lists registered under
+ * the initials of K, and only if K matches one of the segmentations. Lists that include typo corrections are kept
+ * aside with the typed code, they depend on every key within one edit of it.
+ *
+ * When a word is created, deleted or re-weighted, take() hands back exactly the cached lists to drop, the rest of
+ * the caches stay warm. Caches evict entries on their own, stale records are pruned once the index grows past
+ * kPruneThreshold.
+ */
+class CacheDependencyIndex
+{
+  public:
+    static constexpr size_t kPruneThreshold = 4096;
+
+    enum class Cache : uint8_t
+    {
+        Pinyin,
+        Series,
+        SingleHelpcode,
+        DoubleHelpcode,
+    };
+
+    struct Dependent
+    {
+        Cache cache;
+        PackedKey key; // Key of the cached list
+    };
+
+    // The cached list was built from the rows of segmentation, e.g. ni'h'k
+    void add(Cache cache, const PackedKey &key, std::string_view segmentation);
+    // The cached list includes typo corrections of code
+    void add_corrections(Cache cache, const PackedKey &key, std::string_view code);
+    // Cached lists whose rows may change when a word under dictionary key changes, their records are dropped
+    std::vector<Dependent> take(std::string_view key);
+    // Drop the records of lists that are no longer cached
+    void prune(const std::function<bool(const Dependent &)> &cached);
+    void clear();
+    size_t size() const;
+
+    // Whether a row under key is returned by the query of segmentation
+    static bool covers(std::string_view segmentation, std::string_view key);
+    // Equal, or one substitution, insertion, deletion or swap of two neighbouring keys apart
+    static bool within_one_edit(std::string_view a, std::string_view b);
+
+  private:
+    struct Record
+    {
+        Dependent dependent;
+        std::string code; // Segmentation, empty if it matches every key, or the typed code of corrections
+        bool correction;
+    };
+
+    void put(std::vector<Record> &records, Record record);
+    static bool matches(const Record &record, std::string_view key);
+
+  private:
+    std::unordered_map<PackedKey, std::vector<Record>> by_jp_;
+    std::vector<Record> loose_; // Corrections, and segmentations with an empty segment that match every key
+    size_t size_ = 0;
+};
@@ -5,9 +5,10 @@ namespace CommonUtils
 {
 std::wstring string_to_wstring(const std::string &str)
 {
-    std::u16string utf16result;
-    utf8::utf8to16(str.begin(), str.end(), std::back_inserter(utf16result));
-    return std::wstring(utf16result.begin(), utf16result.end());
+    std::wstring result;
+    result.reserve(str.size());
+    utf8::utf8to16(str.begin(), str.end(), std::back_inserter(result));
+    return result;
 }
 
 std::string wstring_to_string(const std::wstring &wstr)
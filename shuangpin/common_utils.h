@@ -43,6 +43,11 @@ template <typename Key, typename Value> class CircularBuffer
         return std::nullopt;
     }
 
+    bool contains(const Key &key) const
+    {
+        return _map.find(key) != _map.end();
+    }
+
     bool remove(const Key &key)
     {
         auto it = _map.find(key);
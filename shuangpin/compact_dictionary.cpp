@@ -0,0 +1,483 @@
+#include "compact_dictionary.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+constexpr char kMagic[4] = {'M', 'S', 'C', 'D'};
+constexpr uint32_t kVersion = 1;
+
+inline unsigned popcount64(uint64_t word)
+{
+#ifdef _MSC_VER
+    return static_cast<unsigned>(__popcnt64(word));
+#else
+    return static_cast<unsigned>(__builtin_popcountll(word));
+#endif
+}
+
+uint32_t bits_for(uint64_t max_value)
+{
+    uint32_t bits = 1;
+    while (bits < 32 && (max_value >> bits) != 0)
+    {
+        ++bits;
+    }
+    return bits;
+}
+
+void append_front_coded(const std::vector<std::string> &sorted, uint32_t block_size, std::string &blocks,
+                        std::vector<uint32_t> &block_offsets)
+{
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const std::string &cur = sorted[i];
+        if (i % block_size == 0)
+        {
+            block_offsets.push_back(static_cast<uint32_t>(blocks.size()));
+            blocks += static_cast<char>(cur.size());
+            blocks += cur;
+            continue;
+        }
+        const std::string &prev = sorted[i - 1];
+        size_t shared = 0;
+        while (shared < prev.size() && shared < cur.size() && prev[shared] == cur[shared])
+        {
+            ++shared;
+        }
+        blocks += static_cast<char>(shared);
+        blocks += static_cast<char>(cur.size() - shared);
+        blocks.append(cur, shared, std::string::npos);
+    }
+    block_offsets.push_back(static_cast<uint32_t>(blocks.size()));
+}
+
+// Bits set at every position in starts, plus a sentinel at bit_count - 1, and the rank directory
+void build_rank_select(const std::vector<size_t> &starts, size_t bit_count, std::vector<uint64_t> &words,
+                       std::vector<uint32_t> &ranks)
+{
+    words.assign((bit_count + 63) / 64, 0);
+    for (size_t pos : starts)
+    {
+        words[pos / 64] |= uint64_t{1} << (pos % 64);
+    }
+    words[(bit_count - 1) / 64] |= uint64_t{1} << ((bit_count - 1) % 64);
+    ranks.assign(words.size() + 1, 0);
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        ranks[i + 1] = ranks[i] + popcount64(words[i]);
+    }
+}
+
+std::vector<uint64_t> pack(const std::vector<uint32_t> &values, uint32_t bits)
+{
+    std::vector<uint64_t> words((values.size() * bits + 63) / 64 + 1, 0);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const size_t bit = i * bits;
+        const uint64_t value = values[i];
+        words[bit / 64] |= value << (bit % 64);
+        if (bit % 64 + bits > 64)
+        {
+            words[bit / 64 + 1] |= value >> (64 - bit % 64);
+        }
+    }
+    return words;
+}
+
+template <typename T> void append_section(std::string &file, const T *data, size_t count)
+{
+    file.append(reinterpret_cast<const char *>(data), sizeof(T) * count);
+    file.append((8 - file.size() % 8) % 8, '\0');
+}
+} // namespace
+
+/**
+ * @brief Map a dictionary built by CompactDictionary::build
+ *
+ * @param path
+ * @return bool
+ */
+bool CompactDictionary::open(const std::string &path)
+{
+    close();
+    if (!file_.open(path) || file_.size() < sizeof(Header))
+    {
+        file_.close();
+        return false;
+    }
+    const Header *header = reinterpret_cast<const Header *>(file_.data());
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion ||
+        file_.size() < header->sections[SectionCount])
+    {
+        file_.close();
+        return false;
+    }
+    header_ = header;
+    keys_ = FrontCoded{reinterpret_cast<const uint8_t *>(section(KeyBlocks)),
+                       reinterpret_cast<const uint32_t *>(section(KeyBlockOffsets)), header->key_count};
+    key_starts_ = RankSelect{reinterpret_cast<const uint64_t *>(section(KeyStarts)),
+                             reinterpret_cast<const uint32_t *>(section(KeyStartRanks)),
+                             section_size(KeyStarts) / sizeof(uint64_t)};
+    value_ids_ = Packed{reinterpret_cast<const uint64_t *>(section(ValueIds)), header->value_bits};
+    weights_ = reinterpret_cast<const uint16_t *>(section(Weights));
+    value_offsets_ = reinterpret_cast<const uint32_t *>(section(ValueOffsets));
+    pool_ = section(Pool);
+    jianpin_ = FrontCoded{reinterpret_cast<const uint8_t *>(section(JianpinBlocks)),
+                          reinterpret_cast<const uint32_t *>(section(JianpinBlockOffsets)), header->jianpin_count};
+    jianpin_starts_ = RankSelect{reinterpret_cast<const uint64_t *>(section(JianpinStarts)),
+                                 reinterpret_cast<const uint32_t *>(section(JianpinStartRanks)),
+                                 section_size(JianpinStarts) / sizeof(uint64_t)};
+    jianpin_postings_ = Packed{reinterpret_cast<const uint64_t *>(section(JianpinPostings)), header->entry_bits};
+    return true;
+}
+
+void CompactDictionary::close()
+{
+    file_.close();
+    header_ = nullptr;
+}
+
+bool CompactDictionary::is_open() const
+{
+    return header_ != nullptr;
+}
+
+std::vector<CompactDictionary::Hit> CompactDictionary::lookup(std::string_view key, size_t offset,
+                                                              size_t limit) const
+{
+    std::vector<Hit> hits;
+    if (!is_open())
+    {
+        return hits;
+    }
+    const int64_t index = keys_.find(key);
+    if (index < 0)
+    {
+        return hits;
+    }
+    const size_t begin = key_starts_.select1(static_cast<size_t>(index)) + offset;
+    const size_t end = std::min(key_starts_.select1(static_cast<size_t>(index) + 1), begin + limit);
+    for (size_t entry = begin; entry < end; ++entry)
+    {
+        hits.push_back(decode_entry(entry, std::string(key)));
+    }
+    return hits;
+}
+
+std::vector<CompactDictionary::Hit> CompactDictionary::lookup_jianpin(std::string_view jp, size_t offset,
+                                                                      size_t limit) const
+{
+    std::vector<Hit> hits;
+    if (!is_open())
+    {
+        return hits;
+    }
+    const int64_t index = jianpin_.find(jp);
+    if (index < 0)
+    {
+        return hits;
+    }
+    const size_t begin = jianpin_starts_.select1(static_cast<size_t>(index)) + offset;
+    const size_t end = std::min(jianpin_starts_.select1(static_cast<size_t>(index) + 1), begin + limit);
+    for (size_t posting = begin; posting < end; ++posting)
+    {
+        const size_t entry = jianpin_postings_.get(posting);
+        /* 条目按 key 排序，条目之前（含）的 key 起点个数减一就是它的 key */
+        const size_t key_index = key_starts_.rank1(entry + 1) - 1;
+        hits.push_back(decode_entry(entry, keys_.at(static_cast<uint32_t>(key_index))));
+    }
+    return hits;
+}
+
+size_t CompactDictionary::entry_count() const
+{
+    return is_open() ? header_->entry_count : 0;
+}
+
+size_t CompactDictionary::key_count() const
+{
+    return is_open() ? header_->key_count : 0;
+}
+
+CompactDictionary::Footprint CompactDictionary::footprint() const
+{
+    Footprint footprint;
+    if (!is_open())
+    {
+        return footprint;
+    }
+    footprint.keys = section_size(KeyBlocks) + section_size(KeyBlockOffsets);
+    footprint.key_starts = section_size(KeyStarts) + section_size(KeyStartRanks);
+    footprint.values = section_size(ValueIds);
+    footprint.weights = section_size(Weights);
+    footprint.pool = section_size(ValueOffsets) + section_size(Pool);
+    footprint.jianpin = section_size(JianpinBlocks) + section_size(JianpinBlockOffsets) +
+                        section_size(JianpinStarts) + section_size(JianpinStartRanks) +
+                        section_size(JianpinPostings);
+    footprint.total = file_.size();
+    return footprint;
+}
+
+/**
+ * @brief Build a compact dictionary file
+ *
+ * @param rows Reordered in place
+ * @param path
+ * @return bool
+ */
+bool CompactDictionary::build(std::vector<Row> &rows, const std::string &path)
+{
+    /* 前缀编码用一个字节存长度 */
+    rows.erase(std::remove_if(rows.begin(), rows.end(),
+                              [](const Row &row) {
+                                  return row.key.empty() || row.key.size() > 255 || row.jp.size() > 255;
+                              }),
+               rows.end());
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        if (a.key != b.key)
+            return a.key < b.key;
+        return a.weight != b.weight ? a.weight > b.weight : a.value < b.value;
+    });
+
+    int max_weight = 1;
+    for (const auto &row : rows)
+    {
+        max_weight = std::max(max_weight, row.weight);
+    }
+    const double weight_scale = 65535.0 / std::log1p(static_cast<double>(max_weight));
+
+    std::vector<std::string> keys;
+    std::vector<size_t> key_starts;
+    std::unordered_map<std::string, uint32_t> value_ids;
+    std::vector<uint32_t> value_offsets{0};
+    std::string pool;
+    std::vector<uint32_t> entry_values;
+    std::vector<uint16_t> weights;
+    std::unordered_map<std::string, std::vector<uint32_t>> jianpin_entries;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const Row &row = rows[i];
+        if (keys.empty() || keys.back() != row.key)
+        {
+            keys.push_back(row.key);
+            key_starts.push_back(i);
+        }
+        auto [it, inserted] = value_ids.emplace(row.value, static_cast<uint32_t>(value_ids.size()));
+        if (inserted)
+        {
+            pool += row.value;
+            value_offsets.push_back(static_cast<uint32_t>(pool.size()));
+        }
+        entry_values.push_back(it->second);
+        const double quantized = std::round(std::log1p(static_cast<double>(std::max(row.weight, 0))) * weight_scale);
+        weights.push_back(static_cast<uint16_t>(std::min(quantized, 65535.0)));
+        jianpin_entries[row.jp].push_back(static_cast<uint32_t>(i));
+    }
+
+    std::vector<std::string> jianpin;
+    jianpin.reserve(jianpin_entries.size());
+    for (const auto &[jp, entries] : jianpin_entries)
+    {
+        jianpin.push_back(jp);
+    }
+    std::sort(jianpin.begin(), jianpin.end());
+    std::vector<uint32_t> jianpin_postings;
+    std::vector<size_t> jianpin_starts;
+    for (const auto &jp : jianpin)
+    {
+        auto &entries = jianpin_entries[jp];
+        std::stable_sort(entries.begin(), entries.end(),
+                         [&rows](uint32_t a, uint32_t b) { return rows[a].weight > rows[b].weight; });
+        jianpin_starts.push_back(jianpin_postings.size());
+        jianpin_postings.insert(jianpin_postings.end(), entries.begin(), entries.end());
+    }
+
+    std::string key_blocks;
+    std::vector<uint32_t> key_block_offsets;
+    append_front_coded(keys, kBlockSize, key_blocks, key_block_offsets);
+    std::string jianpin_blocks;
+    std::vector<uint32_t> jianpin_block_offsets;
+    append_front_coded(jianpin, kBlockSize, jianpin_blocks, jianpin_block_offsets);
+
+    std::vector<uint64_t> key_start_words;
+    std::vector<uint32_t> key_start_ranks;
+    build_rank_select(key_starts, rows.size() + 1, key_start_words, key_start_ranks);
+    std::vector<uint64_t> jianpin_start_words;
+    std::vector<uint32_t> jianpin_start_ranks;
+    build_rank_select(jianpin_starts, jianpin_postings.size() + 1, jianpin_start_words, jianpin_start_ranks);
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.entry_count = static_cast<uint32_t>(rows.size());
+    header.key_count = static_cast<uint32_t>(keys.size());
+    header.jianpin_count = static_cast<uint32_t>(jianpin.size());
+    header.value_count = static_cast<uint32_t>(value_ids.size());
+    header.value_bits = bits_for(value_ids.empty() ? 0 : value_ids.size() - 1);
+    header.entry_bits = bits_for(rows.empty() ? 0 : rows.size() - 1);
+    header.weight_scale = weight_scale;
+
+    std::string file(sizeof(Header), '\0');
+    auto add = [&](Section section, const auto &data) {
+        header.sections[section] = file.size();
+        append_section(file, data.data(), data.size());
+    };
+    add(KeyBlocks, key_blocks);
+    add(KeyBlockOffsets, key_block_offsets);
+    add(KeyStarts, key_start_words);
+    add(KeyStartRanks, key_start_ranks);
+    add(ValueIds, pack(entry_values, header.value_bits));
+    add(Weights, weights);
+    add(ValueOffsets, value_offsets);
+    add(Pool, pool);
+    add(JianpinBlocks, jianpin_blocks);
+    add(JianpinBlockOffsets, jianpin_block_offsets);
+    add(JianpinStarts, jianpin_start_words);
+    add(JianpinStartRanks, jianpin_start_ranks);
+    add(JianpinPostings, pack(jianpin_postings, header.entry_bits));
+    header.sections[SectionCount] = file.size();
+    std::memcpy(file.data(), &header, sizeof(Header));
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+    out.write(file.data(), file.size());
+    return static_cast<bool>(out);
+}
+
+const char *CompactDictionary::section(Section section) const
+{
+    return file_.data() + header_->sections[section];
+}
+
+/**
+ * @brief Size of a section including the up to 7 bytes of padding after it
+ */
+size_t CompactDictionary::section_size(Section section) const
+{
+    return header_->sections[section + 1] - header_->sections[section];
+}
+
+CompactDictionary::Hit CompactDictionary::decode_entry(size_t entry, std::string key) const
+{
+    const uint32_t value_id = value_ids_.get(entry);
+    const uint32_t begin = value_offsets_[value_id];
+    const std::string_view value(pool_ + begin, value_offsets_[value_id + 1] - begin);
+    const int weight = static_cast<int>(std::lround(std::expm1(weights_[entry] / header_->weight_scale)));
+    return Hit{std::move(key), value, weight};
+}
+
+int64_t CompactDictionary::FrontCoded::find(std::string_view s) const
+{
+    if (count == 0)
+    {
+        return -1;
+    }
+    const uint32_t block_count = (count + kBlockSize - 1) / kBlockSize;
+    auto first_of = [this](uint32_t block) {
+        const uint8_t *p = blocks + block_offsets[block];
+        return std::string_view(reinterpret_cast<const char *>(p + 1), p[0]);
+    };
+    /* 最后一个首串不大于 s 的块 */
+    uint32_t lo = 0;
+    uint32_t hi = block_count;
+    while (hi - lo > 1)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (first_of(mid) <= s)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const uint8_t *p = blocks + block_offsets[lo];
+    std::string cur(reinterpret_cast<const char *>(p + 1), p[0]);
+    p += 1 + p[0];
+    const uint32_t in_block = std::min(kBlockSize, count - lo * kBlockSize);
+    for (uint32_t i = 0; i < in_block; ++i)
+    {
+        if (i > 0)
+        {
+            cur.resize(p[0]);
+            cur.append(reinterpret_cast<const char *>(p + 2), p[1]);
+            p += 2 + p[1];
+        }
+        if (cur == s)
+            return int64_t{lo} * kBlockSize + i;
+        if (std::string_view(cur) > s)
+            break;
+    }
+    return -1;
+}
+
+std::string CompactDictionary::FrontCoded::at(uint32_t index) const
+{
+    const uint8_t *p = blocks + block_offsets[index / kBlockSize];
+    std::string cur(reinterpret_cast<const char *>(p + 1), p[0]);
+    p += 1 + p[0];
+    for (uint32_t i = 0; i < index % kBlockSize; ++i)
+    {
+        cur.resize(p[0]);
+        cur.append(reinterpret_cast<const char *>(p + 2), p[1]);
+        p += 2 + p[1];
+    }
+    return cur;
+}
+
+size_t CompactDictionary::RankSelect::rank1(size_t pos) const
+{
+    const size_t word = pos / 64;
+    const size_t bit = pos % 64;
+    size_t rank = ranks[word];
+    if (bit != 0)
+    {
+        rank += popcount64(words[word] & ((uint64_t{1} << bit) - 1));
+    }
+    return rank;
+}
+
+size_t CompactDictionary::RankSelect::select1(size_t k) const
+{
+    /* 最后一个累计计数不大于 k 的字 */
+    size_t lo = 0;
+    size_t hi = word_count;
+    while (hi - lo > 1)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (ranks[mid] <= k)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    uint64_t word = words[lo];
+    for (size_t remaining = k - ranks[lo]; remaining > 0; --remaining)
+    {
+        word &= word - 1;
+    }
+    size_t bit = 0;
+    while (!(word & 1))
+    {
+        word >>= 1;
+        ++bit;
+    }
+    return lo * 64 + bit;
+}
+
+uint32_t CompactDictionary::Packed::get(size_t index) const
+{
+    const size_t bit = index * bits;
+    uint64_t value = words[bit / 64] >> (bit % 64);
+    if (bit % 64 + bits > 64)
+    {
+        value |= words[bit / 64 + 1] << (64 - bit % 64);
+    }
+    return static_cast<uint32_t>(value & ((uint64_t{1} << bits) - 1));
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Read-only, memory-mapped dictionary for low-memory deployments
+ *
+ * File layout, all little-endian, every section 8-byte aligned:
+ *   Header                  section offsets, counts and the weight scale
+ *   keys                    shuangpin keys, sorted, front-coded in blocks of kBlockSize
+ *   key starts              bit vector over entries, 1 at the first entry of every key, rank directory alongside
+ *   values                  entry -> value id, value_bits wide
+ *   weights                 entry -> weight, 16-bit log scale
+ *   value offsets, pool     every distinct hanzi string once
+ *   jianpin codes           sorted, front-coded
+ *   jianpin starts          bit vector over jianpin postings, like key starts
+ *   jianpin postings        entry ids, entry_bits wide, each jianpin sorted by weight desc
+ *
+ * Entries are sorted by key, then by weight desc, so the words of a key are the run between two set bits of the
+ * key starts. A lookup decodes one key block and only the entries of the requested page.
+ */
+class CompactDictionary
+{
+  public:
+    struct Row
+    {
+        std::string key;
+        std::string jp;
+        std::string value;
+        int weight;
+    };
+
+    struct Hit
+    {
+        std::string key;
+        std::string_view value; // Into the mapping
+        int weight;             // Dequantized, about 0.02% relative error
+    };
+
+    struct Footprint
+    {
+        size_t keys = 0;
+        size_t key_starts = 0;
+        size_t values = 0;
+        size_t weights = 0;
+        size_t pool = 0;
+        size_t jianpin = 0;
+        size_t total = 0;
+    };
+
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const;
+
+    // Words [offset, offset + limit) of an exact key, sorted by weight desc
+    std::vector<Hit> lookup(std::string_view key, size_t offset, size_t limit) const;
+    // Words [offset, offset + limit) of a jianpin code, sorted by weight desc
+    std::vector<Hit> lookup_jianpin(std::string_view jp, size_t offset, size_t limit) const;
+
+    size_t entry_count() const;
+    size_t key_count() const;
+    Footprint footprint() const;
+
+    static bool build(std::vector<Row> &rows, const std::string &path);
+
+  private:
+    static constexpr uint32_t kBlockSize = 16;
+
+    enum Section
+    {
+        KeyBlocks,
+        KeyBlockOffsets,
+        KeyStarts,
+        KeyStartRanks,
+        ValueIds,
+        Weights,
+        ValueOffsets,
+        Pool,
+        JianpinBlocks,
+        JianpinBlockOffsets,
+        JianpinStarts,
+        JianpinStartRanks,
+        JianpinPostings,
+        SectionCount,
+    };
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t entry_count;
+        uint32_t key_count;
+        uint32_t jianpin_count;
+        uint32_t value_count;
+        uint32_t value_bits;
+        uint32_t entry_bits;
+        double weight_scale; // weight = exp(quantized / weight_scale) - 1
+        uint64_t sections[SectionCount + 1];
+    };
+
+    // Sorted strings front-coded in blocks, the first string of a block is stored in full
+    struct FrontCoded
+    {
+        const uint8_t *blocks = nullptr;
+        const uint32_t *block_offsets = nullptr;
+        uint32_t count = 0;
+
+        int64_t find(std::string_view s) const;
+        std::string at(uint32_t index) const;
+    };
+
+    // Bit vector with a cumulative popcount per 64-bit word
+    struct RankSelect
+    {
+        const uint64_t *words = nullptr;
+        const uint32_t *ranks = nullptr;
+        size_t word_count = 0;
+
+        size_t rank1(size_t pos) const;
+        size_t select1(size_t k) const;
+    };
+
+    // Fixed-width unsigned integers packed into 64-bit words
+    struct Packed
+    {
+        const uint64_t *words = nullptr;
+        uint32_t bits = 0;
+
+        uint32_t get(size_t index) const;
+    };
+
+    const char *section(Section section) const;
+    size_t section_size(Section section) const;
+    Hit decode_entry(size_t entry, std::string key) const;
+
+  private:
+    MappedFile file_;
+    const Header *header_ = nullptr;
+    FrontCoded keys_;
+    RankSelect key_starts_;
+    Packed value_ids_;
+    const uint16_t *weights_ = nullptr;
+    const uint32_t *value_offsets_ = nullptr;
+    const char *pool_ = nullptr;
+    FrontCoded jianpin_;
+    RankSelect jianpin_starts_;
+    Packed jianpin_postings_;
+};
@@ -1,6 +1,7 @@
 #include "dictionary.h"
 #include "common_utils.h"
 #include "pinyin_utils.h"
+#include "utf8_utils.h"
 #include <mutex>
 #include <shared_mutex>
 #include <sqlite3.h>
@@ -8,12 +9,15 @@
 #include <tuple>
 #include <unordered_set>
 #include <utility>
-#include <regex>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <limits>
 #include <cstdlib>
 #include "global_ime_vars.h"
 #include "../googlepinyinime-rev/src/include/pinyinime.h"
 #include "spdlog/spdlog.h"
-#include <boost/locale/encoding_utf.hpp>
 #include <boost/algorithm/string.hpp>
 #include <fmt/xchar.h>
 #include <Windows.h>
@@ -54,31 +58,98 @@ vector<string> DictionaryUlPb::single_han_list{
     "在子自做走再最怎作总"  //
 };
 
+namespace
+{
+/* googlepinyin 的解码器是进程内的全局状态，不是线程安全的，所有实例和线程池任务对它的调用都经过这把锁 */
+mutex &decoder_mutex()
+{
+    static mutex instance;
+    return instance;
+}
+
+/* 解码器在进程里只打开一次，所有实例共用打开的结果 */
+once_flag decoder_once;
+atomic<bool> decoder_ready{false};
+
+/**
+ * @brief Open the decoder on the first call in the process, later calls wait for it and return the same result
+ *
+ * @return bool Whether sentences can be decoded
+ */
+bool open_decoder()
+{
+    call_once(decoder_once, []() {
+        lock_guard<mutex> lock(decoder_mutex());
+        // 最多可以输出 64 个汉字，拼音最多可以接受 128 个字符
+        ime_pinyin::im_set_max_lens(128, 64);
+        const bool opened = ime_pinyin::im_open_decoder(                                                            //
+            (fmt::format("{}\\{}\\dict_pinyin.dat", PinyinUtil::get_local_appdata_path(), PinyinUtil::app_name)) //
+                .c_str(),                                                                                         //
+            (fmt::format("{}\\{}\\user_dict.dat", PinyinUtil::get_local_appdata_path(), PinyinUtil::app_name))   //
+                .c_str()                                                                                          //
+        );
+        if (!opened)
+        {
+            spdlog::error("Failed to open googleime dictionary.");
+        }
+        decoder_ready = opened;
+    });
+    return decoder_ready;
+}
+} // namespace
+
 DictionaryUlPb::DictionaryUlPb()
-    : _kb_input_sequence(100), _cached_buffer(128), _cached_buffer_sgl(128), _cached_buffer_dbl(128),
-      _cached_buffer_series(128)
+    : DictionaryUlPb(fmt::format("{}\\{}", PinyinUtil::get_local_appdata_path(), PinyinUtil::app_name))
 {
-    // 最多可以输出 64 个汉字，拼音最多可以接受 128 个字符
-    ime_pinyin::im_set_max_lens(128, 64);
-    bool _res = ime_pinyin::im_open_decoder(                                                                          //
-        (fmt::format("{}\\{}\\dict_pinyin.dat", PinyinUtil::get_local_appdata_path(), PinyinUtil::app_name)).c_str(), //
-        (fmt::format("{}\\{}\\user_dict.dat", PinyinUtil::get_local_appdata_path(), PinyinUtil::app_name)).c_str()    //
-    );
-    if (!_res)
-    {
-        spdlog::error("Failed to open googleime dictionary.");
-    }
+}
 
+/**
+ * @brief Open the system dictionary from %LOCALAPPDATA%, and the user's data from user_data_dir
+ *
+ * @param user_data_dir Directory of the frequency model, the user lexicon journal and the warm cache
+ */
+DictionaryUlPb::DictionaryUlPb(const string &user_data_dir)
+    : _kb_input_sequence(100), _cached_buffer(128), _cached_buffer_sgl(128), _cached_buffer_dbl(128),
+      _cached_buffer_series(128),
+      _sentence_stream([this](const string &quanpin) { return search_sentence_from_ime_engine(quanpin); }),
+      _task_pool(TaskPool::shared()), _background_saves(_task_pool)
+{
+    /* 拼音表和辅助码表很小，立即加载；数据库先只打开，索引和解码器在后台预热 */
+    auto tables = PinyinUtil::tables();
     db_path = fmt::format(                    //
         "{}\\{}\\cutted_flyciku_with_jp.db",  //
         PinyinUtil::get_local_appdata_path(), //
         PinyinUtil::app_name                  //
     );
-    int exit = sqlite3_open(db_path.c_str(), &db);
-    if (exit != SQLITE_OK)
+    _snapshot = DictionarySnapshot::open_unindexed(db_path, 0, tables);
+
+    _user_frequency_path = fmt::format("{}\\user_frequency.dat", user_data_dir);
+    _user_frequency.load(_user_frequency_path);
+    _user_lexicon.load(fmt::format("{}\\user_lexicon.journal", user_data_dir));
+
+    _warm_cache_path = fmt::format("{}\\warm_cache.dat", user_data_dir);
+    if (_warm_cache.load(_warm_cache_path, dictionary_fingerprint()))
     {
-        spdlog::error("Failed to open db.");
+        restore_warm_cache();
     }
+
+    _reloading = true;
+    _reload_thread = thread([this]() { warm_up(); });
+}
+
+/**
+ * @brief Startup work that is too slow for the constructor, runs on the reload thread
+ *
+ * Until it finishes, queries are answered from the unindexed snapshot: plain SQL without the negative-lookup
+ * filter and the key index, and without sentence suggestions from the decoder.
+ *
+ */
+void DictionaryUlPb::warm_up()
+{
+    open_decoder();
+
+    const bool published = build_and_publish(1, current_snapshot()->pinyin_tables());
+    _readiness = published ? Readiness::Ready : Readiness::Failed;
 }
 
 /**
@@ -89,8 +160,26 @@ DictionaryUlPb::DictionaryUlPb()
  * @return vector<DictionaryUlPb::WordItem>
  */
 vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate( //
-    const string &pinyin_sequence,                         //
-    const string &pinyin_segmentation                      //
+    string_view pinyin_sequence,                           //
+    string_view pinyin_segmentation                        //
+)
+{
+    KeyArena::Scope arena_scope(_key_arena);
+    return generate(pinyin_sequence, pinyin_segmentation, nullptr);
+}
+
+/**
+ * @brief Same as generate, the rows of the system layer may have been fetched already by a worker
+ *
+ * @param pinyin_sequence
+ * @param pinyin_segmentation
+ * @param fetched_rows Result of query_system_rows for this code, or nullptr to query here
+ * @return vector<DictionaryUlPb::WordItem>
+ */
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate( //
+    string_view pinyin_sequence,                           //
+    string_view pinyin_segmentation,                       //
+    vector<DictionaryUlPb::WordItem> *fetched_rows         //
 )
 {
     // std::shared_lock lock(mutex_);
@@ -99,7 +188,6 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate( //
     {
         return candidate_list;
     }
-    vector<string> code_list;
     if (pinyin_sequence.size() == 1)
     {
         generate_for_single_char(candidate_list, pinyin_sequence);
@@ -107,27 +195,39 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate( //
     else
     {
         // Check cache first
-        if (_cached_buffer.get(pinyin_sequence))
+        const PackedKey cache_key(pinyin_sequence);
+        if (auto cached = _cached_buffer.get(cache_key))
         {
-            candidate_list = _cached_buffer.get(pinyin_sequence).value();
+            _warm_cache.record_lookup(cache_key, pinyin_sequence, pinyin_segmentation, true);
+            candidate_list = std::move(cached.value());
+            apply_user_frequency(candidate_list);
             return candidate_list;
         }
+        _warm_cache.record_lookup(cache_key, pinyin_sequence, pinyin_segmentation, false);
 
-        vector<string> pinyin_list;
-        boost::split(pinyin_list, pinyin_segmentation, boost::is_any_of("'"));
-        // Build sql for query
-        auto sql_pair = build_sql(pinyin_sequence, pinyin_list);
-        string sql_str = sql_pair.first;
-        if (sql_pair.second) // Need to filter
+        /* 分词和 sql 都是临时对象，放在当前按键的 arena 里 */
+        SegmentList pinyin_list(_key_arena.resource());
+        split_segmentation(pinyin_segmentation, pinyin_list);
+        if (fetched_rows)
         {
-            auto key_value_weight_list = select_complete_data(sql_str);
-            filter_key_value_list(candidate_list, pinyin_list, key_value_weight_list);
+            candidate_list = std::move(*fetched_rows);
+        }
+        else if (!may_have_entries(pinyin_sequence, pinyin_list))
+        { /* 数据库里必然没有这个编码，不用查了 */
+            _cached_buffer.insert(cache_key, candidate_list);
+            _cache_dependencies.add(CacheDependencyIndex::Cache::Pinyin, cache_key, pinyin_segmentation);
+            return candidate_list;
         }
         else
         {
-            candidate_list = select_complete_data(sql_str);
+            const auto snapshot = current_snapshot();
+            candidate_list = query_system_rows(snapshot->db(), snapshot->layout(), pinyin_sequence, pinyin_list,
+                                               _key_arena.resource());
         }
-        _cached_buffer.insert(pinyin_sequence, candidate_list);
+        merge_user_lexicon(candidate_list, pinyin_list);
+        _cached_buffer.insert(cache_key, candidate_list);
+        _cache_dependencies.add(CacheDependencyIndex::Cache::Pinyin, cache_key, pinyin_segmentation);
+        apply_user_frequency(candidate_list);
     }
     return candidate_list;
 }
@@ -135,6 +235,8 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate( //
 /**
  * @brief 对于纯粹的拼音，除了完全匹配的汉字串，子串也要全部给出来，子串是为了给接下来可能会进行的造词使用的
  *
+ * 设了截止时间而查完全码就已超时的话，只返回全码的结果并记为不完整，这样的结果不缓存
+ *
  * @param pinyin_sequence
  * @param pinyin_segmentation
  * @return vector<DictionaryUlPb::WordItem>
@@ -144,12 +246,12 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generateSeries( //
     const string &pinyin_segmentation                            //
 )
 {
+    KeyArena::Scope arena_scope(_key_arena);
     vector<DictionaryUlPb::WordItem> candidate_list;
     if (pinyin_sequence.size() == 0)
     {
         return candidate_list;
     }
-    vector<string> code_list;
     if (pinyin_sequence.size() == 1)
     {
         generate_for_single_char(candidate_list, pinyin_sequence);
@@ -157,53 +259,206 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generateSeries( //
     else
     {
         // 先看一下缓存里有没有
-        if (_cached_buffer_series.get(pinyin_sequence))
+        const PackedKey cache_key(pinyin_sequence);
+        if (auto cached = _cached_buffer_series.get(cache_key))
         {
-            candidate_list = _cached_buffer_series.get(pinyin_sequence).value();
-            return candidate_list;
+            return std::move(cached.value());
         }
 
-        // 查询当前的拼音严格对应的数据
-        vector<DictionaryUlPb::WordItem> cur_pinyin_cand = generate(pinyin_sequence, pinyin_segmentation);
-        if (cur_pinyin_cand.size() > 0)
+        /* 全码在前，然后依次去掉最后一个音节 */
+        SeriesCodeList codes(_key_arena.resource());
+        split_series_codes(pinyin_sequence, pinyin_segmentation, codes);
+
+        /* 有截止时间时先单独查全码，它是首屏的主要来源；查完已经超时就先交出去，其余来源留给不限时的查询 */
+        optional<vector<DictionaryUlPb::WordItem>> cur_pinyin_cand;
+        if (_deadline)
         {
-            candidate_list.insert(candidate_list.end(), cur_pinyin_cand.begin(), cur_pinyin_cand.end());
+            cur_pinyin_cand = generate(codes[0].sequence, codes[0].segmentation, nullptr);
+            if (chrono::steady_clock::now() >= *_deadline)
+            {
+                _partial = true;
+                return std::move(*cur_pinyin_cand);
+            }
         }
-        else
-        { /* 可能数据库查询的结果是空，这时就需要联想，这个只适合在此处联想 */
-            if (candidate_list.size() == 0)
+
+        /* 各个编码的查询互不相关，没缓存的放到线程池里，和整句解码、纠错同时进行 */
+        const string quanpin_str = PinyinUtil::convert_seg_shuangpin_to_seg_complete_pinyin(pinyin_segmentation);
+        pmr::vector<optional<vector<DictionaryUlPb::WordItem>>> fetched(codes.size(), _key_arena.resource());
+        optional<string> sentence;
+        vector<DictionaryUlPb::WordItem> corrected;
+        const auto snapshot = current_snapshot();
+        {
+            TaskPool::Group group(_task_pool);
+            if (fetch_series_in_parallel(group, snapshot, codes, fetched))
+            { /* 全码必然查不到，整句肯定要用 */
+                group.run([this, &sentence, &quanpin_str]() {
+                    sentence = search_sentence_from_ime_engine(quanpin_str);
+                });
+            }
+            /* 可能按错了键，纠错得到的候选排在完全匹配的后面 */
+            if (_typo_correction)
             {
-                string quanpin_str = PinyinUtil::convert_seg_shuangpin_to_seg_complete_pinyin(pinyin_segmentation);
-                string res = search_sentence_from_ime_engine(quanpin_str);
-                if (res.size() > 0)
-                {
-                    candidate_list.push_back(make_tuple(_pinyin_sequence, res, 1));
-                }
+                corrected = generate_typo_corrections(pinyin_sequence);
             }
+            group.wait();
         }
 
-        // 查询当前的拼音子串对应的数据
-        string pure_pinyin = pinyin_sequence;
-        string seg_pinyin = pinyin_segmentation;
-        while (true)
+        // 查询当前的拼音严格对应的数据
+        auto fetched_rows = [&fetched](size_t i) { return fetched[i] ? &*fetched[i] : nullptr; };
+        if (!cur_pinyin_cand)
         {
-            size_t pos = seg_pinyin.rfind('\'');
-            if (pos != string::npos)
+            cur_pinyin_cand = generate(codes[0].sequence, codes[0].segmentation, fetched_rows(0));
+        }
+        if (cur_pinyin_cand->size() > 0)
+        {
+            candidate_list.insert(candidate_list.end(), cur_pinyin_cand->begin(), cur_pinyin_cand->end());
+        }
+        else
+        { /* 可能数据库查询的结果是空，这时就需要联想，这个只适合在此处联想 */
+            if (!sentence)
             {
-                seg_pinyin = seg_pinyin.substr(0, pos);
-                pure_pinyin = boost::algorithm::replace_all_copy(seg_pinyin, "'", "");
-                vector<DictionaryUlPb::WordItem> sub_pinyin_cand = generate(pure_pinyin, seg_pinyin);
-                candidate_list.insert(candidate_list.end(), sub_pinyin_cand.begin(), sub_pinyin_cand.end());
+                sentence = search_sentence_from_ime_engine(quanpin_str);
             }
-            else
+            if (sentence->size() > 0)
             {
-                break;
+                candidate_list.push_back(make_tuple(_pinyin_sequence, std::move(*sentence), 1));
             }
         }
+        candidate_list.insert(candidate_list.end(), make_move_iterator(corrected.begin()),
+                              make_move_iterator(corrected.end()));
+
+        // 查询当前的拼音子串对应的数据
+        for (size_t i = 1; i < codes.size(); ++i)
+        {
+            vector<DictionaryUlPb::WordItem> sub_pinyin_cand =
+                generate(codes[i].sequence, codes[i].segmentation, fetched_rows(i));
+            candidate_list.insert(candidate_list.end(), make_move_iterator(sub_pinyin_cand.begin()),
+                                  make_move_iterator(sub_pinyin_cand.end()));
+        }
         /* 缓存起来 */
-        _cached_buffer_series.insert(pinyin_sequence, candidate_list);
+        _cached_buffer_series.insert(cache_key, candidate_list);
+        track_cached_series(CacheDependencyIndex::Cache::Series, cache_key, pinyin_segmentation, pinyin_sequence);
+    }
+
+    return candidate_list;
+}
+
+/**
+ * @brief The full code and every shorter prefix of it, longest first
+ *
+ * @param pinyin_sequence
+ * @param pinyin_segmentation
+ * @param codes Views of the segmentations point into pinyin_segmentation
+ */
+void DictionaryUlPb::split_series_codes(string_view pinyin_sequence, string_view pinyin_segmentation,
+                                        SeriesCodeList &codes)
+{
+    pmr::memory_resource *resource = codes.get_allocator().resource();
+    codes.push_back(SeriesCode{pmr::string(pinyin_sequence, resource), pinyin_segmentation, SegmentList(resource)});
+    string_view seg_pinyin = pinyin_segmentation;
+    for (size_t pos = seg_pinyin.rfind('\''); pos != string_view::npos; pos = seg_pinyin.rfind('\''))
+    {
+        seg_pinyin = seg_pinyin.substr(0, pos);
+        pmr::string pure_pinyin(resource);
+        for (char c : seg_pinyin)
+        {
+            if (c != '\'')
+                pure_pinyin += c;
+        }
+        codes.push_back(SeriesCode{std::move(pure_pinyin), seg_pinyin, SegmentList(resource)});
+    }
+}
+
+/**
+ * @brief Query the system rows of the uncached codes on the task pool, each task on a reader of its own
+ *
+ * Nothing is submitted unless at least two tasks can overlap, a lone query is cheaper on the typing thread. The
+ * filter is checked here, so codes that cannot have rows never leave the typing thread.
+ *
+ * @param group
+ * @param snapshot Leases the readers, must outlive the group
+ * @param codes
+ * @param fetched fetched[i] receives the rows of codes[i] once the group is done
+ * @return bool Whether the full code has no rows for sure and the sentence is worth decoding in parallel
+ */
+bool DictionaryUlPb::fetch_series_in_parallel(                       //
+    TaskPool::Group &group,                                          //
+    const shared_ptr<DictionarySnapshot> &snapshot,                  //
+    SeriesCodeList &codes,                                           //
+    pmr::vector<optional<vector<DictionaryUlPb::WordItem>>> &fetched //
+)
+{
+    if (_task_pool.workers() == 0)
+    {
+        return false;
+    }
+    pmr::vector<size_t> misses(_key_arena.resource());
+    bool full_code_empty = false;
+    for (size_t i = 0; i < codes.size(); ++i)
+    {
+        SeriesCode &code = codes[i];
+        if (code.sequence.size() < 2 || _cached_buffer.contains(PackedKey(code.sequence)))
+        {
+            continue;
+        }
+        split_segmentation(code.segmentation, code.segments);
+        if (may_have_entries(code.sequence, code.segments))
+        {
+            misses.push_back(i);
+        }
+        else if (i == 0)
+        {
+            full_code_empty = decoder_ready;
+        }
+    }
+    if (misses.size() + full_code_empty < 2)
+    {
+        return false;
+    }
+    for (size_t i : misses)
+    {
+        group.run([this, &snapshot, &code = codes[i], &rows = fetched[i]]() {
+            const auto reader = snapshot->lease_reader();
+            rows = query_system_rows(reader.db(), snapshot->layout(), code.sequence, code.segments,
+                                     pmr::new_delete_resource());
+        });
     }
+    return full_code_empty;
+}
 
+/**
+ * @brief Rows of the system layer for a segmented code, through the given connection
+ *
+ * Reads nothing but its arguments, so workers of the task pool can call it. The layout comes from the snapshot the
+ * connection belongs to, a snapshot published meanwhile cannot change the table names.
+ *
+ * @param db
+ * @param layout Layout of the database behind db
+ * @param pinyin_sequence
+ * @param pinyin_list
+ * @param resource Memory of the sql
+ * @return vector<DictionaryUlPb::WordItem>
+ */
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::query_system_rows( //
+    sqlite3 *db,                                                     //
+    DictionarySchema::Layout layout,                                 //
+    string_view pinyin_sequence,                                     //
+    const SegmentList &pinyin_list,                                  //
+    pmr::memory_resource *resource                                   //
+)
+{
+    vector<DictionaryUlPb::WordItem> candidate_list;
+    // Build sql for query
+    pmr::string sql_str(resource);
+    if (build_sql(layout, pinyin_sequence, pinyin_list, sql_str)) // Need to filter
+    {
+        auto key_value_weight_list = select_complete_data(db, sql_str);
+        filter_key_value_list(candidate_list, pinyin_list, key_value_weight_list);
+    }
+    else
+    {
+        candidate_list = select_complete_data(db, sql_str);
+    }
     return candidate_list;
 }
 
@@ -231,83 +486,74 @@ void DictionaryUlPb::filter_with_single_helpcode(           //
 {
     if (candidate_list.empty())
         return;
-    vector<DictionaryUlPb::WordItem> first_helpcode_matched_list;
-    vector<DictionaryUlPb::WordItem> last_helpcode_matched_list;
-    vector<DictionaryUlPb::WordItem> left_helpcode_matched_list; // 被筛完之后剩下的
+    const auto tables = current_snapshot()->pinyin_tables();
+    /* 只记录指向 candidate_list 的指针，最后再一次性拷贝到结果里 */
+    pmr::vector<const DictionaryUlPb::WordItem *> first_helpcode_matched_list(_key_arena.resource());
+    pmr::vector<const DictionaryUlPb::WordItem *> last_helpcode_matched_list(_key_arena.resource());
+    pmr::vector<const DictionaryUlPb::WordItem *> left_helpcode_matched_list(_key_arena.resource()); // 被筛完之后剩下的
 
     for (const auto &cand : candidate_list)
     {
-        string cur_word = std::get<1>(cand);
-        int count = PinyinUtil::count_utf8_chars(cur_word);
+        const string &cur_word = std::get<1>(cand);
+        size_t count = Utf8Utils::count_chars(cur_word);
         bool is_first_helpcode_matched = false;
         bool is_last_helpcode_matched = false;
         /* 处理当前这个候选项 */
         if (count == 1)
         { /* 单字 */
+            auto helpcode = tables->helpcodes.find(cur_word);
             /* 第一个辅助码匹配上了 */
-            if (PinyinUtil::helpcode_keymap.count(cur_word))
+            if (!helpcode.empty() && helpcode[0] == help_code[0])
             {
-                if (PinyinUtil::helpcode_keymap[cur_word][0] == help_code[0])
-                {
-                    first_helpcode_matched_list.push_back(cand);
-                    is_first_helpcode_matched = true;
-                }
+                first_helpcode_matched_list.push_back(&cand);
+                is_first_helpcode_matched = true;
             }
             /* 看看第二个辅助码是否匹配 */
-            if (!is_first_helpcode_matched)
+            if (!is_first_helpcode_matched && helpcode.size() > 1 && helpcode[1] == help_code[0])
             {
-                if (PinyinUtil::helpcode_keymap.count(cur_word))
-                {
-                    if (PinyinUtil::helpcode_keymap[cur_word][1] == help_code[0])
-                    {
-                        last_helpcode_matched_list.push_back(cand);
-                        is_last_helpcode_matched = true;
-                    }
-                }
+                last_helpcode_matched_list.push_back(&cand);
+                is_last_helpcode_matched = true;
             }
         }
         else
         { /* 多字 */
             /* 第一个字的第一个辅助码匹配上了 */
-            string firstHanChar = PinyinUtil::get_first_han_char(cur_word);
-            if (PinyinUtil::helpcode_keymap.count(firstHanChar))
+            auto first_helpcode = tables->helpcodes.find(Utf8Utils::first_char(cur_word));
+            if (!first_helpcode.empty() && first_helpcode[0] == help_code[0])
             {
-                if (PinyinUtil::helpcode_keymap[firstHanChar][0] == help_code[0])
-                {
-                    first_helpcode_matched_list.push_back(cand);
-                    is_first_helpcode_matched = true;
-                }
+                first_helpcode_matched_list.push_back(&cand);
+                is_first_helpcode_matched = true;
             }
             /* 最后一个字的第一个辅助码匹配上了 */
             if (!is_first_helpcode_matched)
             {
-                string lastHanChar = PinyinUtil::get_last_han_char(cur_word);
-                if (PinyinUtil::helpcode_keymap.count(lastHanChar))
+                auto last_helpcode = tables->helpcodes.find(Utf8Utils::last_char(cur_word));
+                if (!last_helpcode.empty() && last_helpcode[0] == help_code[0])
                 {
-                    if (PinyinUtil::helpcode_keymap[lastHanChar][0] == help_code[0])
-                    {
-                        last_helpcode_matched_list.push_back(cand);
-                        is_last_helpcode_matched = true;
-                    }
+                    last_helpcode_matched_list.push_back(&cand);
+                    is_last_helpcode_matched = true;
                 }
             }
         }
         /* 辅助码都匹配不上 */
         if (!is_first_helpcode_matched && !is_last_helpcode_matched)
         {
-            left_helpcode_matched_list.push_back(cand);
+            left_helpcode_matched_list.push_back(&cand);
         }
     }
 
     /* 辅助码筛出来的候选列表 */
-    result_list.insert(result_list.end(), first_helpcode_matched_list.begin(), first_helpcode_matched_list.end());
-    result_list.insert(result_list.end(), last_helpcode_matched_list.begin(), last_helpcode_matched_list.end());
+    for (const auto *cand : first_helpcode_matched_list)
+        result_list.push_back(*cand);
+    for (const auto *cand : last_helpcode_matched_list)
+        result_list.push_back(*cand);
     /* 把原始拼音的候选列表加到辅助码模式的候选列表后面 */
-    _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pinyin_sequence);
     auto original_candidate_list = generateSeries(_pinyin_sequence, _pinyin_segmentation);
-    result_list.insert(result_list.end(), original_candidate_list.begin(), original_candidate_list.end());
+    result_list.insert(result_list.end(), make_move_iterator(original_candidate_list.begin()),
+                       make_move_iterator(original_candidate_list.end()));
     /* 把剩下的候选列表加到辅助码模式的候选列表后面 */
-    result_list.insert(result_list.end(), left_helpcode_matched_list.begin(), left_helpcode_matched_list.end());
+    for (const auto *cand : left_helpcode_matched_list)
+        result_list.push_back(*cand);
 }
 
 /**
@@ -332,30 +578,27 @@ void DictionaryUlPb::filter_with_double_helpcodes(               //
 {
     if (candidate_list.empty())
         return;
+    const auto tables = current_snapshot()->pinyin_tables();
 
     for (const auto &cand : candidate_list)
     {
-        string cur_word = std::get<1>(cand);
-        int count = PinyinUtil::count_utf8_chars(cur_word);
+        const string &cur_word = std::get<1>(cand);
+        size_t count = Utf8Utils::count_chars(cur_word);
         if (count == 1)
         { /* 单字 */
-            if (PinyinUtil::helpcode_keymap.count(cur_word))
+            auto helpcode = tables->helpcodes.find(cur_word);
+            if (helpcode.size() > 1 && helpcode[0] == help_codes[0] && helpcode[1] == help_codes[1])
             {
-                if (PinyinUtil::helpcode_keymap[cur_word][0] == help_codes[0] &&
-                    PinyinUtil::helpcode_keymap[cur_word][1] == help_codes[1])
-                {
-                    result_list.push_back(cand);
-                }
+                result_list.push_back(cand);
             }
         }
         else
         { /* 多字 */
-            string firstHanChar = PinyinUtil::get_first_han_char(cur_word);
-            string lastHanChar = PinyinUtil::get_last_han_char(cur_word);
-            if (PinyinUtil::helpcode_keymap.count(firstHanChar) && PinyinUtil::helpcode_keymap.count(lastHanChar))
+            auto first_helpcode = tables->helpcodes.find(Utf8Utils::first_char(cur_word));
+            auto last_helpcode = tables->helpcodes.find(Utf8Utils::last_char(cur_word));
+            if (!first_helpcode.empty() && !last_helpcode.empty())
             {
-                if (PinyinUtil::helpcode_keymap[firstHanChar][0] == help_codes[0] &&
-                    PinyinUtil::helpcode_keymap[lastHanChar][0] == help_codes[1])
+                if (first_helpcode[0] == help_codes[0] && last_helpcode[0] == help_codes[1])
                 {
                     result_list.push_back(cand);
                 }
@@ -382,22 +625,22 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_with_helpcodes( //
     const string &help_codes                                              //
 )
 {
+    KeyArena::Scope arena_scope(_key_arena);
     vector<WordItem> candidate_list;
     // Check cache first
+    const PackedKey cache_key(pinyin_sequence);
     if (help_codes.size() == 1)
     {
-        if (_cached_buffer_sgl.get(pinyin_sequence))
+        if (auto cached = _cached_buffer_sgl.get(cache_key))
         {
-            candidate_list = _cached_buffer_sgl.get(pinyin_sequence).value();
-            return candidate_list;
+            return std::move(cached.value());
         }
     }
     else if (help_codes.size() == 2)
     {
-        if (_cached_buffer_dbl.get(pinyin_sequence))
+        if (auto cached = _cached_buffer_dbl.get(cache_key))
         {
-            candidate_list = _cached_buffer_dbl.get(pinyin_sequence).value();
-            return candidate_list;
+            return std::move(cached.value());
         }
     }
 
@@ -411,7 +654,12 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_with_helpcodes( //
             result_list,             //
             help_codes               //
         );
-        _cached_buffer_sgl.insert(pinyin_sequence, result_list);
+        if (!_partial)
+        {
+            _cached_buffer_sgl.insert(cache_key, result_list);
+            track_cached_series(CacheDependencyIndex::Cache::SingleHelpcode, cache_key, pure_pinyin_segmentation,
+                                pure_pinyin);
+        }
     }
     else if (help_codes.size() == 2)
     {
@@ -420,7 +668,12 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_with_helpcodes( //
             result_list,              //
             help_codes                //
         );
-        _cached_buffer_dbl.insert(pinyin_sequence, result_list);
+        if (!_partial)
+        {
+            _cached_buffer_dbl.insert(cache_key, result_list);
+            track_cached_series(CacheDependencyIndex::Cache::DoubleHelpcode, cache_key, pure_pinyin_segmentation,
+                                pure_pinyin);
+        }
     }
     return result_list;
 }
@@ -458,15 +711,11 @@ std::string VkSequenceToString(const UINT *vk_codes, size_t count)
     return result;
 }
 
-void DictionaryUlPb::generate_for_single_char(vector<DictionaryUlPb::WordItem> &candidate_list, string code)
+void DictionaryUlPb::generate_for_single_char(vector<DictionaryUlPb::WordItem> &candidate_list, string_view code)
 {
-    string s = single_han_list[code[0] - 'a'];
-    for (size_t i = 0; i < s.length();)
-    {
-        size_t cplen = PinyinUtil::get_first_char_size(s.substr(i, s.size() - i));
-        candidate_list.push_back(make_tuple(code, s.substr(i, cplen), 1));
-        i += cplen;
-    }
+    Utf8Utils::for_each_char(single_han_list[code[0] - 'a'], [&](std::string_view han) {
+        candidate_list.emplace_back(string(code), string(han), 1);
+    });
 }
 
 /**
@@ -477,6 +726,9 @@ void DictionaryUlPb::generate_for_single_char(vector<DictionaryUlPb::WordItem> &
  */
 int DictionaryUlPb::handleVkCode(UINT vk, UINT modifiers_down, WCHAR wch)
 {
+    /* 上一个按键的临时对象到这里全部释放 */
+    KeyArena::Scope arena_scope(_key_arena);
+    sync_cache_generation();
     if (vk != 0)
     { /* 0 是造词过程中的 dummy code */
         _kb_input_sequence.push_back(vk);
@@ -510,6 +762,7 @@ int DictionaryUlPb::handleVkCode(UINT vk, UINT modifiers_down, WCHAR wch)
             { /* 空格键和数字键不要清理状态，因为可能会触发造词 */
                 // Clear state
                 reset_state();
+                _sentence_stream.reset();
             }
             return 0;
         }
@@ -532,73 +785,134 @@ int DictionaryUlPb::handleVkCode(UINT vk, UINT modifiers_down, WCHAR wch)
     // We do not handle other keys currently
     //
 
-    /* 初始状态 */
-    _pure_pinyin_sequence = _pinyin_sequence;
+    /* 增量更新分词和辅助码状态，只有最后一个音节会变 */
+    _analyzer.assign(_pinyin_sequence_with_cases);
+    return generate_candidates();
+}
 
-    /* Whether in full help mode */
-    _is_full_help_mode = PinyinUtil::IsFullHelpMode(_pinyin_sequence_with_cases);
-    if (_is_full_help_mode)
+/**
+ * @brief Same as feeding the keys of analysis one by one into handleVkCode after reset_state, but the candidates are
+ * only generated for the last key and the analysis is used as computed by the scheme
+ *
+ * @param analysis
+ * @return int
+ */
+int DictionaryUlPb::handle_analysis(const PinyinAnalysis &analysis)
+{
+    KeyArena::Scope arena_scope(_key_arena);
+    sync_cache_generation();
+    _kb_input_sequence.clear();
+    for (char c : analysis.pinyin)
     {
-        _help_mode_raw_pos = _pinyin_sequence.size() - 2;
+        _kb_input_sequence.push_back(static_cast<UINT>(c - ('a' - 'A')));
     }
-    else
-    {
-        _help_mode_raw_pos = 0;
+    _pinyin_sequence = analysis.pinyin;
+    _pinyin_sequence_with_cases = analysis.pinyin_with_cases;
+    _analyzer.adopt(analysis);
+    return generate_candidates();
+}
+
+/**
+ * @brief Generate the candidates of the current analysis
+ *
+ * @return int
+ */
+int DictionaryUlPb::generate_candidates()
+{
+    _partial = false;
+    const PinyinAnalysis &analysis = _analyzer.analysis();
+    _pinyin_segmentation = analysis.segmentation();
+    _is_full_help_mode = analysis.helpcode_mode == HelpcodeMode::Full;
+    _help_mode_raw_pos = _is_full_help_mode ? static_cast<int>(analysis.helpcode_pos) : 0;
+    _pure_pinyin_sequence = analysis.pure_pinyin();
+    if (analysis.helpcode_mode == HelpcodeMode::None && analysis.pinyin.size() % 2 == 1 && analysis.pinyin.size() > 1)
+    { /* 奇数长度但双拼部分不完整，纯拼音依然记为去掉最后一个字符 */
+        _pure_pinyin_sequence.pop_back();
     }
 
-    /* Generate candidate list */
-    if (_is_full_help_mode)
-    { // 全码辅助，结果只包含根据辅助码筛出来的候选词部分
-        _pure_pinyin_sequence = _pinyin_sequence.substr(0, _help_mode_raw_pos);
-        _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pure_pinyin_sequence);
-        _pinyin_helpcodes = _pinyin_sequence.substr(     //
-            _help_mode_raw_pos,                          //
-            _pinyin_sequence.size() - _help_mode_raw_pos //
-        );
+    if (analysis.syllables.size() > kLongInputSyllables)
+    { /* 长输入，整句分段解码，辅助码不再生效 */
+        _cur_candidate_list = generate_for_long_input(analysis);
+    }
+    else if (analysis.helpcode_mode != HelpcodeMode::None)
+    {
+        // 1. 全码辅助，结果只包含根据辅助码筛出来的候选词部分
+        // 2. 奇数长度拼音序列，且双拼部分是完整的拼音，最后一个字符是单码辅助
+        _pinyin_helpcodes = analysis.helpcodes();
         _cur_candidate_list = generate_with_helpcodes( //
             _pure_pinyin_sequence,                     //
-            _pinyin_segmentation,                      //
+            analysis.pure_segmentation(),              //
             _pinyin_sequence,                          //
             _pinyin_helpcodes                          //
         );
     }
     else
+    { /* 纯拼音，不触发辅助码模式 */
+        _cur_candidate_list = generateSeries(_pinyin_sequence, _pinyin_segmentation);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Candidates of input too long for whole-string queries
+ *
+ * The sentence comes from the chunked decoder, so only the trailing window is decoded again for each key. Words
+ * are looked up for the leading syllables only, that is what gets committed first when the input is committed in
+ * parts, and no word in the dictionary is longer anyway.
+ *
+ * @param analysis
+ * @return vector<DictionaryUlPb::WordItem>
+ */
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_for_long_input(const PinyinAnalysis &analysis)
+{
+    vector<WordItem> candidate_list;
+    string sentence = _sentence_stream.decode(analysis.pinyin, analysis.syllables);
+    if (!sentence.empty())
     {
-        // 不是全码辅助的情况：
-        //   1. 奇数长度拼音序列，且双拼部分是完整的拼音，需要触发辅助码
-        //   2. 偶数长度拼音序列，不需要触发辅助码
-        if (_pinyin_sequence.size() % 2 == 1 && _pinyin_sequence.size() > 1)
-        { /* 1. 奇数长度拼音序列 */
-            _pure_pinyin_sequence = _pinyin_sequence.substr(0, _pinyin_sequence.size() - 1);
-            _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pure_pinyin_sequence);
-            if (PinyinUtil::is_all_complete_pinyin(_pure_pinyin_sequence, _pinyin_segmentation))
-            { /* 双拼部分是完整的拼音，需要触发辅助码 */
-                _pure_pinyin_sequence = _pinyin_sequence.substr(0, _pinyin_sequence.size() - 1);
-                _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pure_pinyin_sequence);
-                _pinyin_helpcodes = _pinyin_sequence.substr(_pinyin_sequence.size() - 1, 1);
-                _cur_candidate_list = generate_with_helpcodes( //
-                    _pure_pinyin_sequence,                     //
-                    _pinyin_segmentation,                      //
-                    _pinyin_sequence,                          //
-                    _pinyin_helpcodes                          //
-                );
-            }
-            else
-            { /* 依然使用纯拼音，不触发辅助码模式 */
-                _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pinyin_sequence);
-                _cur_candidate_list = generateSeries(_pinyin_sequence, _pinyin_segmentation);
-            }
-        }
-        else
-        { /* 偶数长度拼音序列，不需要触发辅助码 */
-            _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pinyin_sequence);
-            _cur_candidate_list = generateSeries(_pinyin_sequence, _pinyin_segmentation);
-        }
+        candidate_list.emplace_back(analysis.pinyin, std::move(sentence), 1);
     }
 
-    _pinyin_segmentation = PinyinUtil::pinyin_segmentation(_pinyin_sequence);
+    const SyllableSpan &last_head = analysis.syllables[kLongInputHeadSyllables - 1];
+    const string head_pinyin = analysis.pinyin.substr(0, last_head.begin + last_head.length);
+    string head_segmentation;
+    for (size_t i = 0; i < kLongInputHeadSyllables; ++i)
+    {
+        if (i > 0)
+        {
+            head_segmentation += '\'';
+        }
+        head_segmentation.append(analysis.pinyin, analysis.syllables[i].begin, analysis.syllables[i].length);
+    }
+    auto head_list = generateSeries(head_pinyin, head_segmentation);
+    candidate_list.insert(candidate_list.end(), make_move_iterator(head_list.begin()),
+                          make_move_iterator(head_list.end()));
+    return candidate_list;
+}
 
-    return 0;
+/**
+ * @brief Words of the dictionary keys one edit away from the code, see TypoCorrector
+ *
+ * @param pinyin_sequence
+ * @return vector<DictionaryUlPb::WordItem> Grouped by corrected key, cheapest edit first
+ */
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_typo_corrections(string_view pinyin_sequence)
+{
+    vector<WordItem> candidate_list;
+    const auto snapshot = current_snapshot();
+    if (pinyin_sequence.size() < kTypoMinKeys || !snapshot->key_index().ready())
+    {
+        return candidate_list;
+    }
+    TypoCorrector corrector(snapshot->key_index());
+    for (const auto &correction : corrector.correct(pinyin_sequence))
+    {
+        for (const auto &hit : snapshot->key_index().lookup(correction.key, kTypoWordsPerKey))
+        {
+            candidate_list.emplace_back(string(hit.key), string(hit.word), hit.weight);
+        }
+    }
+    return candidate_list;
 }
 
 std::string DictionaryUlPb::get_quanpin()
@@ -617,168 +931,358 @@ std::string DictionaryUlPb::get_quanpin_seg()
 
 void DictionaryUlPb::filter_key_value_list(                       //
     vector<DictionaryUlPb::WordItem> &candidate_list,             //
-    const vector<string> &pinyin_list,                            //
+    const SegmentList &pinyin_list,                               //
     const vector<DictionaryUlPb::WordItem> &key_value_weight_list //
 )
 {
-    string regex_str("");
-    for (const auto &each_pinyin : pinyin_list)
-    {
-        if (each_pinyin.size() == 2)
-        {
-            regex_str += each_pinyin;
-        }
-        else
-        {
-            regex_str = regex_str + each_pinyin + "[a-z]";
-        }
-    }
-    regex pattern(regex_str);
     for (const auto &each_tuple : key_value_weight_list)
     {
-        if (regex_match(get<0>(each_tuple), pattern))
+        if (key_matches_segments(get<0>(each_tuple), pinyin_list))
         {
             candidate_list.push_back(each_tuple);
         }
     }
 }
 
-vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_for_creating_word(const string code)
+/**
+ * @brief Merge the user layer into rows of the system layer in a single pass
+ *
+ * Every query shape returns rows whose jp is the initials of the segmentation, so only the user entries of that jp
+ * are looked at. A system row the user deleted, or whose word the user re-added, is dropped, and the user's added
+ * words that match the segmentation are interleaved by weight.
+ *
+ * @param candidate_list Rows of the system layer, replaced by the merged list
+ * @param pinyin_list
+ */
+void DictionaryUlPb::merge_user_lexicon(vector<DictionaryUlPb::WordItem> &candidate_list,
+                                        const SegmentList &pinyin_list) const
 {
-    return select_complete_data(build_sql_for_creating_word(code));
+    string jp;
+    for (const auto &each : pinyin_list)
+    {
+        if (each.empty())
+            return;
+        jp += each[0];
+    }
+    const vector<UserLexicon::Entry> *entries = _user_lexicon.find(jp);
+    if (!entries)
+        return;
+
+    vector<DictionaryUlPb::WordItem> merged;
+    merged.reserve(candidate_list.size() + entries->size());
+    auto next = entries->begin(); // Sorted by weight desc, deleted entries last
+    auto emit_added = [&](int above) {
+        for (; next != entries->end() && !next->erased && next->weight > above; ++next)
+        {
+            if (key_matches_segments(next->key, pinyin_list))
+                merged.emplace_back(next->key, next->word, next->weight);
+        }
+    };
+    for (auto &row : candidate_list)
+    {
+        const bool overridden = any_of(entries->begin(), entries->end(), [&row](const UserLexicon::Entry &entry) {
+            return entry.key == get<0>(row) && entry.word == get<1>(row);
+        });
+        if (overridden)
+            continue;
+        emit_added(get<2>(row));
+        merged.push_back(std::move(row));
+    }
+    emit_added(numeric_limits<int>::min());
+    candidate_list.swap(merged);
 }
 
-int DictionaryUlPb::create_word(string pinyin, string word)
+/**
+ * @brief Whether a full key matches a segmentation, a complete segment must match both keys, a jianpin segment
+ * only its initial
+ *
+ * @param key
+ * @param pinyin_list
+ * @return bool
+ */
+bool DictionaryUlPb::key_matches_segments(string_view key, const SegmentList &pinyin_list)
 {
-    string jp;
-    for (size_t i = 0; i < pinyin.size(); i += 2)
-        jp += pinyin[i];
-    if (!do_validate(pinyin, jp, word))
-        return ERROR_CODE;
-    if (check_data(build_sql_for_checking_word(pinyin, jp, word)))
+    if (key.size() != pinyin_list.size() * 2)
+        return false;
+    for (size_t i = 0; i < pinyin_list.size(); ++i)
     {
-        return OK;
+        const string_view each_pinyin = pinyin_list[i];
+        if (each_pinyin.empty() || key[i * 2] != each_pinyin[0])
+            return false;
+        if (each_pinyin.size() == 2 ? key[i * 2 + 1] != each_pinyin[1] : (key[i * 2 + 1] < 'a' || key[i * 2 + 1] > 'z'))
+            return false;
     }
-    insert_data(build_sql_for_inserting_word(pinyin, jp, word));
-    /* 插入新词之后要清理缓存 */
-    reset_cache();
-    return OK;
+    return true;
 }
 
-string DictionaryUlPb::build_sql_for_updating_word(string word)
+/**
+ * @brief Split a segmentation like ni'h'k at ', the views point into segmentation
+ *
+ * @param segmentation
+ * @param segments
+ */
+void DictionaryUlPb::split_segmentation(string_view segmentation, SegmentList &segments)
 {
-    int han_cnt = PinyinUtil::cnt_han_chars(word);
-    string pinyin = GlobalIME::pinyin.substr(0, han_cnt * 2);
-    string jp;
-    for (size_t i = 0; i < pinyin.size(); i += 2)
-        jp += pinyin[i];
-    if (!do_validate(pinyin, jp, word))
-        return "";
-    string table = choose_tbl(pinyin, jp.size());
-    string base_sql = "update {0} set weight = ( select MAX(weight) + 1 from {0} AS sub where sub.key = '{1}') "
-                      "where key = '{1}' and value = '{2}';";
-    string res_sql = fmt::format(base_sql, table, pinyin, word);
-    return res_sql;
+    segments.clear();
+    size_t begin = 0;
+    while (true)
+    {
+        const size_t end = segmentation.find('\'', begin);
+        segments.push_back(segmentation.substr(begin, end == string_view::npos ? string_view::npos : end - begin));
+        if (end == string_view::npos)
+            break;
+        begin = end + 1;
+    }
 }
 
-string DictionaryUlPb::build_sql_for_updating_word(string pinyin, string word)
+/**
+ * @brief Candidates for word creation, longest prefix first
+ *
+ * @param code
+ * @return vector<DictionaryUlPb::WordItem>
+ */
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::generate_for_creating_word(const string code)
 {
-    int han_cnt = PinyinUtil::cnt_han_chars(word);
-    pinyin = pinyin.substr(0, han_cnt * 2);
+    KeyArena::Scope arena_scope(_key_arena);
+    if (!current_snapshot()->key_index().ready())
+    {
+        return select_complete_data(build_sql_for_creating_word(code));
+    }
+    vector<DictionaryUlPb::WordItem> candidate_list;
+    auto groups = generate_for_creating_word_by_length(code);
+    for (auto it = groups.rbegin(); it != groups.rend(); ++it)
+    {
+        candidate_list.insert(candidate_list.end(), make_move_iterator(it->begin()), make_move_iterator(it->end()));
+    }
+    return candidate_list;
+}
+
+/**
+ * @brief Candidates of every 2-key prefix of code, collected in a single walk over the key index
+ *
+ * @param code
+ * @return vector<vector<DictionaryUlPb::WordItem>> result[i] holds the candidates of the first (i + 1) hanzi
+ */
+vector<vector<DictionaryUlPb::WordItem>> DictionaryUlPb::generate_for_creating_word_by_length(const string &code)
+{
+    KeyArena::Scope arena_scope(_key_arena);
+    vector<vector<DictionaryUlPb::WordItem>> groups;
+    const auto snapshot = current_snapshot();
+    auto hits = snapshot->key_index().prefix_walk(code, 2, default_candicate_page_limit);
+    groups.resize(hits.size());
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        groups[i].reserve(hits[i].size());
+        for (const auto &hit : hits[i])
+        {
+            groups[i].emplace_back(string(hit.key), string(hit.word), hit.weight);
+        }
+    }
+    return groups;
+}
+
+int DictionaryUlPb::create_word(string pinyin, string word)
+{
+    KeyArena::Scope arena_scope(_key_arena);
     string jp;
     for (size_t i = 0; i < pinyin.size(); i += 2)
         jp += pinyin[i];
     if (!do_validate(pinyin, jp, word))
-        return "";
-    string table = choose_tbl(pinyin, jp.size());
-    string base_sql = "update {0} set weight = ( select MAX(weight) + 1 from {0} AS sub where sub.key = '{1}') "
-                      "where key = '{1}' and value = '{2}';";
-    string res_sql = fmt::format(base_sql, table, pinyin, word);
-    return res_sql;
+        return ERROR_CODE;
+    /* 系统词库只读，新词只写进用户层；用户删过的系统词重新造出来时按系统里的权重写回用户层 */
+    int weight = UserLexicon::kDefaultWeight;
+    switch (_user_lexicon.state(pinyin, word))
+    {
+    case UserLexicon::State::Added:
+        return OK;
+    case UserLexicon::State::Absent:
+        if (check_data(build_sql_for_checking_word(pinyin, jp, word)))
+            return OK;
+        break;
+    case UserLexicon::State::Erased:
+        weight = system_weight(pinyin, jp, word).value_or(UserLexicon::kDefaultWeight);
+        break;
+    }
+    add_user_word(pinyin, word, weight);
+    /* 只清可能包含这个编码的缓存条目 */
+    invalidate_cached_key(pinyin);
+    return OK;
 }
 
-string DictionaryUlPb::build_sql_for_deleting_word(string pinyin, string word)
+/**
+ * @brief Trim pinyin to the committed word and validate it
+ *
+ * @param pinyin Shuangpin typed by user, may be longer than the word
+ * @param word
+ * @return string Key of the word, empty if invalid
+ */
+string DictionaryUlPb::key_for_updating_word(string pinyin, const string &word)
 {
+    size_t han_cnt = Utf8Utils::count_chars(word);
+    pinyin = pinyin.substr(0, han_cnt * 2);
     string jp;
     for (size_t i = 0; i < pinyin.size(); i += 2)
         jp += pinyin[i];
     if (!do_validate(pinyin, jp, word))
         return "";
-    string table = choose_tbl(pinyin, jp.size());
-    string base_sql = "delete from {0} where key = '{1}' and value = '{2}';";
-    string res_sql = fmt::format(base_sql, table, pinyin, word);
-    return res_sql;
+    return pinyin;
 }
 
-int DictionaryUlPb::update_data(string sql_str)
+int DictionaryUlPb::update_weight_by_word(string word)
 {
-    sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
-    if (exit != SQLITE_OK)
-    {
-        spdlog::error("sqlite3_prepare_v2 error.");
-    }
-    exit = sqlite3_step(stmt);
-    if (exit != SQLITE_DONE)
-    {
-        spdlog::error("sqlite3_step error.");
-    }
-    sqlite3_finalize(stmt);
-    return 0;
+    KeyArena::Scope arena_scope(_key_arena);
+    record_user_choice(key_for_updating_word(GlobalIME::pinyin, word), word);
+    return OK;
 }
 
-int DictionaryUlPb::delete_data(string sql_str)
+int DictionaryUlPb::update_weight_by_pinyin_and_word(string pinyin, string word)
 {
-    sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
-    if (exit != SQLITE_OK)
+    KeyArena::Scope arena_scope(_key_arena);
+    record_user_choice(key_for_updating_word(pinyin, word), word);
+    return OK;
+}
+
+int DictionaryUlPb::delete_by_pinyin_and_word(string pinyin, string word)
+{
+    KeyArena::Scope arena_scope(_key_arena);
+    if (!do_validate(pinyin, UserLexicon::jianpin_of(pinyin), word))
+        return ERROR_CODE;
+    erase_user_word(pinyin, word);
+    _user_frequency.forget(pinyin, word);
+    invalidate_cached_key(pinyin);
+    return OK;
+}
+
+/**
+ * @brief Import word lists in bulk, see LexiconImporter
+ *
+ * Imported words go to the user layer like created ones, the system database is only read, through a leased
+ * read-only connection, to find the words it already has. The user layer is applied to the published snapshot once
+ * at the end, and the caches are reset once. A snapshot that is being built picks the words up before it is
+ * published.
+ *
+ * @param paths
+ * @param stats
+ * @return int
+ */
+int DictionaryUlPb::import_lexicon(const vector<string> &paths, LexiconImporter::Stats &stats)
+{
+    KeyArena::Scope arena_scope(_key_arena);
+    lock_guard<mutex> lock(_reload_mutex);
+    const auto snapshot = current_snapshot();
+    auto reader = snapshot->lease_reader();
+    if (!reader.db())
     {
-        spdlog::error("sqlite3_prepare_v2 error.");
+        spdlog::error("Failed to open db {} for import.", db_path);
+        return ERROR_CODE;
     }
-    exit = sqlite3_step(stmt);
-    if (exit != SQLITE_DONE)
+    LexiconImporter importer(reader.db(), snapshot->layout(), _user_lexicon);
+    const bool ok = importer.import_files(paths, stats);
+    if (stats.inserted + stats.updated > 0)
     {
-        spdlog::error("sqlite3_step error.");
+        _user_lexicon.apply_to(*snapshot);
+        reset_cache();
     }
-    sqlite3_finalize(stmt);
-    return 0;
+    return ok ? OK : ERROR_CODE;
 }
 
-int DictionaryUlPb::update_weight_by_word(string word)
+/**
+ * @brief Record a user choice in the in-memory frequency model
+ *
+ * The derived caches embed ranked results, the entries that may contain the word are dropped. Every few records a
+ * snapshot of the model is written on the task pool, the typing thread never waits for the file.
+ *
+ * @param key
+ * @param word
+ */
+void DictionaryUlPb::record_user_choice(const string &key, const string &word)
 {
-    // std::unique_lock lock(mutex_);
-    update_data(build_sql_for_updating_word(word));
-    return OK;
+    if (key.empty())
+        return;
+    _user_frequency.record(key, word);
+    invalidate_cached_key(key);
+    if (_user_frequency.records_since_save() >= 32 && !_user_frequency_saving.exchange(true))
+    {
+        _background_saves.run([this]() {
+            if (!_user_frequency.save(_user_frequency_path))
+            {
+                spdlog::warn("Failed to save user frequency {}.", _user_frequency_path);
+            }
+            _user_frequency_saving = false;
+        });
+    }
 }
 
-int DictionaryUlPb::update_weight_by_pinyin_and_word(string pinyin, string word)
+/**
+ * @brief Merge user frequency with dictionary weights
+ *
+ * A word gets a bonus proportional to its decayed choice count, scaled by the weight spread of the list and capped
+ * at the spread, so a single accidental choice lifts a word part of the way and about three recent choices put it
+ * on top. Words that are not chosen for a while sink back to their dictionary position.
+ *
+ * @param candidate_list
+ */
+void DictionaryUlPb::apply_user_frequency(vector<DictionaryUlPb::WordItem> &candidate_list) const
 {
-    update_data(build_sql_for_updating_word(pinyin, word));
-    return OK;
-}
+    constexpr double saturation = 3.0;
+    if (candidate_list.size() < 2 || _user_frequency.size() == 0)
+        return;
 
-int DictionaryUlPb::delete_by_pinyin_and_word(string pinyin, string word)
-{
+    const uint32_t now = UserFrequencyModel::now_minutes();
+    int max_weight = get<2>(candidate_list[0]);
+    int min_weight = max_weight;
+    for (const auto &cand : candidate_list)
+    {
+        max_weight = std::max(max_weight, get<2>(cand));
+        min_weight = std::min(min_weight, get<2>(cand));
+    }
+    const double spread = static_cast<double>(max_weight) - min_weight + 1;
 
-    delete_data(build_sql_for_deleting_word(pinyin, word));
-    return OK;
+    vector<pair<double, size_t>> order;
+    order.reserve(candidate_list.size());
+    bool boosted = false;
+    for (size_t i = 0; i < candidate_list.size(); ++i)
+    {
+        const double user_score = _user_frequency.score(get<0>(candidate_list[i]), get<1>(candidate_list[i]), now);
+        boosted = boosted || user_score > 0.0;
+        order.emplace_back(get<2>(candidate_list[i]) + spread * std::min(1.0, user_score / saturation), i);
+    }
+    if (!boosted)
+        return;
+
+    std::stable_sort(order.begin(), order.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    vector<DictionaryUlPb::WordItem> ranked;
+    ranked.reserve(candidate_list.size());
+    for (const auto &[weight, index] : order)
+    {
+        ranked.push_back(std::move(candidate_list[index]));
+        get<2>(ranked.back()) = static_cast<int>(weight);
+    }
+    candidate_list.swap(ranked);
 }
 
 // generate_with_seg_pinyin
 
 DictionaryUlPb::~DictionaryUlPb()
 {
-    if (db)
+    if (_reload_thread.joinable())
+    {
+        _reload_thread.join();
+    }
+    _background_saves.wait();
+    if (_user_frequency.records_since_save() > 0)
     {
-        sqlite3_close(db);
+        _user_frequency.save(_user_frequency_path);
     }
+    save_warm_cache();
 }
 
 vector<string> DictionaryUlPb::select_data(string sql_str)
 {
     vector<string> candidateList;
+    const auto snapshot = current_snapshot();
     sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
+    int exit = sqlite3_prepare_v2(snapshot->db(), sql_str.c_str(), -1, &stmt, 0);
     if (exit != SQLITE_OK)
     {
         spdlog::error("sqlite3_prepare_v2 error.");
@@ -791,11 +1295,17 @@ vector<string> DictionaryUlPb::select_data(string sql_str)
     return candidateList;
 }
 
-vector<DictionaryUlPb::WordItem> DictionaryUlPb::select_complete_data(string sql_str)
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::select_complete_data(string_view sql_str)
+{
+    const auto snapshot = current_snapshot();
+    return select_complete_data(snapshot->db(), sql_str);
+}
+
+vector<DictionaryUlPb::WordItem> DictionaryUlPb::select_complete_data(sqlite3 *db, string_view sql_str)
 {
     vector<DictionaryUlPb::WordItem> candidateList;
     sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
+    int exit = sqlite3_prepare_v2(db, sql_str.data(), static_cast<int>(sql_str.size()), &stmt, 0);
     if (exit != SQLITE_OK)
     {
         spdlog::error("sqlite3_prepare_v2 error.");
@@ -815,8 +1325,9 @@ vector<DictionaryUlPb::WordItem> DictionaryUlPb::select_complete_data(string sql
 vector<pair<string, string>> DictionaryUlPb::select_key_and_value(string sql_str)
 {
     vector<pair<string, string>> candidateList;
+    const auto snapshot = current_snapshot();
     sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
+    int exit = sqlite3_prepare_v2(snapshot->db(), sql_str.c_str(), -1, &stmt, 0);
     if (exit != SQLITE_OK)
     {
         spdlog::error("sqlite3_prepare_v2 error.");
@@ -831,54 +1342,75 @@ vector<pair<string, string>> DictionaryUlPb::select_key_and_value(string sql_str
 }
 
 /**
- * @brief Check if data exists
+ * @brief Weight of a word in the system layer, whether or not the user deleted it
  *
- * @param sql_str
- * @return int
+ * @param key
+ * @param jp
+ * @param word
+ * @return optional<int> Empty if the system layer does not have the word
  */
-int DictionaryUlPb::check_data(string sql_str)
+optional<int> DictionaryUlPb::system_weight(const string &key, const string &jp, const string &word)
 {
+    const auto snapshot = current_snapshot();
+    const string sql = fmt::format("select max(weight) from {} where key = '{}' and value = '{}';",
+                                   choose_tbl(snapshot->layout(), key, jp.size()), key, word);
     sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
-    if (exit != SQLITE_OK)
+    if (sqlite3_prepare_v2(snapshot->db(), sql.c_str(), -1, &stmt, 0) != SQLITE_OK)
     {
         spdlog::error("sqlite3_prepare_v2 error.");
+        return nullopt;
     }
-    bool exists = false;
-    exit = sqlite3_step(stmt);
-    if (exit == SQLITE_ROW)
+    optional<int> weight;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
     {
-        exists = true;
+        weight = sqlite3_column_int(stmt, 0);
     }
     sqlite3_finalize(stmt);
-    return exists;
+    return weight;
 }
 
-int DictionaryUlPb::insert_data(string sql_str)
+/**
+ * @brief Check if data exists
+ *
+ * @param sql_str
+ * @return int
+ */
+int DictionaryUlPb::check_data(string sql_str)
 {
+    const auto snapshot = current_snapshot();
     sqlite3_stmt *stmt;
-    int exit = sqlite3_prepare_v2(db, sql_str.c_str(), -1, &stmt, 0);
+    int exit = sqlite3_prepare_v2(snapshot->db(), sql_str.c_str(), -1, &stmt, 0);
     if (exit != SQLITE_OK)
     {
         spdlog::error("sqlite3_prepare_v2 error.");
     }
+    bool exists = false;
     exit = sqlite3_step(stmt);
-    if (exit != SQLITE_DONE)
+    if (exit == SQLITE_ROW)
     {
-        spdlog::info("sqlite3_step error.");
+        exists = true;
     }
     sqlite3_finalize(stmt);
-    return 0;
+    return exists;
 }
 
-pair<string, bool> DictionaryUlPb::build_sql(const string &sp_str, vector<string> &pinyin_list)
+/**
+ * @brief Build the query of a segmented code, the sql is appended to sql
+ *
+ * @param layout
+ * @param sp_str
+ * @param pinyin_list
+ * @param sql
+ * @return bool Whether the rows need to be filtered with filter_key_value_list
+ */
+bool DictionaryUlPb::build_sql(DictionarySchema::Layout layout, string_view sp_str, const SegmentList &pinyin_list,
+                               pmr::string &sql)
 {
     bool all_entire_pinyin = true;
     bool all_jp = true;
-    vector<string>::size_type jp_cnt = 0; // 简拼的数量
-    for (vector<string>::size_type i = 0; i < pinyin_list.size(); i++)
+    size_t jp_cnt = 0; // 简拼的数量
+    for (const auto &cur_pinyin : pinyin_list)
     {
-        string cur_pinyin = pinyin_list[i];
         if (cur_pinyin.size() == 1)
         {
             all_entire_pinyin = false;
@@ -889,67 +1421,67 @@ pair<string, bool> DictionaryUlPb::build_sql(const string &sp_str, vector<string
             all_jp = false;
         }
     }
-    string sql;
-    string base_sql("select * from {0} where {1} = '{2}' order by weight desc limit {3};");
-    string table = choose_tbl(sp_str, pinyin_list.size());
-    bool need_filtering = false;
+    const bool unified = layout == DictionarySchema::Layout::Unified;
+    const string table = choose_tbl(layout, sp_str, pinyin_list.size());
+    auto out = back_inserter(sql);
     if (all_entire_pinyin) // Segmentations are all quanpin
     {
-        sql = fmt::format(base_sql, table, "key", sp_str, default_candicate_page_limit);
+        fmt::format_to(out, "select {0} from {1} where key = '{2}' order by weight desc limit {3};",
+                       DictionarySchema::kColumns, table, sp_str, default_candicate_page_limit);
     }
     else if (all_jp) // Segmentations are all jianpin
     {
-        sql = fmt::format(base_sql, table, "jp", sp_str, default_candicate_page_limit);
+        fmt::format_to(out, "select {0} from {1} where jp = '{2}' order by weight desc limit {3};",
+                       DictionarySchema::kColumns, table, sp_str, default_candicate_page_limit);
     }
     else if (jp_cnt == 1) // Only one jianpin
     {
-        string sql_param0("");
-        for (vector<string>::size_type i = 0; i < pinyin_list.size(); i++)
+        /* glob 区分大小写，可以用主键做前缀范围扫描，like 默认不区分大小写，用不上索引 */
+        fmt::format_to(out, "select {} from {} where key {} '", DictionarySchema::kColumns, table,
+                       unified ? "glob" : "like");
+        for (const auto &cur_pinyin : pinyin_list)
         {
-            if (pinyin_list[i].size() == 1)
-            {
-                sql_param0 = sql_param0 + pinyin_list[i] + "_";
-            }
-            else
+            sql += cur_pinyin;
+            if (cur_pinyin.size() == 1)
             {
-                sql_param0 += pinyin_list[i];
+                sql += unified ? '?' : '_';
             }
         }
-        sql =
-            fmt::format( //
-                         // "select * from {0} where key >= '{1}' and key <= '{2}' order by weight desc limit {3};", //
-                "select * from {0} where key like '{1}' order by weight desc limit {2};", //
-                table, sql_param0, default_candicate_page_limit                           //
-            );
+        fmt::format_to(out, "' order by weight desc limit {};", default_candicate_page_limit);
     }
     else // Neithor pure quanpin, nor pure jianpin, and count of jianpin is more than 1
     {
-        need_filtering = true;
-        string sql_param("");
-        for (string &cur_pinyin : pinyin_list)
+        // TODO: not adding weight desc
+        fmt::format_to(out, "select {} from {} where jp = '", DictionarySchema::kColumns, table);
+        for (const auto &cur_pinyin : pinyin_list)
         {
-            sql_param += cur_pinyin.substr(0, 1);
+            sql += cur_pinyin.substr(0, 1);
         }
-        // TODO: not adding weight desc
-        sql = fmt::format("select * from {0} where jp = '{1}';", table, sql_param);
+        sql += "';";
+        return true;
     }
-    return make_pair(sql, need_filtering);
+    return false;
 }
 
 string DictionaryUlPb::build_sql_for_creating_word(const string &sp_str)
 {
-    string base_sql = "select * from(select * from {} where key = '{}' order by weight desc limit {})";
+    const auto layout = current_snapshot()->layout();
+    string base_sql = fmt::format(                                                             //
+        "select * from(select {} from {{}} where key = '{{}}' order by weight desc limit {{}})", //
+        DictionarySchema::kColumns                                                             //
+    );
     string res_sql =
-        fmt::format(base_sql, choose_tbl(sp_str.substr(0, 2), 1), sp_str.substr(0, 2), default_candicate_page_limit);
+        fmt::format(base_sql, choose_tbl(layout, sp_str.substr(0, 2), 1), sp_str.substr(0, 2),
+                    default_candicate_page_limit);
     string trimed_sp_str = sp_str.substr(0, 8); // 4 hanzi at most
     for (size_t i = 4; i <= sp_str.size(); i += 2)
     {
         res_sql = fmt::format(                                //
-                      base_sql,                               //
-                      choose_tbl(sp_str.substr(0, i), i / 2), //
-                      sp_str.substr(0, i),                    //
-                      default_candicate_page_limit)           //
-                  + " union all "                             //
+                      base_sql,                                       //
+                      choose_tbl(layout, sp_str.substr(0, i), i / 2), //
+                      sp_str.substr(0, i),                            //
+                      default_candicate_page_limit)                   //
+                  + " union all "                                     //
                   + res_sql;
     }
     return res_sql;
@@ -957,20 +1489,15 @@ string DictionaryUlPb::build_sql_for_creating_word(const string &sp_str)
 
 string DictionaryUlPb::build_sql_for_checking_word(string key, string jp, string value)
 {
-    string table = choose_tbl(key, jp.size());
+    string table = choose_tbl(current_snapshot()->layout(), key, jp.size());
     string base_sql = "select 1 from {} where key = '{}' and value = '{}';";
     return fmt::format(base_sql, table, key, value); // Default weight is 10,000
 }
 
-string DictionaryUlPb::build_sql_for_inserting_word(string key, string jp, string value)
-{
-    string table = choose_tbl(key, jp.size());
-    string base_sql = "insert into {} (key, jp, value, weight) values ('{}', '{}', '{}', '{}');";
-    return fmt::format(base_sql, table, key, jp, value, 10000); // Default weight is 10,000
-}
-
-string DictionaryUlPb::choose_tbl(const string &sp_str, size_t word_len)
+string DictionaryUlPb::choose_tbl(DictionarySchema::Layout layout, string_view sp_str, size_t word_len)
 {
+    if (layout == DictionarySchema::Layout::Unified)
+        return DictionarySchema::kUnifiedTable;
     string base_tbl("tbl_{}_{}");
     if (word_len >= 8)
         return fmt::format(base_tbl, "others", sp_str[0]);
@@ -979,21 +1506,202 @@ string DictionaryUlPb::choose_tbl(const string &sp_str, size_t word_len)
 
 bool DictionaryUlPb::do_validate(string key, string jp, string value)
 {
-    if (key.size() % 2 || jp.size() != key.size() / 2 || key.size() != PinyinUtil::cnt_han_chars(value) * 2)
+    if (key.size() % 2 || jp.size() != key.size() / 2 || key.size() != Utf8Utils::count_chars(value) * 2)
+        return false;
+    return true;
+}
+
+/**
+ * @brief Whether the database may contain rows for the code
+ *
+ * Every row that any of the queries in build_sql can return has jp equal to the initials of the segmentation, so a
+ * missing jp rules out all query shapes. When all segments are complete, the exact key is checked as well.
+ *
+ * @param pinyin_sequence
+ * @param pinyin_list
+ * @return bool false only if the result is guaranteed to be empty
+ */
+bool DictionaryUlPb::may_have_entries(string_view pinyin_sequence, const SegmentList &pinyin_list)
+{
+    pmr::string jp(_key_arena.resource());
+    bool all_entire_pinyin = true;
+    for (const auto &each : pinyin_list)
+    {
+        if (each.empty())
+        {
+            return true;
+        }
+        jp += each[0];
+        all_entire_pinyin = all_entire_pinyin && each.size() == 2;
+    }
+    const auto snapshot = current_snapshot();
+    const KeyFilter &key_filter = snapshot->key_filter();
+    if (!key_filter.may_contain(KeyFilter::Domain::Jianpin, PackedKey(jp)))
+    {
         return false;
+    }
+    if (all_entire_pinyin && !key_filter.may_contain(KeyFilter::Domain::Key, PackedKey(pinyin_sequence)))
+    {
+        return false;
+    }
     return true;
 }
 
+shared_ptr<DictionarySnapshot> DictionaryUlPb::current_snapshot() const
+{
+    return atomic_load(&_snapshot);
+}
+
+/**
+ * @brief Drop cached results once a newer snapshot has been published
+ *
+ */
+void DictionaryUlPb::sync_cache_generation()
+{
+    const uint64_t generation = _published_generation.load(memory_order_acquire);
+    if (generation != _cache_generation)
+    {
+        reset_cache();
+        _cache_generation = generation;
+        if (generation == 1)
+        { /* 第 1 代是预热时从同一个文件建的索引，恢复的条目仍然有效，之后的重新加载就不一定了 */
+            restore_warm_cache();
+            _warm_cache.release_entries();
+        }
+    }
+}
+
+/**
+ * @brief Record a created word in the user layer and in the published snapshot's filter and index
+ *
+ * A snapshot that is being built picks the word up from the user layer before it is published.
+ *
+ * @param key
+ * @param word
+ * @param weight
+ */
+void DictionaryUlPb::add_user_word(const string &key, const string &word, int weight)
+{
+    lock_guard<mutex> lock(_reload_mutex);
+    if (!_user_lexicon.add(key, word, weight))
+    {
+        spdlog::warn("Failed to journal user word {} {}.", key, word);
+    }
+    current_snapshot()->add_word(key, UserLexicon::jianpin_of(key), word, weight);
+}
+
+void DictionaryUlPb::erase_user_word(const string &key, const string &word)
+{
+    lock_guard<mutex> lock(_reload_mutex);
+    if (!_user_lexicon.erase(key, word))
+    {
+        spdlog::warn("Failed to journal deleted word {} {}.", key, word);
+    }
+    current_snapshot()->remove_word(key, word);
+}
+
+/**
+ * @brief Reload the dictionary and the pinyin tables on a background thread
+ *
+ * The new snapshot gets its own connection, filter, index and tables. The user layer, including words created or
+ * deleted while it is being built, is applied to it, then it is swapped in with a single atomic store. Queries that
+ * already hold the old snapshot finish on it, cached results are dropped at the next key. The googlepinyin decoder
+ * is global state and is not reloaded.
+ *
+ * @return bool false if a reload is already running
+ */
+bool DictionaryUlPb::reload_async()
+{
+    if (_reloading.exchange(true))
+    {
+        return false;
+    }
+    if (_reload_thread.joinable())
+    {
+        _reload_thread.join();
+    }
+    const uint64_t generation = current_snapshot()->generation() + 1;
+    _reload_thread = thread([this, generation]() { build_and_publish(generation, PinyinUtil::load_tables()); });
+    return true;
+}
+
+/**
+ * @brief Build an indexed snapshot, prefetch its hot keys and publish it, runs on the reload thread
+ *
+ * @param generation
+ * @param tables Pinyin tables published together with the snapshot
+ * @return bool false if the snapshot could not be built, the current one stays in place
+ */
+bool DictionaryUlPb::build_and_publish(uint64_t generation, shared_ptr<const PinyinTables> tables)
+{
+    auto next = DictionarySnapshot::open(db_path, generation, tables, default_candicate_page_limit);
+    if (next->ok())
+    {
+        const size_t prefetched = next->prefetch_hot_keys(default_candicate_page_limit);
+        spdlog::info("Dictionary snapshot {}: prefetched {} hot keys.", generation, prefetched);
+    }
+
+    lock_guard<mutex> lock(_reload_mutex);
+    const bool ok = next->ok();
+    if (ok)
+    {
+        _user_lexicon.apply_to(*next);
+        PinyinUtil::publish_tables(std::move(tables));
+        atomic_store(&_snapshot, std::move(next));
+        _published_generation.store(generation, memory_order_release);
+        spdlog::info("Dictionary snapshot {} published.", generation);
+    }
+    else
+    {
+        spdlog::error("Failed to load dictionary snapshot {}, keep using snapshot {}.", generation, generation - 1);
+    }
+    _reloading = false;
+    return ok;
+}
+
+DictionaryUlPb::Readiness DictionaryUlPb::readiness() const
+{
+    return _readiness;
+}
+
+void DictionaryUlPb::set_deadline(optional<chrono::steady_clock::time_point> deadline)
+{
+    _deadline = deadline;
+}
+
+bool DictionaryUlPb::is_partial() const
+{
+    return _partial;
+}
+
+bool DictionaryUlPb::is_reloading() const
+{
+    return _reloading;
+}
+
+uint64_t DictionaryUlPb::dictionary_generation() const
+{
+    return _published_generation.load(memory_order_acquire);
+}
+
 string from_utf16(const ime_pinyin::char16 *buf, size_t len)
 {
-    u16string utf16Str(reinterpret_cast<const char16_t *>(buf), len);
-    return boost::locale::conv::utf_to_utf<char>(utf16Str);
+    string result;
+    result.reserve(len * 3);
+    Utf8Utils::append_utf8(u16string_view(reinterpret_cast<const char16_t *>(buf), len), result);
+    return result;
 }
 
 string DictionaryUlPb::search_sentence_from_ime_engine(const string &user_pinyin)
 {
+    if (!decoder_ready)
+    { /* 解码器还在预热，先不给整句 */
+        return "";
+    }
     string pinyin_str = user_pinyin;
     const char *pinyin = pinyin_str.c_str();
+    /* 整句可能在线程池的任务里解码，解码器的搜索状态在两次调用之间也不能被别的线程改掉 */
+    lock_guard<mutex> lock(decoder_mutex());
     size_t cand_cnt = ime_pinyin::im_search(pinyin, strlen(pinyin));
     string msg;
     cand_cnt = cand_cnt > 0 ? 1 : 0;
@@ -1009,6 +1717,12 @@ string DictionaryUlPb::search_sentence_from_ime_engine(const string &user_pinyin
     return msg;
 }
 
+/**
+ * @brief Clear the composition
+ *
+ * The sentence stream is kept: the provider resets the state and replays the input on every key, and the stream
+ * checks its frozen chunks against the new syllables itself, so only chunks an edit reached are decoded again.
+ */
 void DictionaryUlPb::reset_state()
 {
     _is_full_help_mode = false;
@@ -1018,6 +1732,7 @@ void DictionaryUlPb::reset_state()
     _pinyin_sequence_with_cases = "";
     _pure_pinyin_sequence = "";
     _pinyin_segmentation = "";
+    _analyzer.reset();
     _help_codes_sequence.fill(0);
     _cur_candidate_list.clear();
     _cur_page_candidate_list.clear();
@@ -1029,14 +1744,142 @@ void DictionaryUlPb::reset_cache()
     _cached_buffer_sgl.clear();
     _cached_buffer_dbl.clear();
     _cached_buffer_series.clear();
+    _cache_dependencies.clear();
+}
+
+/**
+ * @brief Identifies the data cached results were computed from: the system database file and the user lexicon
+ *
+ * @return uint64_t
+ */
+uint64_t DictionaryUlPb::dictionary_fingerprint() const
+{
+    error_code ec;
+    const uint64_t size = filesystem::file_size(db_path, ec);
+    const uint64_t mtime = ec ? 0 : filesystem::last_write_time(db_path, ec).time_since_epoch().count();
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const uint64_t value : {size, mtime, _user_lexicon.content_hash(), uint64_t{_user_lexicon.size()}})
+    {
+        hash = (hash ^ value) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Put the entries loaded from the warm cache file into the pure pinyin cache
+ *
+ */
+void DictionaryUlPb::restore_warm_cache()
+{
+    for (const auto &entry : _warm_cache.entries())
+    {
+        const PackedKey cache_key(entry.sequence);
+        _cached_buffer.insert(cache_key, entry.candidates);
+        _cache_dependencies.add(CacheDependencyIndex::Cache::Pinyin, cache_key, entry.segmentation);
+    }
+}
+
+/**
+ * @brief Write the cached candidates of the most looked-up codes, for the next process to start warm
+ *
+ */
+void DictionaryUlPb::save_warm_cache()
+{
+    vector<WarmCache::Entry> entries;
+    for (auto &code : _warm_cache.hottest(WarmCache::kMaxEntries))
+    {
+        if (auto cached = _cached_buffer.get(PackedKey(code.sequence)))
+        {
+            entries.push_back({std::move(code.sequence), std::move(code.segmentation), std::move(cached.value())});
+        }
+    }
+    if (!entries.empty() && !WarmCache::save(_warm_cache_path, dictionary_fingerprint(), entries))
+    {
+        spdlog::warn("Failed to save warm cache {}.", _warm_cache_path);
+    }
+}
+
+/**
+ * @brief Register a series result, or a help code result filtered from one, with the cache dependency index
+ *
+ * A series holds the candidates of the whole segmentation and of each of its prefixes, and typo corrections of the
+ * code when they are on.
+ *
+ * @param cache
+ * @param cache_key
+ * @param pinyin_segmentation
+ * @param pinyin_sequence
+ */
+void DictionaryUlPb::track_cached_series(CacheDependencyIndex::Cache cache, const PackedKey &cache_key,
+                                         string_view pinyin_segmentation, string_view pinyin_sequence)
+{
+    string_view seg_pinyin = pinyin_segmentation;
+    while (true)
+    {
+        _cache_dependencies.add(cache, cache_key, seg_pinyin);
+        const size_t pos = seg_pinyin.rfind('\'');
+        if (pos == string_view::npos)
+            break;
+        seg_pinyin = seg_pinyin.substr(0, pos);
+    }
+    if (_typo_correction)
+    {
+        _cache_dependencies.add_corrections(cache, cache_key, pinyin_sequence);
+    }
+    if (_cache_dependencies.size() > CacheDependencyIndex::kPruneThreshold)
+    {
+        _cache_dependencies.prune([this](const CacheDependencyIndex::Dependent &dependent) {
+            switch (dependent.cache)
+            {
+            case CacheDependencyIndex::Cache::Pinyin:
+                return _cached_buffer.contains(dependent.key);
+            case CacheDependencyIndex::Cache::Series:
+                return _cached_buffer_series.contains(dependent.key);
+            case CacheDependencyIndex::Cache::SingleHelpcode:
+                return _cached_buffer_sgl.contains(dependent.key);
+            case CacheDependencyIndex::Cache::DoubleHelpcode:
+                return _cached_buffer_dbl.contains(dependent.key);
+            }
+            return false;
+        });
+    }
+}
+
+/**
+ * @brief Drop the cached results that may contain words under key, after a word was created, deleted or chosen
+ *
+ * @param key
+ */
+void DictionaryUlPb::invalidate_cached_key(const string &key)
+{
+    for (const auto &[cache, cache_key] : _cache_dependencies.take(key))
+    {
+        switch (cache)
+        {
+        case CacheDependencyIndex::Cache::Pinyin:
+            _cached_buffer.remove(cache_key);
+            break;
+        case CacheDependencyIndex::Cache::Series:
+            _cached_buffer_series.remove(cache_key);
+            break;
+        case CacheDependencyIndex::Cache::SingleHelpcode:
+            _cached_buffer_sgl.remove(cache_key);
+            break;
+        case CacheDependencyIndex::Cache::DoubleHelpcode:
+            _cached_buffer_dbl.remove(cache_key);
+            break;
+        }
+    }
 }
 
 int DictionaryUlPb::insert_word_to_cached_buffer_series(const std::string &pinyin, const std::string &word)
 {
+    KeyArena::Scope arena_scope(_key_arena);
     OutputDebugString(fmt::format(L"[msime]: pinyin: {}, word: {}", CommonUtils::string_to_wstring(pinyin),
                                   CommonUtils::string_to_wstring(word))
                           .c_str());
-    if (auto opt = _cached_buffer_series.get(pinyin))
+    const PackedKey cache_key(pinyin);
+    if (auto opt = _cached_buffer_series.get(cache_key))
     {
 #ifdef FANY_DEBUG
         OutputDebugString(fmt::format(L"[msime]: insert_word_to_cached_buffer_series").c_str());
@@ -1050,11 +1893,17 @@ int DictionaryUlPb::insert_word_to_cached_buffer_series(const std::string &pinyi
         {
             list.push_back(make_tuple(pinyin, word, 1));
         }
-        _cached_buffer_series.insert(pinyin, list);
+        _cached_buffer_series.insert(cache_key, list);
     }
     else
     {
-        _cached_buffer_series.insert(pinyin, vector<WordItem>{make_tuple(pinyin, word, 1)});
+        _cached_buffer_series.insert(cache_key, vector<WordItem>{make_tuple(pinyin, word, 1)});
+        string segmentation;
+        for (size_t i = 0; i < pinyin.size(); i += 2)
+        {
+            segmentation += (i == 0 ? "" : "'") + pinyin.substr(i, 2);
+        }
+        _cache_dependencies.add(CacheDependencyIndex::Cache::Series, cache_key, segmentation);
     }
     return 0;
 }
@@ -1067,10 +1916,7 @@ bool DictionaryUlPb::is_all_complete_pinyin()
 
 bool DictionaryUlPb::is_all_complete_pure_pinyin()
 {
-    bool res = PinyinUtil::is_all_complete_pinyin( //
-        _pure_pinyin_sequence,                     //
-        PinyinUtil::pinyin_segmentation(_pure_pinyin_sequence));
-    return res;
+    return _analyzer.analysis().pure_all_complete;
 }
 
 std::string DictionaryUlPb::get_pinyin_segmentation_with_cases()
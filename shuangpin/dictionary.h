@@ -1,13 +1,32 @@
 #pragma once
 
+#include "cache_dependency_index.h"
 #include "common_utils.h"
+#include "dictionary_snapshot.h"
+#include "key_arena.h"
+#include "lexicon_importer.h"
+#include "packed_key.h"
+#include "pinyin_analyzer.h"
+#include "sentence_stream.h"
+#include "task_pool.h"
+#include "typo_corrector.h"
+#include "user_frequency_model.h"
+#include "user_lexicon.h"
+#include "warm_cache.h"
 #include <windows.h>
 #include <shared_mutex>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <array>
+#include <chrono>
+#include <optional>
 #include <vector>
 #include <tuple>
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include <memory_resource>
 #include <fstream>
 #include <sqlite3.h>
 #include <memory>
@@ -28,9 +47,16 @@ class DictionaryUlPb
     static const int OK = 0;
     static const int ERROR_CODE = -1;
 
-    std::vector<WordItem> generate(            //
-        const std::string &pinyin_sequence,    //
-        const std::string &pinyin_segmentation //
+    enum class Readiness
+    {
+        Warming, // Answers come from plain SQL, no filter, key index or sentence decoder yet
+        Ready,
+        Failed, // The indexed dictionary could not be loaded, answers stay degraded
+    };
+
+    std::vector<WordItem> generate(          //
+        std::string_view pinyin_sequence,    //
+        std::string_view pinyin_segmentation //
     );
     std::vector<DictionaryUlPb::WordItem> DictionaryUlPb::generateSeries( //
         const std::string &pinyin_sequence,                               //
@@ -43,13 +69,18 @@ class DictionaryUlPb
         const std::string &help_codes                //
     );
     int handleVkCode(UINT vk, UINT modifiers_down, WCHAR wch = 0);
+    int handle_analysis(const PinyinAnalysis &analysis);
     std::vector<WordItem> generate_for_creating_word(const std::string code);
+    // result[i] holds the candidates of the first (i + 1) hanzi of code
+    std::vector<std::vector<WordItem>> generate_for_creating_word_by_length(const std::string &code);
     int create_word(std::string pinyin, std::string word);
-    // 一次到顶
+    // 记录一次用户选词，排序时与词库权重合并
     int update_weight_by_word(std::string word);
-    // 一次到顶
+    // 记录一次用户选词，排序时与词库权重合并
     int update_weight_by_pinyin_and_word(std::string pinyin, std::string word);
     int delete_by_pinyin_and_word(std::string pinyin, std::string word);
+    // 批量导入词表到用户词库，格式见 LexiconImporter，系统词库只读，缓存只在导入结束时清一次
+    int import_lexicon(const std::vector<std::string> &paths, LexiconImporter::Stats &stats);
 
     /*
       Return: list of complete item data of database table
@@ -58,20 +89,46 @@ class DictionaryUlPb
 
     std::string search_sentence_from_ime_engine(const std::string &user_pinyin);
 
+    // 在后台线程重新加载词库和拼音表，加载完成后原子地替换当前快照，正在进行的查询继续使用旧快照
+    bool reload_async();
+    // Past the deadline the series of a code stops after the code itself, the prefixes, the sentence and typo
+    // corrections are left for a query without a deadline
+    void set_deadline(std::optional<std::chrono::steady_clock::time_point> deadline);
+    // Whether the current candidates stopped at the deadline
+    bool is_partial() const;
+    bool is_reloading() const;
+    Readiness readiness() const;
+    uint64_t dictionary_generation() const;
+
     DictionaryUlPb();
+    // 用户数据（用户词库日志、选词频率、热缓存）放在 user_data_dir 下，系统词库仍在 %LOCALAPPDATA%
+    explicit DictionaryUlPb(const std::string &user_data_dir);
     ~DictionaryUlPb();
 
   private:
     std::ifstream inputFile;
     std::string db_path;
-    sqlite3 *db = nullptr;
-    std::unordered_map<std::string, std::vector<std::string>> dict_map;
+    std::unordered_map<PackedKey, std::vector<std::string>> dict_map;
     int default_candicate_page_limit = 80;
+    // Above this many syllables the sentence is decoded in chunks and words are only looked up for the head
+    static constexpr size_t kLongInputSyllables = 16;
+    static constexpr size_t kLongInputHeadSyllables = 8;
+    // Typo correction only for codes of at least two syllables, a single syllable is one edit away from most others
+    static constexpr size_t kTypoMinKeys = 4;
+    static constexpr size_t kTypoWordsPerKey = 3;
 
     static std::vector<std::string> alpha_list;
     static std::vector<std::string> single_han_list;
 
-    void generate_for_single_char(std::vector<WordItem> &candidate_list, std::string code);
+    int generate_candidates();
+    std::vector<WordItem> generate(           //
+        std::string_view pinyin_sequence,     //
+        std::string_view pinyin_segmentation, //
+        std::vector<WordItem> *fetched_rows   //
+    );
+    std::vector<WordItem> generate_for_long_input(const PinyinAnalysis &analysis);
+    std::vector<WordItem> generate_typo_corrections(std::string_view pinyin_sequence);
+    void generate_for_single_char(std::vector<WordItem> &candidate_list, std::string_view code);
     void filter_with_single_helpcode(                //
         const std::vector<WordItem> &candidate_list, //
         std::vector<WordItem> &filtered_list,        //
@@ -82,27 +139,69 @@ class DictionaryUlPb
         std::vector<WordItem> &filtered_list,        //
         const std::string &help_codes                //
     );
+    // Views into a segmentation, allocated in the key arena
+    using SegmentList = std::pmr::vector<std::string_view>;
+
     void filter_key_value_list(                            //
         std::vector<WordItem> &candidate_list,             //
-        const std::vector<std::string> &pinyin_list,       //
+        const SegmentList &pinyin_list,                    //
         const std::vector<WordItem> &key_value_weight_list //
     );
+    // A code queried by generateSeries, allocated in the key arena
+    struct SeriesCode
+    {
+        std::pmr::string sequence;
+        std::string_view segmentation;
+        SegmentList segments; // Only split for the codes that are fetched in parallel
+    };
+    using SeriesCodeList = std::pmr::vector<SeriesCode>;
+
+    static void split_series_codes(std::string_view pinyin_sequence, std::string_view pinyin_segmentation,
+                                   SeriesCodeList &codes);
+    bool fetch_series_in_parallel(                                     //
+        TaskPool::Group &group,                                        //
+        const std::shared_ptr<DictionarySnapshot> &snapshot,           //
+        SeriesCodeList &codes,                                         //
+        std::pmr::vector<std::optional<std::vector<WordItem>>> &fetched //
+    );
+    std::vector<WordItem> query_system_rows( //
+        sqlite3 *db,                         //
+        DictionarySchema::Layout layout,     //
+        std::string_view pinyin_sequence,    //
+        const SegmentList &pinyin_list,      //
+        std::pmr::memory_resource *resource  //
+    );
+    void merge_user_lexicon(std::vector<WordItem> &candidate_list, const SegmentList &pinyin_list) const;
+    static bool key_matches_segments(std::string_view key, const SegmentList &pinyin_list);
+    static void split_segmentation(std::string_view segmentation, SegmentList &segments);
     std::vector<std::string> select_data(std::string sql_str);
-    std::vector<WordItem> select_complete_data(std::string sql_str);
+    std::vector<WordItem> select_complete_data(std::string_view sql_str);
+    std::vector<WordItem> select_complete_data(sqlite3 *db, std::string_view sql_str);
     std::vector<std::pair<std::string, std::string>> select_key_and_value(std::string sql_str);
     int check_data(std::string sql_str);
-    int insert_data(std::string sql_str);
-    int update_data(std::string sql_str);
-    int delete_data(std::string sql_str);
-    std::pair<std::string, bool> build_sql(const std::string &sp_str, std::vector<std::string> &pinyin_list);
+    std::optional<int> system_weight(const std::string &key, const std::string &jp, const std::string &word);
+    bool build_sql(DictionarySchema::Layout layout, std::string_view sp_str, const SegmentList &pinyin_list,
+                   std::pmr::string &sql);
     std::string build_sql_for_creating_word(const std::string &sp_str);
     std::string build_sql_for_checking_word(std::string key, std::string jp, std::string value);
-    std::string build_sql_for_inserting_word(std::string key, std::string jp, std::string value);
-    std::string build_sql_for_updating_word(std::string value);
-    std::string build_sql_for_updating_word(std::string pinyin, std::string word);
-    std::string build_sql_for_deleting_word(std::string pinyin, std::string word);
-    std::string choose_tbl(const std::string &sp_str, size_t word_len);
+    std::string key_for_updating_word(std::string pinyin, const std::string &word);
+    static std::string choose_tbl(DictionarySchema::Layout layout, std::string_view sp_str, size_t word_len);
     bool do_validate(std::string key, std::string jp, std::string value);
+    std::shared_ptr<DictionarySnapshot> current_snapshot() const;
+    void warm_up();
+    bool build_and_publish(uint64_t generation, std::shared_ptr<const PinyinTables> tables);
+    void sync_cache_generation();
+    void add_user_word(const std::string &key, const std::string &word, int weight = UserLexicon::kDefaultWeight);
+    void erase_user_word(const std::string &key, const std::string &word);
+    bool may_have_entries(std::string_view pinyin_sequence, const SegmentList &pinyin_list);
+    void record_user_choice(const std::string &key, const std::string &word);
+    void track_cached_series(CacheDependencyIndex::Cache cache, const PackedKey &cache_key,
+                             std::string_view pinyin_segmentation, std::string_view pinyin_sequence);
+    void invalidate_cached_key(const std::string &key);
+    uint64_t dictionary_fingerprint() const;
+    void restore_warm_cache();
+    void save_warm_cache();
+    void apply_user_frequency(std::vector<WordItem> &candidate_list) const;
 
   private:
     // Lock
@@ -110,6 +209,8 @@ class DictionaryUlPb
 
     // Whether in full help mode
     bool _is_full_help_mode = false;
+    // Whether keys one edit away are looked up too
+    bool _typo_correction = false;
     // Localtion of starting position
     int _help_mode_raw_pos = 0;           // Start from pos, e.g. 妮: ninv: 2
     std::string _pinyin_helpcodes = "";   // Help codes
@@ -125,10 +226,35 @@ class DictionaryUlPb
     std::vector<WordItem> _cur_candidate_list;
     std::vector<WordItem> _cur_page_candidate_list; // Current candidate list
     // boost::circular_buffer<std::pair<std::string, std::vector<WordItem>>> _cached_buffer;
-    CircularBuffer<std::string, std::vector<WordItem>> _cached_buffer;        // 缓存纯拼音的结果
-    CircularBuffer<std::string, std::vector<WordItem>> _cached_buffer_sgl;    // 缓存单码辅助结果
-    CircularBuffer<std::string, std::vector<WordItem>> _cached_buffer_dbl;    // 缓存双码辅助结果
-    CircularBuffer<std::string, std::vector<WordItem>> _cached_buffer_series; // 缓存拼音序列对应的所有结果
+    CircularBuffer<PackedKey, std::vector<WordItem>> _cached_buffer;        // 缓存纯拼音的结果
+    CircularBuffer<PackedKey, std::vector<WordItem>> _cached_buffer_sgl;    // 缓存单码辅助结果
+    CircularBuffer<PackedKey, std::vector<WordItem>> _cached_buffer_dbl;    // 缓存双码辅助结果
+    CircularBuffer<PackedKey, std::vector<WordItem>> _cached_buffer_series; // 缓存拼音序列对应的所有结果
+    /* 编码到上面四个缓存条目的反向索引，词库变动时只清受影响的条目 */
+    CacheDependencyIndex _cache_dependencies;
+    PinyinAnalyzer _analyzer;           // 分词、是否完整、辅助码位置，随按键增量更新
+    SentenceStream _sentence_stream;    // 长输入的整句，按块解码，只重解尾部窗口
+    KeyArena _key_arena;                // 当前按键的临时对象，下一次公开调用开始时整体释放
+    UserFrequencyModel _user_frequency; // 用户选词频率，带时间衰减
+    std::string _user_frequency_path;
+    WarmCache _warm_cache; // 最常查的编码，下次启动时直接放回纯拼音缓存
+    std::string _warm_cache_path;
+    TaskPool &_task_pool; // 长编码的各个前缀并行查询，每个任务从快照借一个只读连接；进程内共用一个线程池
+    TaskPool::Group _background_saves;               // 选词频率的快照在线程池里写，析构时等它写完
+    std::atomic<bool> _user_frequency_saving{false}; // 同一时间只写一份快照
+    std::optional<std::chrono::steady_clock::time_point> _deadline; // 本次查询的截止时间
+    bool _partial = false; // 当前候选因为截止时间缺了一部分来源，结果不进序列缓存和辅助码缓存
+
+    /* 词库快照，只通过 atomic_load/atomic_store 访问 */
+    std::shared_ptr<DictionarySnapshot> _snapshot;
+    std::atomic<uint64_t> _published_generation{0}; // 最新发布的快照的代数
+    uint64_t _cache_generation = 0;                 // 缓存里的结果来自哪一代快照
+    std::thread _reload_thread;
+    std::atomic<bool> _reloading{false};
+    std::atomic<Readiness> _readiness{Readiness::Warming};
+    std::mutex _reload_mutex; // 保护快照的发布与 _user_lexicon
+    /* 用户造的词和删的词，叠加在只读的系统词库上，每个新快照发布前都补到它的索引里 */
+    UserLexicon _user_lexicon;
 
   public:
     // Getters and setters
@@ -150,6 +276,19 @@ class DictionaryUlPb
         this->_help_mode_raw_pos = raw_pos;
     }
 
+    bool get_typo_correction()
+    {
+        return this->_typo_correction;
+    }
+    void set_typo_correction(bool typo_correction)
+    {
+        if (this->_typo_correction != typo_correction)
+        { /* 序列缓存里的结果带着纠错候选，或者缺少纠错候选 */
+            this->_typo_correction = typo_correction;
+            this->_cached_buffer_series.clear();
+        }
+    }
+
     const std::string &get_pinyin_sequence()
     {
         return this->_pinyin_sequence;
@@ -185,6 +324,16 @@ class DictionaryUlPb
         return this->_cur_candidate_list;
     }
 
+    const SentenceStream::Stats &get_sentence_stream_stats() const
+    {
+        return this->_sentence_stream.stats();
+    }
+
+    const KeyArena::Stats &get_key_arena_stats() const
+    {
+        return this->_key_arena.stats();
+    }
+
     int insert_word_to_cached_buffer_series(const std::string &pinyin, const std::string &word);
 
     bool is_all_complete_pinyin();
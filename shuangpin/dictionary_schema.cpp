@@ -0,0 +1,174 @@
+#include "dictionary_schema.h"
+#include "spdlog/spdlog.h"
+#include <fmt/core.h>
+#include <filesystem>
+#include <vector>
+
+using namespace std;
+
+namespace DictionarySchema
+{
+static bool exec(sqlite3 *db, const string &sql)
+{
+    char *err = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK)
+    {
+        spdlog::error("sqlite3_exec error: {} ({}).", err ? err : "", sql);
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+static bool create_table(sqlite3 *db)
+{
+    return exec(db, fmt::format("create table if not exists {} ("
+                                "key text not null, "
+                                "jp text not null, "
+                                "value text not null, "
+                                "weight integer not null, "
+                                "len integer not null, " // 字数，即 jp 的长度
+                                "primary key (key, weight desc, value)"
+                                ") without rowid;",
+                                kUnifiedTable));
+}
+
+/* without rowid 表的二级索引自带主键列，所以 (jp, weight desc) 对 key, jp, value, weight 是覆盖的 */
+static bool create_indexes(sqlite3 *db)
+{
+    return exec(db, fmt::format("create index if not exists {0}_jp on {0} (jp, weight desc);", kUnifiedTable));
+}
+
+Layout detect(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "select 1 from sqlite_master where type = 'table' and name = ?1;", -1, &stmt, 0) !=
+        SQLITE_OK)
+    {
+        spdlog::error("sqlite3_prepare_v2 error.");
+        return Layout::Sharded;
+    }
+    sqlite3_bind_text(stmt, 1, kUnifiedTable, -1, SQLITE_STATIC);
+    const Layout layout = sqlite3_step(stmt) == SQLITE_ROW ? Layout::Unified : Layout::Sharded;
+    sqlite3_finalize(stmt);
+    return layout;
+}
+
+/**
+ * @brief Per-connection settings, applied to every connection that reads the dictionary
+ *
+ * @param db
+ */
+void apply_connection_pragmas(sqlite3 *db)
+{
+    exec(db, fmt::format("pragma cache_size = -{};", kCacheSizeKib));
+    exec(db, fmt::format("pragma mmap_size = {};", kMmapSize));
+    exec(db, "pragma temp_store = memory;");
+}
+
+bool create_unified(sqlite3 *db)
+{
+    return create_table(db) && create_indexes(db);
+}
+
+/* 把 src 里的分片表搬进已打开的新库 db */
+static bool copy_tables(sqlite3 *db, const string &src_path, MigrationStats &stats)
+{
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, "attach database ?1 as src;", -1, &stmt, 0);
+    sqlite3_bind_text(stmt, 1, src_path.c_str(), -1, SQLITE_TRANSIENT);
+    const int attached = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (attached != SQLITE_DONE)
+    {
+        spdlog::error("Failed to attach db {}: {}.", src_path, sqlite3_errmsg(db));
+        return false;
+    }
+
+    vector<string> tables;
+    sqlite3_prepare_v2(db, "select name from src.sqlite_master where type = 'table' and name like 'tbl_%';", -1, &stmt,
+                       0);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        tables.push_back(string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))));
+    }
+    sqlite3_finalize(stmt);
+    if (tables.empty())
+    {
+        spdlog::error("No sharded dictionary tables in {}.", src_path);
+        return false;
+    }
+
+    /* 目标是新文件，中途失败直接删掉重来，不需要日志 */
+    if (!exec(db, "pragma journal_mode = off; pragma synchronous = off;") || !create_table(db) ||
+        !exec(db, "begin;"))
+    {
+        return false;
+    }
+    for (const auto &table : tables)
+    {
+        sqlite3_prepare_v2(db, fmt::format("select count(*) from src.\"{}\";", table).c_str(), -1, &stmt, 0);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            stats.rows_read += static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        const string sql = fmt::format("insert or ignore into {} (key, jp, value, weight, len) "
+                                       "select key, jp, value, weight, length(jp) from src.\"{}\" order by key;",
+                                       kUnifiedTable, table);
+        if (!exec(db, sql))
+        {
+            exec(db, "rollback;");
+            return false;
+        }
+        stats.rows_written += static_cast<size_t>(sqlite3_changes(db));
+        stats.tables += 1;
+    }
+    if (!exec(db, "commit;") || !exec(db, "detach database src;") || !create_indexes(db) || !exec(db, "analyze;"))
+    {
+        return false;
+    }
+    spdlog::info("Migrated {} tables, {} rows into {} rows.", stats.tables, stats.rows_read, stats.rows_written);
+    return true;
+}
+
+/**
+ * @brief Copy every sharded table of src into a new unified database at dst
+ *
+ * The source is only read. Rows are loaded before the jianpin index is created, and the database is analyzed at the
+ * end so the planner knows the index is selective. On failure dst is closed and deleted, so the migration can
+ * simply be run again.
+ *
+ * @param src_path Database in the sharded layout
+ * @param dst_path Must not exist yet
+ * @param stats
+ * @return bool
+ */
+bool migrate(const string &src_path, const string &dst_path, MigrationStats &stats)
+{
+    stats = MigrationStats{};
+    if (filesystem::exists(dst_path))
+    {
+        spdlog::error("Migration target {} already exists.", dst_path);
+        return false;
+    }
+    sqlite3 *db = nullptr;
+    bool migrated = false;
+    if (sqlite3_open_v2(dst_path.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+    {
+        spdlog::error("Failed to open db {}: {}.", dst_path, sqlite3_errmsg(db));
+    }
+    else
+    {
+        migrated = copy_tables(db, src_path, stats);
+    }
+    sqlite3_close(db);
+    if (!migrated)
+    {
+        /* 目标是这次新建的，失败的半成品删掉，下次重新迁移 */
+        error_code ec;
+        filesystem::remove(dst_path, ec);
+    }
+    return migrated;
+}
+} // namespace DictionarySchema
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sqlite3.h>
+
+// Layouts of the system dictionary database and the migration between them.
+//
+// Sharded is the layout the dictionary ships with: one table per word length and initial, tbl_{len}_{initial} and
+// tbl_others_{initial}, with whatever indexes the file happens to have. Unified is a single WITHOUT ROWID table
+// clustered on (key, weight desc), so an exact-key query is one range read that is already in weight order, plus a
+// covering index on (jp, weight desc) for jianpin queries and an integer length column.
+namespace DictionarySchema
+{
+enum class Layout
+{
+    Sharded,
+    Unified,
+};
+
+constexpr const char *kUnifiedTable = "dict";
+// Column list of every candidate query, in the order the rows are read. Covered by the jianpin index in the unified
+// layout, which select * is not because of the length column.
+constexpr const char *kColumns = "key, jp, value, weight";
+
+// Negative cache_size is in KiB
+constexpr int kCacheSizeKib = 16 * 1024;
+constexpr long long kMmapSize = 256LL * 1024 * 1024;
+
+struct MigrationStats
+{
+    size_t tables = 0;
+    size_t rows_read = 0;
+    size_t rows_written = 0; // Smaller than rows_read when the source has duplicate (key, weight, value) rows
+};
+
+Layout detect(sqlite3 *db);
+void apply_connection_pragmas(sqlite3 *db);
+bool create_unified(sqlite3 *db);
+bool migrate(const std::string &src_path, const std::string &dst_path, MigrationStats &stats);
+} // namespace DictionarySchema
@@ -0,0 +1,346 @@
+#include "dictionary_snapshot.h"
+#include "packed_key.h"
+#include "spdlog/spdlog.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+DictionarySnapshot::DictionarySnapshot(const string &db_path, uint64_t generation,
+                                       shared_ptr<const PinyinTables> tables)
+    : db_path_(db_path), generation_(generation), tables_(std::move(tables))
+{
+}
+
+DictionarySnapshot::~DictionarySnapshot()
+{
+    for (sqlite3 *reader : idle_readers_)
+    {
+        sqlite3_close(reader);
+    }
+    if (db_)
+    {
+        sqlite3_close(db_);
+    }
+}
+
+/**
+ * @brief Open the database and build the filter and the key index
+ *
+ * A snapshot is returned even if loading fails, so the caller always has something to query. Check ok() before
+ * publishing a reloaded one.
+ *
+ * @param db_path
+ * @param generation Increases with every reload, caches built on an older generation are stale
+ * @param tables Pinyin tables the snapshot is published with
+ * @param top_k Words kept per key in the index
+ * @return shared_ptr<DictionarySnapshot>
+ */
+shared_ptr<DictionarySnapshot> DictionarySnapshot::open( //
+    const string &db_path,                               //
+    uint64_t generation,                                 //
+    shared_ptr<const PinyinTables> tables,               //
+    size_t top_k                                         //
+)
+{
+    auto snapshot = open_unindexed(db_path, generation, std::move(tables));
+    if (snapshot->ok_)
+    {
+        snapshot->ok_ = snapshot->build_indexes(top_k);
+    }
+    return snapshot;
+}
+
+shared_ptr<DictionarySnapshot> DictionarySnapshot::open_unindexed( //
+    const string &db_path,                                         //
+    uint64_t generation,                                           //
+    shared_ptr<const PinyinTables> tables                          //
+)
+{
+    shared_ptr<DictionarySnapshot> snapshot(new DictionarySnapshot(db_path, generation, std::move(tables)));
+    /* 不自动创建，词库文件缺失时直接报错，而不是得到一个空库；只读打开，用户的改动在 UserLexicon 里，
+       页面经 mmap 在进程之间共享 */
+    if (sqlite3_open_v2(db_path.c_str(), &snapshot->db_, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        spdlog::error("Failed to open db {}: {}.", db_path, sqlite3_errmsg(snapshot->db_));
+        return snapshot;
+    }
+    DictionarySchema::apply_connection_pragmas(snapshot->db_);
+    snapshot->layout_ = DictionarySchema::detect(snapshot->db_);
+    snapshot->ok_ = true;
+    return snapshot;
+}
+
+/**
+ * @brief Query the hot keys once, in the same shape build_sql uses for complete pinyin
+ *
+ * Called before the snapshot is published, so nothing else uses the connection yet.
+ *
+ * @param limit
+ * @return size_t Number of keys queried
+ */
+size_t DictionarySnapshot::prefetch_hot_keys(int limit)
+{
+    size_t count = 0;
+    for (const auto &[table, key] : hot_keys_)
+    {
+        sqlite3_stmt *stmt;
+        const string sql =
+            fmt::format("select {} from {} where key = '{}' order by weight desc limit {};", DictionarySchema::kColumns,
+                        table, key, limit);
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, 0) != SQLITE_OK)
+        {
+            continue;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+        }
+        sqlite3_finalize(stmt);
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief Lease an idle reader, or open one
+ *
+ * If a reader cannot be opened the lease hands out the snapshot's own connection, which sqlite serializes, so the
+ * query still runs, only not in parallel.
+ *
+ * @return DictionarySnapshot::Reader
+ */
+DictionarySnapshot::Reader DictionarySnapshot::lease_reader()
+{
+    {
+        lock_guard<mutex> lock(readers_mutex_);
+        if (!idle_readers_.empty())
+        {
+            sqlite3 *reader = idle_readers_.back();
+            idle_readers_.pop_back();
+            return Reader(this, reader);
+        }
+    }
+    sqlite3 *reader = nullptr;
+    if (!ok_ || sqlite3_open_v2(db_path_.c_str(), &reader, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        if (ok_)
+        {
+            spdlog::warn("Failed to open a reader of {}: {}.", db_path_, sqlite3_errmsg(reader));
+        }
+        sqlite3_close(reader);
+        return Reader(nullptr, db_);
+    }
+    DictionarySchema::apply_connection_pragmas(reader);
+    return Reader(this, reader);
+}
+
+DictionarySnapshot::Reader::Reader(DictionarySnapshot *owner, sqlite3 *db) : owner_(owner), db_(db)
+{
+}
+
+DictionarySnapshot::Reader::Reader(Reader &&other) noexcept : owner_(other.owner_), db_(other.db_)
+{
+    other.owner_ = nullptr;
+    other.db_ = nullptr;
+}
+
+DictionarySnapshot::Reader::~Reader()
+{
+    if (owner_)
+    {
+        lock_guard<mutex> lock(owner_->readers_mutex_);
+        owner_->idle_readers_.push_back(db_);
+    }
+}
+
+sqlite3 *DictionarySnapshot::Reader::db() const
+{
+    return db_;
+}
+
+void DictionarySnapshot::add_word(const string &key, const string &jp, const string &word, int weight)
+{
+    key_filter_.insert(KeyFilter::Domain::Key, PackedKey(key));
+    key_filter_.insert(KeyFilter::Domain::Jianpin, PackedKey(jp));
+    key_index_.insert(key, word, weight);
+}
+
+void DictionarySnapshot::remove_word(const string &key, const string &word)
+{
+    key_index_.erase(key, word);
+}
+
+bool DictionarySnapshot::ok() const
+{
+    return ok_;
+}
+
+uint64_t DictionarySnapshot::generation() const
+{
+    return generation_;
+}
+
+sqlite3 *DictionarySnapshot::db() const
+{
+    return db_;
+}
+
+DictionarySchema::Layout DictionarySnapshot::layout() const
+{
+    return layout_;
+}
+
+const shared_ptr<const PinyinTables> &DictionarySnapshot::pinyin_tables() const
+{
+    return tables_;
+}
+
+const KeyFilter &DictionarySnapshot::key_filter() const
+{
+    return key_filter_;
+}
+
+const KeyIndex &DictionarySnapshot::key_index() const
+{
+    return key_index_;
+}
+
+/**
+ * @brief List all sharded dictionary tables, i.e. tbl_{len}_{initial} and tbl_others_{initial}, or the single table of
+ * the unified layout
+ *
+ * @return vector<string>
+ */
+vector<string> DictionarySnapshot::list_dict_tables() const
+{
+    vector<string> tables;
+    if (layout_ == DictionarySchema::Layout::Unified)
+    {
+        tables.push_back(DictionarySchema::kUnifiedTable);
+        return tables;
+    }
+    sqlite3_stmt *stmt;
+    int exit = sqlite3_prepare_v2(db_, "select name from sqlite_master where type = 'table' and name like 'tbl_%';",
+                                  -1, &stmt, 0);
+    if (exit != SQLITE_OK)
+    {
+        spdlog::error("sqlite3_prepare_v2 error.");
+        return tables;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        tables.push_back(string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))));
+    }
+    sqlite3_finalize(stmt);
+    return tables;
+}
+
+/**
+ * @brief Scan every row once, fill the negative-lookup filter and build the key index
+ *
+ * @param top_k
+ * @return bool
+ */
+bool DictionarySnapshot::build_indexes(size_t top_k)
+{
+    vector<string> tables = list_dict_tables();
+    size_t row_count = 0;
+    for (const auto &table : tables)
+    {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db_, fmt::format("select count(*) from {};", table).c_str(), -1, &stmt, 0) != SQLITE_OK)
+        {
+            spdlog::error("sqlite3_prepare_v2 error.");
+            return false;
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            row_count += static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    /* Every row contributes a key and a jp, leave some room for words created later */
+    key_filter_.reset(row_count * 2 + 4096);
+    vector<KeyIndex::Row> rows;
+    vector<size_t> table_ends;
+    rows.reserve(row_count);
+    for (const auto &table : tables)
+    {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db_, fmt::format("select key, jp, value, weight from {};", table).c_str(), -1, &stmt,
+                               0) != SQLITE_OK)
+        {
+            spdlog::error("sqlite3_prepare_v2 error.");
+            key_filter_.clear();
+            return false;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const char *key = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            const char *jp = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            const char *value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+            if (key)
+            {
+                key_filter_.insert(KeyFilter::Domain::Key, PackedKey(key));
+                if (value)
+                {
+                    rows.push_back(KeyIndex::Row{key, value, sqlite3_column_int(stmt, 3)});
+                }
+            }
+            if (jp)
+            {
+                key_filter_.insert(KeyFilter::Domain::Jianpin, PackedKey(jp));
+            }
+        }
+        sqlite3_finalize(stmt);
+        table_ends.push_back(rows.size());
+    }
+    collect_hot_keys(tables, rows, table_ends);
+    key_index_.build(rows, top_k);
+    spdlog::info("Dictionary snapshot {}: {} codes in filter ({} KB), {} keys in index ({} KB).", generation_,
+                 key_filter_.item_count(), key_filter_.memory_usage() / 1024, key_index_.key_count(),
+                 key_index_.memory_usage() / 1024);
+    return true;
+}
+
+/**
+ * @brief Remember the keys of the heaviest rows for prefetch_hot_keys
+ *
+ * @param tables
+ * @param rows
+ * @param table_ends rows[table_ends[i - 1], table_ends[i]) came from tables[i]
+ */
+void DictionarySnapshot::collect_hot_keys(const vector<string> &tables, const vector<KeyIndex::Row> &rows,
+                                          const vector<size_t> &table_ends)
+{
+    constexpr size_t kHotKeyCount = 256;
+    vector<pair<int, size_t>> order; // weight, row
+    order.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        order.emplace_back(rows[i].weight, i);
+    }
+    /* Many rows share a key, sorting a few thousand of the heaviest rows is enough to find the hot keys */
+    const size_t sorted = min(order.size(), kHotKeyCount * 16);
+    partial_sort(order.begin(), order.begin() + sorted, order.end(),
+                 [](const auto &a, const auto &b) { return a.first > b.first; });
+    order.resize(sorted);
+
+    unordered_set<string> seen;
+    hot_keys_.clear();
+    for (const auto &[weight, row] : order)
+    {
+        if (hot_keys_.size() >= kHotKeyCount)
+        {
+            break;
+        }
+        if (!seen.insert(rows[row].key).second)
+        {
+            continue;
+        }
+        const size_t table = upper_bound(table_ends.begin(), table_ends.end(), row) - table_ends.begin();
+        hot_keys_.emplace_back(tables[table], rows[row].key);
+    }
+}
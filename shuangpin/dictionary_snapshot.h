@@ -0,0 +1,106 @@
+#pragma once
+
+#include "dictionary_schema.h"
+#include "key_filter.h"
+#include "key_index.h"
+#include "pinyin_tables.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sqlite3.h>
+
+/**
+ * @brief Everything a query reads from the system dictionary, loaded and published as one unit
+ *
+ * A snapshot owns its own database connection, the negative-lookup filter, the key index and the pinyin tables it
+ * was built with. It is built in full before it is published, and readers hold a shared_ptr for the duration of a
+ * query, so a reload never blocks typing and the previous snapshot is released by its last reader.
+ *
+ * The database is opened read-only. Apart from the user layer, which is applied to the filter and the index delta,
+ * a published snapshot is not modified.
+ *
+ * db() belongs to the thread that types. Queries run on other threads lease a connection of their own, the
+ * connections are opened on first use and kept for the lifetime of the snapshot, so parallel queries neither share
+ * a connection mutex nor pay for opening one per key.
+ */
+class DictionarySnapshot
+{
+  public:
+    // A read-only connection leased from the snapshot's pool, returned when the lease ends
+    class Reader
+    {
+      public:
+        Reader(Reader &&other) noexcept;
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+        ~Reader();
+
+        sqlite3 *db() const;
+
+      private:
+        friend class DictionarySnapshot;
+        Reader(DictionarySnapshot *owner, sqlite3 *db);
+
+      private:
+        DictionarySnapshot *owner_; // Null if db is the snapshot's own connection
+        sqlite3 *db_;
+    };
+
+    DictionarySnapshot(const DictionarySnapshot &) = delete;
+    DictionarySnapshot &operator=(const DictionarySnapshot &) = delete;
+    ~DictionarySnapshot();
+
+    static std::shared_ptr<DictionarySnapshot> open( //
+        const std::string &db_path,                  //
+        uint64_t generation,                         //
+        std::shared_ptr<const PinyinTables> tables,  //
+        size_t top_k                                 //
+    );
+    // Only open the database, queries go straight to SQL until an indexed snapshot replaces this one
+    static std::shared_ptr<DictionarySnapshot> open_unindexed( //
+        const std::string &db_path,                            //
+        uint64_t generation,                                   //
+        std::shared_ptr<const PinyinTables> tables             //
+    );
+
+    // Run the queries of the heaviest keys once so that their pages are in the connection's cache
+    size_t prefetch_hot_keys(int limit);
+    // The snapshot must outlive the lease
+    Reader lease_reader();
+
+    void add_word(const std::string &key, const std::string &jp, const std::string &word, int weight);
+    void remove_word(const std::string &key, const std::string &word);
+
+    // Database opened, and indexes built unless opened unindexed
+    bool ok() const;
+    uint64_t generation() const;
+    sqlite3 *db() const;
+    DictionarySchema::Layout layout() const;
+    const std::shared_ptr<const PinyinTables> &pinyin_tables() const;
+    const KeyFilter &key_filter() const;
+    const KeyIndex &key_index() const;
+
+  private:
+    DictionarySnapshot(const std::string &db_path, uint64_t generation, std::shared_ptr<const PinyinTables> tables);
+
+    std::vector<std::string> list_dict_tables() const;
+    bool build_indexes(size_t top_k);
+    void collect_hot_keys(const std::vector<std::string> &tables, const std::vector<KeyIndex::Row> &rows,
+                          const std::vector<size_t> &table_ends);
+
+  private:
+    std::string db_path_;
+    uint64_t generation_;
+    sqlite3 *db_ = nullptr;
+    bool ok_ = false;
+    DictionarySchema::Layout layout_ = DictionarySchema::Layout::Sharded;
+    std::shared_ptr<const PinyinTables> tables_;
+    KeyFilter key_filter_; // 数据库中存在的 key 和 jp，用来跳过必然为空的查询
+    KeyIndex key_index_;   // 全拼 key 的前缀树，造词时一次遍历取出所有前缀的候选
+    std::vector<std::pair<std::string, std::string>> hot_keys_; // table, key，权重最高的编码，预热时先查一遍
+    std::mutex readers_mutex_;
+    std::vector<sqlite3 *> idle_readers_; // 其他线程用过的只读连接，留着下次再借
+};
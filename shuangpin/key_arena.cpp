@@ -0,0 +1,66 @@
+#include "key_arena.h"
+
+KeyArena::OverflowResource::OverflowResource(Stats &stats) : stats_(stats)
+{
+}
+
+void *KeyArena::OverflowResource::do_allocate(size_t bytes, size_t alignment)
+{
+    ++stats_.overflow_allocations;
+    stats_.overflow_bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void KeyArena::OverflowResource::do_deallocate(void *p, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool KeyArena::OverflowResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+KeyArena::KeyArena(size_t block_size) : block_(block_size), overflow_(stats_)
+{
+    buffer_.emplace(block_.data(), block_.size(), &overflow_);
+}
+
+std::pmr::memory_resource *KeyArena::resource()
+{
+    return &*buffer_;
+}
+
+/**
+ * @brief Release everything allocated since the last reset, O(1) unless the key overflowed the block
+ *
+ */
+void KeyArena::reset()
+{
+    /* Re-create the resource so that the next key starts at the beginning of the block again */
+    buffer_.emplace(block_.data(), block_.size(), &overflow_);
+    ++stats_.keys;
+}
+
+KeyArena::Scope::Scope(KeyArena &arena) : arena_(arena)
+{
+    if (arena_.depth_++ == 0)
+    {
+        arena_.reset();
+    }
+}
+
+KeyArena::Scope::~Scope()
+{
+    --arena_.depth_;
+}
+
+const KeyArena::Stats &KeyArena::stats() const
+{
+    return stats_;
+}
+
+size_t KeyArena::block_size() const
+{
+    return block_.size();
+}
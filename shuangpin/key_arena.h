@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief Scratch memory for the temporaries of one keystroke
+ *
+ * A monotonic buffer over a block that is allocated once and reused for every key. Allocations are a pointer bump,
+ * deallocation is a no-op, and reset() drops everything at once. When a key needs more than the block, the overflow
+ * goes to the global heap and is counted, so a steady-state overflow count of zero means the temporaries of the hot
+ * path never touch the heap.
+ *
+ * Public entry points of the dictionary open a Scope. Only the outermost one resets the arena, so an entry point
+ * called from another one does not free the temporaries of its caller. Not thread-safe, the arena belongs to the
+ * thread that types.
+ */
+class KeyArena
+{
+  public:
+    struct Stats
+    {
+        size_t keys = 0;                 // reset() calls, one per outermost Scope
+        size_t overflow_allocations = 0; // Allocations that did not fit in the block
+        size_t overflow_bytes = 0;
+    };
+
+    explicit KeyArena(size_t block_size = 64 * 1024);
+    KeyArena(const KeyArena &) = delete;
+    KeyArena &operator=(const KeyArena &) = delete;
+
+    // Resets the arena when no other scope is open
+    class Scope
+    {
+      public:
+        explicit Scope(KeyArena &arena);
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+
+      private:
+        KeyArena &arena_;
+    };
+
+    std::pmr::memory_resource *resource();
+    void reset();
+
+    const Stats &stats() const;
+    size_t block_size() const;
+
+  private:
+    // Forwards to the global heap and counts
+    class OverflowResource : public std::pmr::memory_resource
+    {
+      public:
+        explicit OverflowResource(Stats &stats);
+
+      private:
+        void *do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+      private:
+        Stats &stats_;
+    };
+
+    std::vector<std::byte> block_;
+    Stats stats_;
+    OverflowResource overflow_;
+    std::optional<std::pmr::monotonic_buffer_resource> buffer_;
+    size_t depth_ = 0; // Open scopes
+};
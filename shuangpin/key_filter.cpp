@@ -0,0 +1,91 @@
+#include "key_filter.h"
+
+namespace
+{
+uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+} // namespace
+
+/**
+ * @brief Allocate the bit array, rounded up to a power of two
+ *
+ * @param expected_items
+ * @param bits_per_item
+ */
+void KeyFilter::reset(size_t expected_items, size_t bits_per_item)
+{
+    uint64_t bit_count = 1 << 16;
+    const uint64_t wanted = static_cast<uint64_t>(expected_items) * bits_per_item;
+    while (bit_count < wanted)
+    {
+        bit_count <<= 1;
+    }
+    bits_.assign(static_cast<size_t>(bit_count / 64), 0);
+    bit_mask_ = bit_count - 1;
+    item_count_ = 0;
+}
+
+void KeyFilter::clear()
+{
+    bits_.clear();
+    bits_.shrink_to_fit();
+    bit_mask_ = 0;
+    item_count_ = 0;
+}
+
+void KeyFilter::insert(Domain domain, const PackedKey &code)
+{
+    if (!ready())
+    {
+        return;
+    }
+    const uint64_t h1 = mix(code.hash() ^ static_cast<uint64_t>(domain));
+    const uint64_t h2 = mix(h1) | 1;
+    for (int i = 0; i < kHashCount; ++i)
+    {
+        const uint64_t bit = (h1 + i * h2) & bit_mask_;
+        bits_[bit >> 6] |= uint64_t{1} << (bit & 63);
+    }
+    item_count_ += 1;
+}
+
+bool KeyFilter::may_contain(Domain domain, const PackedKey &code) const
+{
+    if (!ready())
+    {
+        return true;
+    }
+    const uint64_t h1 = mix(code.hash() ^ static_cast<uint64_t>(domain));
+    const uint64_t h2 = mix(h1) | 1;
+    for (int i = 0; i < kHashCount; ++i)
+    {
+        const uint64_t bit = (h1 + i * h2) & bit_mask_;
+        if (!(bits_[bit >> 6] & (uint64_t{1} << (bit & 63))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool KeyFilter::ready() const
+{
+    return !bits_.empty();
+}
+
+size_t KeyFilter::item_count() const
+{
+    return item_count_;
+}
+
+size_t KeyFilter::memory_usage() const
+{
+    return bits_.capacity() * sizeof(uint64_t);
+}
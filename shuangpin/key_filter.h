@@ -0,0 +1,39 @@
+#pragma once
+
+#include "packed_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Bloom filter over dictionary codes, used to skip queries that are guaranteed to be empty
+ *
+ * Full shuangpin keys and jianpin codes live in the same bit array under different salts. A negative answer is
+ * exact, a positive answer may be a false positive (about 1% at the default 10 bits per item). Before the filter is
+ * built every code is reported as possibly present, so the filter never hides data.
+ */
+class KeyFilter
+{
+  public:
+    enum class Domain : uint64_t
+    {
+        Key = 0x9e3779b97f4a7c15ULL,
+        Jianpin = 0xc2b2ae3d27d4eb4fULL,
+    };
+
+    void reset(size_t expected_items, size_t bits_per_item = 10);
+    void clear();
+    void insert(Domain domain, const PackedKey &code);
+    bool may_contain(Domain domain, const PackedKey &code) const;
+
+    bool ready() const;
+    size_t item_count() const;
+    size_t memory_usage() const;
+
+  private:
+    static constexpr int kHashCount = 7;
+
+    std::vector<uint64_t> bits_;
+    uint64_t bit_mask_ = 0;
+    size_t item_count_ = 0;
+};
@@ -0,0 +1,257 @@
+#include "key_index.h"
+#include <algorithm>
+
+/**
+ * @brief Build the trie from dictionary rows, rows are sorted in place
+ *
+ * @param rows (key, word, weight), keys must be lowercase letters
+ * @param top_k Postings kept per key
+ */
+void KeyIndex::build(std::vector<Row> &rows, size_t top_k)
+{
+    clear();
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        return a.key != b.key ? a.key < b.key : a.weight > b.weight;
+    });
+    std::unordered_map<std::string, uint32_t> pooled;
+    nodes_.push_back(Node{0, 0, 0, 0, 0});
+    build_node(rows, 0, rows.size(), 0, 0, top_k, pooled);
+    nodes_.shrink_to_fit();
+    postings_.shrink_to_fit();
+    pool_.shrink_to_fit();
+}
+
+/**
+ * @brief Fill node for rows [lo, hi) sharing a prefix of length depth, then recurse into its children
+ *
+ * @return uint32_t node
+ */
+uint32_t KeyIndex::build_node(std::vector<Row> &rows, size_t lo, size_t hi, size_t depth, uint32_t node,
+                              size_t top_k, std::unordered_map<std::string, uint32_t> &pooled)
+{
+    /* Rows whose key ends here sort first */
+    size_t terminal_end = lo;
+    while (terminal_end < hi && rows[terminal_end].key.size() == depth)
+    {
+        ++terminal_end;
+    }
+    if (terminal_end > lo)
+    {
+        const size_t count = std::min(terminal_end - lo, std::min<size_t>(top_k, UINT16_MAX));
+        nodes_[node].posting_begin = static_cast<uint32_t>(postings_.size());
+        nodes_[node].posting_count = static_cast<uint16_t>(count);
+        for (size_t i = lo; i < lo + count; ++i)
+        {
+            auto [it, inserted] = pooled.emplace(rows[i].word, static_cast<uint32_t>(pool_.size()));
+            if (inserted)
+            {
+                pool_ += rows[i].word;
+            }
+            postings_.push_back(Posting{it->second, static_cast<uint16_t>(rows[i].word.size()), rows[i].weight});
+        }
+        key_count_ += 1;
+    }
+
+    /* Group the remaining rows by their next letter */
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t i = terminal_end; i < hi;)
+    {
+        size_t j = i + 1;
+        while (j < hi && rows[j].key[depth] == rows[i].key[depth])
+        {
+            ++j;
+        }
+        groups.emplace_back(i, j);
+        i = j;
+    }
+    const uint32_t children_begin = static_cast<uint32_t>(nodes_.size());
+    nodes_[node].children_begin = children_begin;
+    nodes_[node].child_count = static_cast<uint8_t>(groups.size());
+    for (const auto &[group_lo, group_hi] : groups)
+    {
+        nodes_.push_back(Node{0, 0, 0, 0, rows[group_lo].key[depth]});
+    }
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        build_node(rows, groups[i].first, groups[i].second, depth + 1, children_begin + static_cast<uint32_t>(i),
+                   top_k, pooled);
+    }
+    return node;
+}
+
+void KeyIndex::insert(const std::string &key, const std::string &word, int weight)
+{
+    /* The delta copy replaces a built one, e.g. a word replayed onto a freshly built index */
+    erased_.insert(key + '\0' + word);
+    auto &words = inserted_[key];
+    for (auto &each : words)
+    {
+        if (each.word == word)
+        {
+            each.weight = weight;
+            return;
+        }
+    }
+    words.push_back(PendingWord{word, weight});
+}
+
+void KeyIndex::erase(const std::string &key, const std::string &word)
+{
+    auto it = inserted_.find(key);
+    if (it != inserted_.end())
+    {
+        auto &words = it->second;
+        words.erase(std::remove_if(words.begin(), words.end(), [&](const PendingWord &each) { return each.word == word; }),
+                    words.end());
+    }
+    erased_.insert(key + '\0' + word);
+}
+
+void KeyIndex::clear()
+{
+    nodes_.clear();
+    postings_.clear();
+    pool_.clear();
+    key_count_ = 0;
+    inserted_.clear();
+    erased_.clear();
+}
+
+bool KeyIndex::ready() const
+{
+    return !nodes_.empty();
+}
+
+size_t KeyIndex::key_count() const
+{
+    return key_count_;
+}
+
+size_t KeyIndex::memory_usage() const
+{
+    return nodes_.capacity() * sizeof(Node) + postings_.capacity() * sizeof(Posting) + pool_.capacity();
+}
+
+std::vector<KeyIndex::Hit> KeyIndex::lookup(std::string_view key, size_t top_k) const
+{
+    std::vector<Hit> hits;
+    if (!ready())
+    {
+        return hits;
+    }
+    const Node *node = &root();
+    for (const char letter : key)
+    {
+        node = child(*node, letter);
+        if (!node)
+        {
+            break;
+        }
+    }
+    if (node)
+    {
+        collect(*node, key, top_k, hits);
+    }
+    else
+    {
+        collect(root(), key, top_k, hits); // Only the delta can hold this key, root has no postings
+    }
+    return hits;
+}
+
+/**
+ * @brief Collect the words of every prefix of code whose length is a multiple of step in one descent
+ *
+ * @param code Full shuangpin code
+ * @param step 2 for shuangpin, one hanzi per two keys
+ * @param top_k Words kept per prefix
+ * @return vector<vector<Hit>> Grouped by prefix length, shortest first
+ */
+std::vector<std::vector<KeyIndex::Hit>> KeyIndex::prefix_walk(std::string_view code, size_t step, size_t top_k) const
+{
+    std::vector<std::vector<Hit>> groups;
+    if (!ready() || step == 0)
+    {
+        return groups;
+    }
+    groups.resize(code.size() / step);
+    const Node *node = &root();
+    for (size_t depth = 1; depth <= groups.size() * step; ++depth)
+    {
+        node = node ? child(*node, code[depth - 1]) : nullptr;
+        if (depth % step == 0)
+        {
+            collect(node ? *node : root(), code.substr(0, depth), top_k, groups[depth / step - 1]);
+        }
+    }
+    return groups;
+}
+
+const KeyIndex::Node &KeyIndex::root() const
+{
+    return nodes_[0];
+}
+
+const KeyIndex::Node *KeyIndex::child(const Node &node, char letter) const
+{
+    const Node *begin = children(node);
+    const Node *end = begin + node.child_count;
+    const Node *it = std::lower_bound(begin, end, letter, [](const Node &each, char value) { return each.letter < value; });
+    return it != end && it->letter == letter ? it : nullptr;
+}
+
+const KeyIndex::Node *KeyIndex::children(const Node &node) const
+{
+    return nodes_.data() + node.children_begin;
+}
+
+/**
+ * @brief Append the postings of node merged with the delta for key, sorted by weight desc
+ *
+ * @param node Node reached by key, root when the key is not in the trie
+ * @param key
+ * @param top_k
+ * @param hits
+ */
+void KeyIndex::collect(const Node &node, std::string_view key, size_t top_k, std::vector<Hit> &hits) const
+{
+    const size_t begin = hits.size();
+    if (&node != &root() || key.empty())
+    {
+        for (uint32_t i = 0; i < node.posting_count; ++i)
+        {
+            const Posting &posting = postings_[node.posting_begin + i];
+            std::string_view word(pool_.data() + posting.text_offset, posting.text_length);
+            if (erased_.empty() || !is_erased(key, word))
+            {
+                hits.push_back(Hit{key, word, posting.weight});
+            }
+        }
+    }
+    if (!inserted_.empty())
+    {
+        auto it = inserted_.find(std::string(key));
+        if (it != inserted_.end())
+        {
+            for (const auto &each : it->second)
+            {
+                hits.push_back(Hit{key, each.word, each.weight});
+            }
+            std::stable_sort(hits.begin() + begin, hits.end(),
+                             [](const Hit &a, const Hit &b) { return a.weight > b.weight; });
+        }
+    }
+    if (hits.size() - begin > top_k)
+    {
+        hits.resize(begin + top_k);
+    }
+}
+
+bool KeyIndex::is_erased(std::string_view key, std::string_view word) const
+{
+    std::string tag;
+    tag.reserve(key.size() + 1 + word.size());
+    tag.append(key.data(), key.size()).push_back('\0');
+    tag.append(word.data(), word.size());
+    return erased_.count(tag) > 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief In-memory trie over full shuangpin keys with weight-sorted postings
+ *
+ * Nodes are stored in one flat array, the children of a node are contiguous and sorted by letter. A node that ends
+ * a dictionary key points to a slice of the postings array holding the top-k words of that key, sorted by weight
+ * desc. Word text is kept once in a shared string pool.
+ *
+ * The structure is immutable after build(), words created or deleted later are kept in a small delta that is merged
+ * during lookups.
+ */
+class KeyIndex
+{
+  public:
+    struct Row
+    {
+        std::string key;
+        std::string word;
+        int weight;
+    };
+
+    struct Hit
+    {
+        std::string_view key;
+        std::string_view word;
+        int weight;
+    };
+
+    struct Node
+    {
+        uint32_t children_begin;
+        uint32_t posting_begin;
+        uint16_t posting_count;
+        uint8_t child_count;
+        char letter;
+    };
+
+    void build(std::vector<Row> &rows, size_t top_k);
+    void insert(const std::string &key, const std::string &word, int weight);
+    void erase(const std::string &key, const std::string &word);
+    void clear();
+
+    bool ready() const;
+    size_t key_count() const;
+    size_t memory_usage() const;
+
+    // Exact key, top_k words sorted by weight desc
+    std::vector<Hit> lookup(std::string_view key, size_t top_k) const;
+    // Walk code once from the root, result[i] holds the words of code[0, (i + 1) * step)
+    std::vector<std::vector<Hit>> prefix_walk(std::string_view code, size_t step, size_t top_k) const;
+
+    const Node &root() const;
+    const Node *child(const Node &node, char letter) const;
+    const Node *children(const Node &node) const;
+    void collect(const Node &node, std::string_view key, size_t top_k, std::vector<Hit> &hits) const;
+
+  private:
+    struct Posting
+    {
+        uint32_t text_offset;
+        uint16_t text_length;
+        int32_t weight;
+    };
+
+    struct PendingWord
+    {
+        std::string word;
+        int weight;
+    };
+
+    uint32_t build_node(std::vector<Row> &rows, size_t lo, size_t hi, size_t depth, uint32_t node, size_t top_k,
+                        std::unordered_map<std::string, uint32_t> &pooled);
+    bool is_erased(std::string_view key, std::string_view word) const;
+
+  private:
+    std::vector<Node> nodes_;
+    std::vector<Posting> postings_;
+    std::string pool_;
+    size_t key_count_ = 0;
+
+    std::unordered_map<std::string, std::vector<PendingWord>> inserted_; // key -> words created after build
+    std::unordered_set<std::string> erased_;                             // key + '\0' + word, hides built postings
+};
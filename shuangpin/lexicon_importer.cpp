@@ -0,0 +1,477 @@
+#include "lexicon_importer.h"
+#include "pinyin_utils.h"
+#include "utf8_utils.h"
+#include "spdlog/spdlog.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+constexpr size_t kMinChunkBytes = 256 * 1024;
+constexpr size_t kMaxWorkers = 8;
+constexpr size_t kMaxReportedRejects = 10;
+
+/* 语句在作用域结束时释放，出错提前返回时不会漏掉 */
+struct Statement
+{
+    sqlite3_stmt *stmt = nullptr;
+
+    Statement() = default;
+    Statement(const Statement &) = delete;
+    Statement &operator=(const Statement &) = delete;
+    ~Statement()
+    {
+        sqlite3_finalize(stmt);
+    }
+
+    bool prepare(sqlite3 *db, const string &sql)
+    {
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK)
+        {
+            spdlog::error("sqlite3_prepare_v2 error: {} ({}).", sqlite3_errmsg(db), sql);
+            return false;
+        }
+        return true;
+    }
+};
+
+void bind_text(sqlite3_stmt *stmt, int index, const string &text)
+{
+    sqlite3_bind_text(stmt, index, text.data(), static_cast<int>(text.size()), SQLITE_STATIC);
+}
+
+bool table_exists(sqlite3 *db, const string &table)
+{
+    Statement stmt;
+    if (!stmt.prepare(db, "select 1 from sqlite_master where type = 'table' and name = ?1;"))
+    {
+        return false;
+    }
+    bind_text(stmt.stmt, 1, table);
+    return sqlite3_step(stmt.stmt) == SQLITE_ROW;
+}
+
+double elapsed_ms(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+double LexiconImporter::Stats::rows_per_second() const
+{
+    const double rows = static_cast<double>(inserted + updated + unchanged);
+    const double seconds = (parse_ms + write_ms) / 1000.0;
+    return seconds > 0 ? rows / seconds : 0;
+}
+
+LexiconImporter::LexiconImporter(sqlite3 *db, DictionarySchema::Layout layout, UserLexicon &lexicon)
+    : db_(db), layout_(layout), lexicon_(lexicon)
+{
+    /* 音节只有几百个，先全部换算好，解析线程只读这张表 */
+    const auto tables = PinyinUtil::tables();
+    for (size_t id = 0; id < tables->syllables.size(); ++id)
+    {
+        const string &syllable = tables->syllables.spelling(static_cast<int>(id));
+        string shuangpin = PinyinUtil::convert_complete_pinyin_to_shuangpin(syllable);
+        if (!shuangpin.empty())
+        {
+            shuangpin_of_.emplace(syllable, std::move(shuangpin));
+        }
+    }
+}
+
+bool LexiconImporter::import_files(const vector<string> &paths, Stats &stats)
+{
+    vector<string> contents;
+    contents.reserve(paths.size());
+    for (const auto &path : paths)
+    {
+        ifstream file(path, ios::binary);
+        if (!file.is_open())
+        {
+            spdlog::error("Failed to open lexicon {}.", path);
+            return false;
+        }
+        ostringstream buffer;
+        buffer << file.rdbuf();
+        contents.push_back(buffer.str());
+    }
+    vector<Source> sources;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        sources.push_back(Source{paths[i], contents[i]});
+    }
+    return import_sources(sources, stats);
+}
+
+bool LexiconImporter::import_text(string_view text, Stats &stats)
+{
+    return import_sources({Source{"<text>", text}}, stats);
+}
+
+/**
+ * @brief Parse all sources in parallel, then compare and journal the rows on the calling thread
+ *
+ * @param sources
+ * @param stats
+ * @return bool
+ */
+bool LexiconImporter::import_sources(const vector<Source> &sources, Stats &stats)
+{
+    stats = Stats{};
+    const auto parse_start = chrono::steady_clock::now();
+
+    struct Chunk
+    {
+        size_t source;
+        size_t begin;
+        size_t end;
+        size_t first_line;
+    };
+    const size_t workers = clamp<size_t>(thread::hardware_concurrency(), 1, kMaxWorkers);
+    vector<Chunk> chunks;
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        const string_view text = sources[i].text;
+        const size_t chunk_bytes = max(kMinChunkBytes, text.size() / workers + 1);
+        size_t begin = 0;
+        size_t line = 1;
+        while (begin < text.size())
+        {
+            size_t end = text.find('\n', min(begin + chunk_bytes, text.size() - 1));
+            end = end == string_view::npos ? text.size() : end + 1;
+            chunks.push_back(Chunk{i, begin, end, line});
+            line += static_cast<size_t>(count(text.begin() + begin, text.begin() + end, '\n'));
+            begin = end;
+        }
+    }
+
+    vector<ParseResult> results(chunks.size());
+    atomic<size_t> next{0};
+    vector<future<void>> tasks;
+    for (size_t i = 0; i < min(workers, chunks.size()); ++i)
+    {
+        tasks.push_back(async(launch::async, [&]() {
+            for (size_t chunk = next++; chunk < chunks.size(); chunk = next++)
+            {
+                const Chunk &c = chunks[chunk];
+                results[chunk] = parse_chunk(sources[c.source], c.begin, c.end, c.first_line);
+            }
+        }));
+    }
+    for (auto &task : tasks)
+    {
+        task.get();
+    }
+
+    vector<Row> rows;
+    size_t reported = 0;
+    for (auto &result : results)
+    {
+        stats.lines += result.lines;
+        stats.rejected += result.rejected;
+        for (const auto &reject : result.first_rejects)
+        {
+            if (reported++ < kMaxReportedRejects)
+            {
+                spdlog::warn("Lexicon line rejected, {}.", reject);
+            }
+        }
+        rows.insert(rows.end(), make_move_iterator(result.rows.begin()), make_move_iterator(result.rows.end()));
+        result.rows = vector<Row>();
+    }
+    stats.parse_ms = elapsed_ms(parse_start);
+
+    const auto write_start = chrono::steady_clock::now();
+    const bool ok = write_rows(rows, stats);
+    stats.write_ms = elapsed_ms(write_start);
+    spdlog::info("Lexicon import: {} lines, {} rejected, {} duplicates, {} inserted, {} updated, {} unchanged, "
+                 "{:.0f} rows/s.",
+                 stats.lines, stats.rejected, stats.duplicates, stats.inserted, stats.updated, stats.unchanged,
+                 stats.rows_per_second());
+    return ok;
+}
+
+LexiconImporter::ParseResult LexiconImporter::parse_chunk(const Source &source, size_t begin, size_t end,
+                                                          size_t first_line) const
+{
+    ParseResult result;
+    const string_view text = source.text.substr(begin, end - begin);
+    size_t line_no = first_line;
+    string reason;
+    for (size_t pos = 0; pos < text.size(); ++line_no)
+    {
+        size_t eol = text.find('\n', pos);
+        eol = eol == string_view::npos ? text.size() : eol;
+        string_view line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+        {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        result.lines += 1;
+        Row row;
+        if (parse_line(line, row, reason))
+        {
+            result.rows.push_back(std::move(row));
+            continue;
+        }
+        result.rejected += 1;
+        if (result.first_rejects.size() < kMaxReportedRejects)
+        {
+            result.first_rejects.push_back(fmt::format("{}:{}: {}", source.name, line_no, reason));
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Parse "word pinyin [weight]" into a row with shuangpin key and jianpin
+ *
+ * @param line Without line break
+ * @param row
+ * @param reason Why the line was rejected
+ * @return bool
+ */
+bool LexiconImporter::parse_line(string_view line, Row &row, string &reason) const
+{
+    vector<string_view> fields;
+    const char separator = line.find('\t') != string_view::npos ? '\t' : ' ';
+    for (size_t pos = 0; pos <= line.size();)
+    {
+        size_t next = line.find(separator, pos);
+        next = next == string_view::npos ? line.size() : next;
+        if (next > pos)
+        {
+            fields.push_back(line.substr(pos, next - pos));
+        }
+        pos = next + 1;
+    }
+    if (fields.size() < 2 || fields.size() > 3)
+    {
+        reason = "expected word, pinyin and an optional weight";
+        return false;
+    }
+
+    row.key.clear();
+    size_t syllable_count = 0;
+    for (size_t pos = 0; pos <= fields[1].size(); ++syllable_count)
+    {
+        size_t next = fields[1].find('\'', pos);
+        next = next == string_view::npos ? fields[1].size() : next;
+        string syllable;
+        for (size_t i = pos; i < next; ++i)
+        {
+            const char ch = fields[1][i];
+            if (ch == '\xc3' && i + 1 < next && fields[1][i + 1] == '\xbc') // ü
+            {
+                syllable += 'v';
+                ++i;
+            }
+            else
+            {
+                syllable += static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+            }
+        }
+        auto it = shuangpin_of_.find(syllable);
+        if (it == shuangpin_of_.end())
+        {
+            reason = fmt::format("unknown syllable '{}'", syllable);
+            return false;
+        }
+        row.key += it->second;
+        pos = next + 1;
+    }
+    if (Utf8Utils::count_chars(fields[0]) != syllable_count)
+    {
+        reason = "syllable count does not match the word";
+        return false;
+    }
+
+    row.weight = kDefaultWeight;
+    if (fields.size() == 3)
+    {
+        const auto [ptr, ec] = from_chars(fields[2].data(), fields[2].data() + fields[2].size(), row.weight);
+        if (ec != errc() || ptr != fields[2].data() + fields[2].size() || row.weight < 0)
+        {
+            reason = "weight is not a non-negative integer";
+            return false;
+        }
+    }
+    row.jp.clear();
+    for (size_t i = 0; i < row.key.size(); i += 2)
+    {
+        row.jp += row.key[i];
+    }
+    row.value = string(fields[0]);
+    row.table = table_for(row.key, syllable_count);
+    return true;
+}
+
+/**
+ * @brief Sort by table, drop duplicates, compare table by table and journal the changes at once
+ *
+ * @param rows
+ * @param stats
+ * @return bool
+ */
+bool LexiconImporter::write_rows(vector<Row> &rows, Stats &stats)
+{
+    sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        if (a.table != b.table)
+            return a.table < b.table;
+        if (a.key != b.key)
+            return a.key < b.key;
+        return a.value != b.value ? a.value < b.value : a.weight > b.weight;
+    });
+    /* 同一个词出现多次时保留权重最高的一行 */
+    const auto last = unique(rows.begin(), rows.end(),
+                             [](const Row &a, const Row &b) { return a.key == b.key && a.value == b.value; });
+    stats.duplicates = static_cast<size_t>(rows.end() - last);
+    rows.erase(last, rows.end());
+
+    vector<UserLexicon::Entry> changes;
+    for (auto begin = rows.cbegin(); begin != rows.cend();)
+    {
+        const auto end =
+            find_if(begin, rows.cend(), [&begin](const Row &row) { return row.table != begin->table; });
+        if (!diff_table(begin, end, stats, changes))
+        {
+            return false;
+        }
+        begin = end;
+    }
+    if (changes.empty())
+    {
+        return true;
+    }
+    if (!lexicon_.add_all(changes))
+    {
+        spdlog::error("Failed to journal {} imported words.", changes.size());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compare the rows of one system table, all with the same row.table, with both layers
+ *
+ * Sharded tables have no index, so their existing words are read once into a map. The unified table is clustered
+ * on key, an existence check is a short range read. A user entry decides over the system row, a word the user
+ * deleted is imported again.
+ *
+ * @param begin
+ * @param end
+ * @param stats
+ * @param changes Words to add to the user lexicon
+ * @return bool
+ */
+bool LexiconImporter::diff_table(vector<Row>::const_iterator begin, vector<Row>::const_iterator end, Stats &stats,
+                                 vector<UserLexicon::Entry> &changes) const
+{
+    const bool unified = layout_ == DictionarySchema::Layout::Unified;
+    const string &table = begin->table;
+    Statement lookup;
+    /* key + '\0' + value -> weight */
+    unordered_map<string, int> existing;
+    if (unified)
+    {
+        const string lookup_sql = fmt::format("select max(weight) from {} where key = ?1 and value = ?2;", table);
+        if (!lookup.prepare(db_, lookup_sql))
+        {
+            return false;
+        }
+    }
+    else if (table_exists(db_, table))
+    {
+        Statement scan;
+        if (!scan.prepare(db_, fmt::format("select key, value, weight from {};", table)))
+        {
+            return false;
+        }
+        while (sqlite3_step(scan.stmt) == SQLITE_ROW)
+        {
+            const char *key = reinterpret_cast<const char *>(sqlite3_column_text(scan.stmt, 0));
+            const char *value = reinterpret_cast<const char *>(sqlite3_column_text(scan.stmt, 1));
+            if (!key || !value)
+            {
+                continue;
+            }
+            auto [it, inserted] = existing.try_emplace(string(key) + '\0' + value, sqlite3_column_int(scan.stmt, 2));
+            it->second = max(it->second, sqlite3_column_int(scan.stmt, 2));
+        }
+    }
+
+    for (auto it = begin; it != end; ++it)
+    {
+        const Row &row = *it;
+        bool found = false;
+        int old_weight = 0;
+        if (const UserLexicon::Entry *entry = user_entry(row))
+        {
+            found = !entry->erased;
+            old_weight = entry->weight;
+        }
+        else if (unified)
+        {
+            bind_text(lookup.stmt, 1, row.key);
+            bind_text(lookup.stmt, 2, row.value);
+            if (sqlite3_step(lookup.stmt) == SQLITE_ROW && sqlite3_column_type(lookup.stmt, 0) != SQLITE_NULL)
+            {
+                found = true;
+                old_weight = sqlite3_column_int(lookup.stmt, 0);
+            }
+            sqlite3_reset(lookup.stmt);
+        }
+        else if (auto hit = existing.find(row.key + '\0' + row.value); hit != existing.end())
+        {
+            found = true;
+            old_weight = hit->second;
+        }
+
+        if (found && old_weight >= row.weight)
+        {
+            stats.unchanged += 1;
+            continue;
+        }
+        (found ? stats.updated : stats.inserted) += 1;
+        changes.push_back(UserLexicon::Entry{row.key, row.value, row.weight, false});
+    }
+    return true;
+}
+
+const UserLexicon::Entry *LexiconImporter::user_entry(const Row &row) const
+{
+    const vector<UserLexicon::Entry> *entries = lexicon_.find(row.jp);
+    if (!entries)
+    {
+        return nullptr;
+    }
+    const auto it = find_if(entries->begin(), entries->end(), [&row](const UserLexicon::Entry &entry) {
+        return entry.key == row.key && entry.word == row.value;
+    });
+    return it == entries->end() ? nullptr : &*it;
+}
+
+// Same choice as DictionaryUlPb::choose_tbl
+string LexiconImporter::table_for(string_view key, size_t word_len) const
+{
+    if (layout_ == DictionarySchema::Layout::Unified)
+        return DictionarySchema::kUnifiedTable;
+    if (word_len >= 8)
+        return fmt::format("tbl_others_{}", key[0]);
+    return fmt::format("tbl_{}_{}", word_len, key[0]);
+}
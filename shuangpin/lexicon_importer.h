@@ -0,0 +1,92 @@
+#pragma once
+
+#include "dictionary_schema.h"
+#include "user_lexicon.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+
+/**
+ * @brief Bulk import of word lists into the user lexicon
+ *
+ * Input is UTF-8 text, one word per line, fields separated by tabs or spaces:
+ *
+ *   你好    ni'hao    12000
+ *   女儿    nv'er
+ *
+ * Syllables are quanpin separated by ', the weight defaults to the weight create_word gives new words. Blank lines
+ * and lines starting with # are skipped.
+ *
+ * Files are parsed and validated on several threads. The rows are sorted by system table and compared with the
+ * read-only system layer, one scan per sharded table or one keyed read per row of the unified table, and with the
+ * user lexicon. A word already in either layer under the same key keeps the higher of the two weights, so importing
+ * the same file twice changes nothing. Everything that changes goes into the user lexicon in one journal write, the
+ * system database is never written.
+ */
+class LexiconImporter
+{
+  public:
+    static constexpr int kDefaultWeight = UserLexicon::kDefaultWeight;
+
+    struct Stats
+    {
+        size_t lines = 0;      // Non-blank, non-comment lines
+        size_t rejected = 0;   // Malformed lines, unknown syllables, syllable count not matching the word
+        size_t duplicates = 0; // Same key and word more than once in the input
+        size_t inserted = 0;
+        size_t updated = 0;   // Already in the system or the user layer with a lower weight
+        size_t unchanged = 0; // Already in the system or the user layer with the same or a higher weight
+        double parse_ms = 0;
+        double write_ms = 0;
+
+        double rows_per_second() const;
+    };
+
+    // db is a read-only connection to the system layer, only used to look up the words already there
+    LexiconImporter(sqlite3 *db, DictionarySchema::Layout layout, UserLexicon &lexicon);
+
+    bool import_files(const std::vector<std::string> &paths, Stats &stats);
+    bool import_text(std::string_view text, Stats &stats);
+
+  private:
+    struct Row
+    {
+        std::string table;
+        std::string key;
+        std::string jp;
+        std::string value;
+        int weight;
+    };
+
+    struct Source
+    {
+        std::string name;
+        std::string_view text;
+    };
+
+    struct ParseResult
+    {
+        std::vector<Row> rows;
+        size_t lines = 0;
+        size_t rejected = 0;
+        std::vector<std::string> first_rejects; // "file:line: reason"
+    };
+
+    bool import_sources(const std::vector<Source> &sources, Stats &stats);
+    ParseResult parse_chunk(const Source &source, size_t begin, size_t end, size_t first_line) const;
+    bool parse_line(std::string_view line, Row &row, std::string &reason) const;
+    bool write_rows(std::vector<Row> &rows, Stats &stats);
+    bool diff_table(std::vector<Row>::const_iterator begin, std::vector<Row>::const_iterator end, Stats &stats,
+                    std::vector<UserLexicon::Entry> &changes) const;
+    const UserLexicon::Entry *user_entry(const Row &row) const;
+    std::string table_for(std::string_view key, size_t word_len) const;
+
+  private:
+    sqlite3 *db_;
+    DictionarySchema::Layout layout_;
+    UserLexicon &lexicon_;
+    std::unordered_map<std::string, std::string> shuangpin_of_; // quanpin syllable -> shuangpin, read by all workers
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Shuangpin key sequence packed into a single 64-bit integer
+ *
+ * Layout: bits [63:60] hold the length, bits [59:0] hold up to 12 keys at 5 bits each, first key in the highest
+ * bits. 'a' ~ 'z' map to 1 ~ 26 and the segmentation delimiter ' maps to 27, so both raw sequences and segmented
+ * sequences can be packed. Because keys are left-aligned, numeric order equals lexicographic order.
+ *
+ * Input that does not fit (longer than 12 keys, uppercase helpcodes, other chars) falls back to an overflow form
+ * that keeps the original string, hashing and comparison then go through the string.
+ */
+class PackedKey
+{
+  public:
+    static constexpr size_t kMaxPackedLen = 12;
+    static constexpr uint64_t kBitsPerKey = 5;
+
+    PackedKey() = default;
+    explicit PackedKey(std::string_view keys)
+    {
+        if (keys.size() > kMaxPackedLen)
+        {
+            set_overflow(keys);
+            return;
+        }
+        uint64_t bits = 0;
+        for (size_t i = 0; i < kMaxPackedLen; ++i)
+        {
+            uint64_t code = 0;
+            if (i < keys.size())
+            {
+                code = encode(keys[i]);
+                if (code == 0)
+                {
+                    set_overflow(keys);
+                    return;
+                }
+            }
+            bits = (bits << kBitsPerKey) | code;
+        }
+        bits_ = (static_cast<uint64_t>(keys.size()) << kLenShift) | bits;
+    }
+
+    bool is_packed() const
+    {
+        return (bits_ >> kLenShift) != kOverflowLen;
+    }
+
+    size_t size() const
+    {
+        return is_packed() ? static_cast<size_t>(bits_ >> kLenShift) : overflow_.size();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    uint64_t bits() const
+    {
+        return bits_;
+    }
+
+    /**
+     * @brief First len keys, a mask operation for packed keys
+     */
+    PackedKey prefix(size_t len) const
+    {
+        if (len >= size())
+        {
+            return *this;
+        }
+        if (!is_packed())
+        {
+            return PackedKey(std::string_view(overflow_).substr(0, len));
+        }
+        PackedKey res;
+        const uint64_t keep = kPayloadMask & ~((uint64_t{1} << (kBitsPerKey * (kMaxPackedLen - len))) - 1);
+        res.bits_ = (static_cast<uint64_t>(len) << kLenShift) | (bits_ & keep);
+        return res;
+    }
+
+    bool starts_with(const PackedKey &other) const
+    {
+        return other.size() <= size() && prefix(other.size()) == other;
+    }
+
+    char at(size_t index) const
+    {
+        if (!is_packed())
+        {
+            return overflow_[index];
+        }
+        return decode((bits_ >> (kBitsPerKey * (kMaxPackedLen - 1 - index))) & 0x1f);
+    }
+
+    std::string to_string() const
+    {
+        if (!is_packed())
+        {
+            return overflow_;
+        }
+        std::string res;
+        res.reserve(size());
+        for (size_t i = 0; i < size(); ++i)
+        {
+            res.push_back(at(i));
+        }
+        return res;
+    }
+
+    size_t hash() const
+    {
+        if (!is_packed())
+        {
+            return std::hash<std::string>{}(overflow_);
+        }
+        // splitmix64 finalizer
+        uint64_t x = bits_;
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return static_cast<size_t>(x);
+    }
+
+    bool operator==(const PackedKey &other) const
+    {
+        return bits_ == other.bits_ && (is_packed() || overflow_ == other.overflow_);
+    }
+
+    bool operator!=(const PackedKey &other) const
+    {
+        return !(*this == other);
+    }
+
+    bool operator<(const PackedKey &other) const
+    {
+        if (is_packed() && other.is_packed())
+        {
+            return (bits_ & kPayloadMask) != (other.bits_ & kPayloadMask)
+                       ? (bits_ & kPayloadMask) < (other.bits_ & kPayloadMask)
+                       : bits_ < other.bits_;
+        }
+        return to_string() < other.to_string();
+    }
+
+  private:
+    static constexpr uint64_t kLenShift = 60;
+    static constexpr uint64_t kOverflowLen = 15;
+    static constexpr uint64_t kPayloadMask = (uint64_t{1} << kLenShift) - 1;
+
+    static uint64_t encode(char ch)
+    {
+        if (ch >= 'a' && ch <= 'z')
+            return static_cast<uint64_t>(ch - 'a' + 1);
+        if (ch == '\'')
+            return 27;
+        return 0;
+    }
+
+    static char decode(uint64_t code)
+    {
+        if (code >= 1 && code <= 26)
+            return static_cast<char>('a' + code - 1);
+        if (code == 27)
+            return '\'';
+        return 0;
+    }
+
+    void set_overflow(std::string_view keys)
+    {
+        bits_ = kOverflowLen << kLenShift;
+        overflow_.assign(keys.data(), keys.size());
+    }
+
+  private:
+    uint64_t bits_ = 0;
+    std::string overflow_; // Only used by the overflow form
+};
+
+namespace std
+{
+template <> struct hash<PackedKey>
+{
+    size_t operator()(const PackedKey &key) const
+    {
+        return key.hash();
+    }
+};
+} // namespace std
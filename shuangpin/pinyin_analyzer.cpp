@@ -0,0 +1,141 @@
+#include "pinyin_analyzer.h"
+#include "pinyin_utils.h"
+
+using namespace std;
+
+void PinyinAnalyzer::reset()
+{
+    analysis_ = PinyinAnalysis{};
+    incomplete_count_ = 0;
+    update_helpcode_mode();
+}
+
+/**
+ * @brief Append a key, a-z or A-Z
+ *
+ * The last syllable has one key only because the sequence ended there, so the new key either completes it or
+ * starts a new syllable, exactly as PinyinUtil::pinyin_segmentation would decide.
+ *
+ * @param key
+ */
+void PinyinAnalyzer::push(char key)
+{
+    const char lower = (key >= 'A' && key <= 'Z') ? static_cast<char>(key + ('a' - 'A')) : key;
+    auto &syllables = analysis_.syllables;
+    const uint16_t pos = static_cast<uint16_t>(analysis_.pinyin.size());
+    if (!syllables.empty() && syllables.back().length == 1 &&
+        PinyinUtil::tables()->syllables.shuangpin_id(analysis_.pinyin.back(), lower) != SyllableTable::kInvalid)
+    {
+        syllables.back().length = 2;
+        incomplete_count_ -= 1;
+    }
+    else
+    {
+        syllables.push_back(SyllableSpan{pos, 1});
+        incomplete_count_ += 1;
+    }
+    analysis_.pinyin += lower;
+    analysis_.pinyin_with_cases += key;
+    update_helpcode_mode();
+}
+
+void PinyinAnalyzer::pop()
+{
+    if (analysis_.pinyin.empty())
+    {
+        return;
+    }
+    auto &syllables = analysis_.syllables;
+    if (syllables.back().length == 2)
+    {
+        syllables.back().length = 1;
+        incomplete_count_ += 1;
+    }
+    else
+    {
+        syllables.pop_back();
+        incomplete_count_ -= 1;
+    }
+    analysis_.pinyin.pop_back();
+    analysis_.pinyin_with_cases.pop_back();
+    update_helpcode_mode();
+}
+
+void PinyinAnalyzer::assign(string_view pinyin_with_cases)
+{
+    const string &current = analysis_.pinyin_with_cases;
+    size_t common = 0;
+    while (common < current.size() && common < pinyin_with_cases.size() && current[common] == pinyin_with_cases[common])
+    {
+        ++common;
+    }
+    while (current.size() > common)
+    {
+        pop();
+    }
+    for (size_t i = common; i < pinyin_with_cases.size(); ++i)
+    {
+        push(pinyin_with_cases[i]);
+    }
+}
+
+void PinyinAnalyzer::adopt(const PinyinAnalysis &analysis)
+{
+    analysis_ = analysis;
+    incomplete_count_ = 0;
+    for (const auto &span : analysis_.syllables)
+    {
+        incomplete_count_ += span.complete() ? 0 : 1;
+    }
+}
+
+/**
+ * @brief Same rules as handleVkCode used to apply with PinyinUtil::IsFullHelpMode and is_all_complete_pinyin
+ *
+ * The pure part is a prefix of the sequence, its segmentation is the one of the sequence cut at helpcode_pos, a
+ * syllable crossing the cut keeps only its initial.
+ */
+void PinyinAnalyzer::update_helpcode_mode()
+{
+    const size_t n = analysis_.pinyin.size();
+    const auto &syllables = analysis_.syllables;
+    analysis_.all_complete = n % 2 == 0 && incomplete_count_ == 0;
+    analysis_.helpcode_mode = HelpcodeMode::None;
+    analysis_.helpcode_pos = n;
+
+    size_t candidate_pos = n;
+    HelpcodeMode candidate_mode = HelpcodeMode::None;
+    if (n >= 4 && n % 2 == 0 && analysis_.upper_case(n - 1))
+    {
+        candidate_pos = n - 2;
+        candidate_mode = HelpcodeMode::Full;
+    }
+    else if (n > 1 && n % 2 == 1)
+    {
+        candidate_pos = n - 1;
+        candidate_mode = HelpcodeMode::Single;
+    }
+
+    /* 切掉辅助码之后剩下的前缀是否都是完整的双拼 */
+    size_t kept = syllables.size();
+    size_t kept_incomplete = incomplete_count_;
+    while (kept > 0 && syllables[kept - 1].begin >= candidate_pos)
+    {
+        kept -= 1;
+        kept_incomplete -= syllables[kept].complete() ? 0 : 1;
+    }
+    const bool crossing = kept > 0 && syllables[kept - 1].begin + syllables[kept - 1].length > candidate_pos;
+    const bool prefix_complete = candidate_pos % 2 == 0 && kept_incomplete == 0 && !crossing;
+    if (candidate_mode != HelpcodeMode::None && prefix_complete)
+    {
+        analysis_.helpcode_mode = candidate_mode;
+        analysis_.helpcode_pos = candidate_pos;
+        analysis_.pure_syllables.assign(syllables.begin(), syllables.begin() + kept);
+        analysis_.pure_all_complete = true;
+    }
+    else
+    {
+        analysis_.pure_syllables = syllables;
+        analysis_.pure_all_complete = analysis_.all_complete;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../core/pinyin_analysis.h"
+#include <string_view>
+
+/**
+ * @brief Keeps the PinyinAnalysis of a key sequence up to date one key at a time
+ *
+ * Forward greedy segmentation only ever changes its last syllable when a key is appended or removed, so push and
+ * pop touch the last span and recompute the helpcode mode from flags instead of segmenting the sequence again.
+ */
+class PinyinAnalyzer
+{
+  public:
+    void reset();
+    void push(char key);
+    void pop();
+    // Keep the common prefix with the current sequence and push only the rest
+    void assign(std::string_view pinyin_with_cases);
+    // Take over an analysis computed elsewhere, e.g. by the scheme
+    void adopt(const PinyinAnalysis &analysis);
+
+    const PinyinAnalysis &analysis() const
+    {
+        return analysis_;
+    }
+
+  private:
+    void update_helpcode_mode();
+
+    PinyinAnalysis analysis_;
+    size_t incomplete_count_ = 0; // Syllables of one key
+};
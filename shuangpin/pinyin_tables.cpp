@@ -0,0 +1,300 @@
+#include "pinyin_tables.h"
+#include "utf8_utils.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+/**
+ * @brief Read the whole file in one go, lines are parsed in place afterwards
+ *
+ * @param path
+ * @param content
+ * @return bool Whether the file could be opened
+ */
+bool read_file(const std::string &path, std::string &content)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    const auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    content.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    if (!content.empty())
+    {
+        file.read(content.data(), content.size());
+    }
+    return true;
+}
+
+template <typename Fn> void for_each_line(std::string_view content, Fn &&fn)
+{
+    while (!content.empty())
+    {
+        size_t pos = content.find('\n');
+        std::string_view line = content.substr(0, pos);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        fn(line);
+        if (pos == std::string_view::npos)
+        {
+            break;
+        }
+        content.remove_prefix(pos + 1);
+    }
+}
+
+char32_t decode_single(std::string_view han_char, bool &ok)
+{
+    ok = false;
+    if (han_char.empty())
+    {
+        return 0;
+    }
+    size_t size = 0;
+    char32_t codepoint = Utf8Utils::decode(han_char, size);
+    ok = size == han_char.size() && codepoint != 0xfffd;
+    return codepoint;
+}
+} // namespace
+
+HelpcodeTable::HelpcodeTable() : directory_(kMaxCodepoint >> kPageBits, kNoPage)
+{
+}
+
+/**
+ * @brief Load helpcode.txt, each line looks like `字=ab`
+ *
+ * @param path
+ * @return bool
+ */
+bool HelpcodeTable::load(const std::string &path)
+{
+    std::string content;
+    if (!read_file(path, content))
+    {
+        return false;
+    }
+    for_each_line(content, [this](std::string_view line) {
+        size_t pos = line.find('=');
+        if (pos == std::string_view::npos)
+        {
+            return;
+        }
+        bool ok = false;
+        char32_t codepoint = decode_single(line.substr(0, pos), ok);
+        if (ok)
+        {
+            set(codepoint, line.substr(pos + 1, 2));
+        }
+    });
+    return true;
+}
+
+void HelpcodeTable::set(char32_t codepoint, std::string_view helpcode)
+{
+    if (codepoint >= kMaxCodepoint || helpcode.empty())
+    {
+        return;
+    }
+    uint16_t &page = directory_[codepoint >> kPageBits];
+    if (page == kNoPage)
+    {
+        page = static_cast<uint16_t>(pages_.size() / kPageSize);
+        pages_.resize(pages_.size() + kPageSize, Entry{0, 0});
+    }
+    Entry &entry = pages_[static_cast<size_t>(page) * kPageSize + (codepoint & (kPageSize - 1))];
+    if (entry[0] == 0)
+    {
+        size_ += 1;
+    }
+    entry[0] = helpcode[0];
+    entry[1] = helpcode.size() > 1 ? helpcode[1] : 0;
+}
+
+std::string_view HelpcodeTable::find(char32_t codepoint) const
+{
+    if (codepoint >= kMaxCodepoint)
+    {
+        return {};
+    }
+    const uint16_t page = directory_[codepoint >> kPageBits];
+    if (page == kNoPage)
+    {
+        return {};
+    }
+    const Entry &entry = pages_[static_cast<size_t>(page) * kPageSize + (codepoint & (kPageSize - 1))];
+    if (entry[0] == 0)
+    {
+        return {};
+    }
+    return std::string_view(entry.data(), entry[1] ? 2 : 1);
+}
+
+std::string_view HelpcodeTable::find(std::string_view han_char) const
+{
+    bool ok = false;
+    char32_t codepoint = decode_single(han_char, ok);
+    if (!ok)
+    {
+        return {};
+    }
+    return find(codepoint);
+}
+
+size_t HelpcodeTable::size() const
+{
+    return size_;
+}
+
+size_t HelpcodeTable::memory_usage() const
+{
+    return directory_.capacity() * sizeof(uint16_t) + pages_.capacity() * sizeof(Entry);
+}
+
+SyllableTable::SyllableTable()
+{
+    shuangpin_ids_.fill(kInvalid);
+}
+
+/**
+ * @brief Load pinyin.txt, one syllable per line
+ *
+ * @param path
+ * @return bool
+ */
+bool SyllableTable::load(const std::string &path)
+{
+    std::string content;
+    if (!read_file(path, content))
+    {
+        return false;
+    }
+    for_each_line(content, [this](std::string_view line) {
+        std::string syllable;
+        std::copy_if(line.begin(), line.end(), std::back_inserter(syllable),
+                     [](unsigned char x) { return !std::isspace(x); });
+        insert(syllable);
+    });
+    return true;
+}
+
+void SyllableTable::insert(std::string_view syllable)
+{
+    uint32_t packed = pack(syllable);
+    if (packed == 0)
+    {
+        return;
+    }
+    auto it = std::lower_bound(packed_.begin(), packed_.end(), packed);
+    if (it != packed_.end() && *it == packed)
+    {
+        return;
+    }
+    spellings_.insert(spellings_.begin() + (it - packed_.begin()), std::string(syllable));
+    packed_.insert(it, packed);
+}
+
+bool SyllableTable::contains(std::string_view syllable) const
+{
+    return id_of(syllable) != kInvalid;
+}
+
+int SyllableTable::id_of(std::string_view syllable) const
+{
+    uint32_t packed = pack(syllable);
+    if (packed == 0)
+    {
+        return kInvalid;
+    }
+    auto it = std::lower_bound(packed_.begin(), packed_.end(), packed);
+    if (it == packed_.end() || *it != packed)
+    {
+        return kInvalid;
+    }
+    return static_cast<int>(it - packed_.begin());
+}
+
+const std::string &SyllableTable::spelling(int id) const
+{
+    static const std::string empty;
+    if (id < 0 || static_cast<size_t>(id) >= spellings_.size())
+    {
+        return empty;
+    }
+    return spellings_[id];
+}
+
+void SyllableTable::set_shuangpin(char first, char second, int id)
+{
+    if (first < 'a' || first > 'z' || second < 'a' || second > 'z')
+    {
+        return;
+    }
+    shuangpin_ids_[(first - 'a') * 26 + (second - 'a')] = static_cast<int16_t>(id);
+}
+
+int SyllableTable::shuangpin_id(char first, char second) const
+{
+    if (first < 'a' || first > 'z' || second < 'a' || second > 'z')
+    {
+        return kInvalid;
+    }
+    return shuangpin_ids_[(first - 'a') * 26 + (second - 'a')];
+}
+
+size_t SyllableTable::size() const
+{
+    return packed_.size();
+}
+
+bool SyllableTable::empty() const
+{
+    return packed_.empty();
+}
+
+size_t SyllableTable::memory_usage() const
+{
+    size_t total = packed_.capacity() * sizeof(uint32_t) + sizeof(shuangpin_ids_);
+    for (const auto &each : spellings_)
+    {
+        total += sizeof(std::string) + (each.size() > 15 ? each.capacity() : 0);
+    }
+    return total;
+}
+
+/**
+ * @brief Pack a lowercase syllable into 5 bits per letter, left-aligned
+ *
+ * @param syllable
+ * @return uint32_t 0 if the syllable is empty, too long or contains non-lowercase letters
+ */
+uint32_t SyllableTable::pack(std::string_view syllable)
+{
+    if (syllable.empty() || syllable.size() > kMaxSyllableLen)
+    {
+        return 0;
+    }
+    uint32_t packed = 0;
+    for (size_t i = 0; i < kMaxSyllableLen; ++i)
+    {
+        uint32_t code = 0;
+        if (i < syllable.size())
+        {
+            if (syllable[i] < 'a' || syllable[i] > 'z')
+            {
+                return 0;
+            }
+            code = static_cast<uint32_t>(syllable[i] - 'a' + 1);
+        }
+        packed = (packed << 5) | code;
+    }
+    return packed;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Helpcodes indexed by codepoint
+ *
+ * Two-level table: the directory maps (codepoint >> 8) to a 256-entry page, each entry holds the two helpcode
+ * letters of one character (2 bytes per character). Only pages that contain at least one character are allocated,
+ * for the CJK blocks that is a few hundred KB, and a lookup touches one directory slot and one page entry.
+ */
+class HelpcodeTable
+{
+  public:
+    HelpcodeTable();
+
+    bool load(const std::string &path);
+    void set(char32_t codepoint, std::string_view helpcode);
+    std::string_view find(char32_t codepoint) const;
+    std::string_view find(std::string_view han_char) const;
+
+    size_t size() const;
+    size_t memory_usage() const;
+
+  private:
+    using Entry = std::array<char, 2>;
+    static constexpr uint32_t kPageBits = 8;
+    static constexpr uint32_t kPageSize = 1u << kPageBits;
+    static constexpr uint32_t kMaxCodepoint = 0x110000;
+    static constexpr uint16_t kNoPage = 0xffff;
+
+    std::vector<uint16_t> directory_; // codepoint >> kPageBits -> page number
+    std::vector<Entry> pages_;        // kPageSize entries per page
+    size_t size_ = 0;
+};
+
+/**
+ * @brief Quanpin syllables keyed by a packed id
+ *
+ * Each syllable (at most 6 letters) is packed left-aligned into 5 bits per letter, so numeric order equals
+ * lexicographic order and membership is a binary search over ~400 integers. On top of that, every lowercase
+ * two-key shuangpin code is resolved to its syllable once at load time, which turns the segmentation check into a
+ * single array read.
+ */
+class SyllableTable
+{
+  public:
+    static constexpr int kInvalid = -1;
+
+    SyllableTable();
+
+    bool load(const std::string &path);
+    void insert(std::string_view syllable);
+
+    bool contains(std::string_view syllable) const;
+    int id_of(std::string_view syllable) const;
+    const std::string &spelling(int id) const;
+
+    void set_shuangpin(char first, char second, int id);
+    int shuangpin_id(char first, char second) const;
+
+    size_t size() const;
+    bool empty() const;
+    size_t memory_usage() const;
+
+    static uint32_t pack(std::string_view syllable);
+
+  private:
+    static constexpr size_t kMaxSyllableLen = 6;
+
+    std::vector<uint32_t> packed_;      // Sorted
+    std::vector<std::string> spellings_; // Parallel to packed_
+    std::array<int16_t, 26 * 26> shuangpin_ids_;
+};
+
+/**
+ * @brief The syllable and helpcode tables loaded together, published as one immutable unit
+ */
+struct PinyinTables
+{
+    SyllableTable syllables;
+    HelpcodeTable helpcodes;
+};
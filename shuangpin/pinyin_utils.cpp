@@ -1,9 +1,9 @@
-#include <utf8.h>
 #include <spdlog/spdlog.h>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 #include "pinyin_utils.h"
+#include "utf8_utils.h"
 
 using namespace std;
 
@@ -15,27 +15,29 @@ static string helpcode_file_name = "helpcode.txt";
 /**
  * @brief Get the local app data path from environment variable LOCALAPPDATA
  *
+ * Read once on first use instead of during static initialization.
+ *
  * @return string The path of local app data directory
  */
 string PinyinUtil::get_local_appdata_path()
 {
-    char *localAppDataDir = nullptr;
-    std::string localAppDataDirStr;
+    static const string local_appdata_path = []() {
+        char *localAppDataDir = nullptr;
+        std::string localAppDataDirStr;
 
-    errno_t err = _dupenv_s(&localAppDataDir, nullptr, "LOCALAPPDATA");
-    if (err == 0 && localAppDataDir != nullptr)
-    {
-        localAppDataDirStr = std::string(localAppDataDir);
-    }
+        errno_t err = _dupenv_s(&localAppDataDir, nullptr, "LOCALAPPDATA");
+        if (err == 0 && localAppDataDir != nullptr)
+        {
+            localAppDataDirStr = std::string(localAppDataDir);
+        }
 
-    std::unique_ptr<char, decltype(&free)> dirPtr(localAppDataDir, free);
+        std::unique_ptr<char, decltype(&free)> dirPtr(localAppDataDir, free);
 
-    return localAppDataDirStr.empty() ? "" : localAppDataDirStr;
+        return localAppDataDirStr;
+    }();
+    return local_appdata_path;
 }
 
-// LocalAppData path
-string PinyinUtil::local_appdata_path = PinyinUtil::get_local_appdata_path();
-
 unordered_map<string, string> PinyinUtil::sm_keymaps{
     {"sh", "u"}, //
     {"ch", "i"}, //
@@ -142,71 +144,18 @@ unordered_map<string, string> PinyinUtil::ym_keymaps_reversed{
     {"m", "ian"}   //
 };
 
-unordered_set<string> &initialize_quanpin_set()
-{
-    static unordered_set<string> tmp_set;
-    ifstream pinyin_path(PinyinUtil::get_local_appdata_path() //
-                         + path_seperator                     //
-                         + PinyinUtil::app_name               //
-                         + path_seperator                     //
-                         + pinyin_file_name                   //
-    );
-    if (!pinyin_path.is_open())
-    {
-        spdlog::error("Failed to open pinyin.txt file. Please make sure file exists.");
-    }
-    string line;
-    while (getline(pinyin_path, line))
-    {
-        line.erase(remove_if(line.begin(), line.end(), [](unsigned char x) { return isspace(x); }), line.end());
-        tmp_set.insert(line);
-    }
-    return tmp_set;
-}
-
-unordered_set<string> &PinyinUtil::quanpin_set = initialize_quanpin_set();
-
-unordered_map<string, string> &initialize_helpcode_keymap()
-{
-    static unordered_map<string, string> tmp_map;
-    ifstream helpcode_path(PinyinUtil::get_local_appdata_path() //
-                           + path_seperator                     //
-                           + PinyinUtil::app_name               //
-                           + path_seperator                     //
-                           + helpcode_file_name                 //
-    );
-    if (!helpcode_path.is_open())
-    {
-        spdlog::error("Failed to open pinyin.txt file. Please make sure file exists.");
-    }
-    string line;
-    while (getline(helpcode_path, line))
-    {
-        size_t pos = line.find('=');
-        tmp_map[line.substr(0, pos)] = line.substr(pos + 1, 2);
-    }
-    return tmp_map;
-}
-unordered_map<string, string> &PinyinUtil::helpcode_keymap = initialize_helpcode_keymap();
-
-/*
-
-
-*/
-
 /**
- * @brief Convert Xiaohe shuangpin to Quanpin
- *
- * Currently support 402 pinyin
+ * @brief Slow path of shuangpin to quanpin conversion, only used to fill the syllable table at load time
  *
- * @param sp_str Shuangpin string
+ * @param sp_str Lowercase shuangpin
+ * @param syllables Loaded quanpin syllables
  * @return string Quanpin string
  */
-string PinyinUtil::cvt_single_sp_to_pinyin(string sp_str)
+static string resolve_single_sp_to_pinyin(const string &sp_str, const SyllableTable &syllables)
 {
-    if (zero_sm_keymaps_reversed.count(sp_str) > 0)
+    if (PinyinUtil::zero_sm_keymaps_reversed.count(sp_str) > 0)
     {
-        return zero_sm_keymaps_reversed[sp_str];
+        return PinyinUtil::zero_sm_keymaps_reversed[sp_str];
     }
     if (sp_str.size() != 2)
         return "";
@@ -214,16 +163,16 @@ string PinyinUtil::cvt_single_sp_to_pinyin(string sp_str)
     string sm;
     vector<string> ym_list;
 
-    if (sm_keymaps_reversed.count(sp_str.substr(0, 1)) > 0)
+    if (PinyinUtil::sm_keymaps_reversed.count(sp_str.substr(0, 1)) > 0)
     {
-        sm = sm_keymaps_reversed[sp_str.substr(0, 1)];
+        sm = PinyinUtil::sm_keymaps_reversed[sp_str.substr(0, 1)];
     }
     else
     {
         sm = sp_str.substr(0, 1);
     }
 
-    for (const auto &pair : ym_keymaps)
+    for (const auto &pair : PinyinUtil::ym_keymaps)
     {
         if (pair.second == sp_str.substr(1, 1))
         {
@@ -236,7 +185,7 @@ string PinyinUtil::cvt_single_sp_to_pinyin(string sp_str)
     }
     for (const auto &ym : ym_list)
     {
-        if (quanpin_set.count(sm + ym) > 0)
+        if (syllables.contains(sm + ym))
         {
             res = sm + ym;
         }
@@ -244,51 +193,120 @@ string PinyinUtil::cvt_single_sp_to_pinyin(string sp_str)
     return res;
 }
 
+/**
+ * @brief Load pinyin.txt and helpcode.txt into a new set of tables
+ *
+ * @return shared_ptr<const PinyinTables>
+ */
+shared_ptr<const PinyinTables> PinyinUtil::load_tables()
+{
+    auto tables = make_shared<PinyinTables>();
+    string pinyin_path = PinyinUtil::get_local_appdata_path() //
+                         + path_seperator                     //
+                         + PinyinUtil::app_name               //
+                         + path_seperator                     //
+                         + pinyin_file_name;                  //
+    if (!tables->syllables.load(pinyin_path))
+    {
+        spdlog::error("Failed to open pinyin.txt file. Please make sure file exists.");
+    }
+    /* Resolve every two-key shuangpin code once, segmentation then only reads the table */
+    for (char first = 'a'; first <= 'z'; ++first)
+    {
+        for (char second = 'a'; second <= 'z'; ++second)
+        {
+            string quanpin = resolve_single_sp_to_pinyin(string{first, second}, tables->syllables);
+            tables->syllables.set_shuangpin(first, second, tables->syllables.id_of(quanpin));
+        }
+    }
+
+    string helpcode_path = PinyinUtil::get_local_appdata_path() //
+                           + path_seperator                     //
+                           + PinyinUtil::app_name               //
+                           + path_seperator                     //
+                           + helpcode_file_name;                //
+    if (!tables->helpcodes.load(helpcode_path))
+    {
+        spdlog::error("Failed to open helpcode.txt file. Please make sure file exists.");
+    }
+    return tables;
+}
+
+/* Loaded on first use, replaced as a whole by publish_tables */
+static shared_ptr<const PinyinTables> &current_tables()
+{
+    static shared_ptr<const PinyinTables> tables = PinyinUtil::load_tables();
+    return tables;
+}
+
+shared_ptr<const PinyinTables> PinyinUtil::tables()
+{
+    return atomic_load(&current_tables());
+}
+
+void PinyinUtil::publish_tables(shared_ptr<const PinyinTables> tables)
+{
+    atomic_store(&current_tables(), std::move(tables));
+}
+
+/*
+
+
+*/
+
+/**
+ * @brief Convert Xiaohe shuangpin to Quanpin
+ *
+ * Currently support 402 pinyin
+ *
+ * @param sp_str Shuangpin string
+ * @return string Quanpin string
+ */
+string PinyinUtil::cvt_single_sp_to_pinyin(string sp_str)
+{
+    if (sp_str.size() != 2)
+        return "";
+    const auto tables = PinyinUtil::tables();
+    return tables->syllables.spelling(tables->syllables.shuangpin_id(sp_str[0], sp_str[1]));
+}
+
 /**
  * @brief Split shuangpin, using ' as delimiter, using forward greedy segmentation
  *
  * @param sp_str Shuangpin string
  * @return string Segmented string with '
  */
-string PinyinUtil::pinyin_segmentation(string sp_str)
+string PinyinUtil::pinyin_segmentation(std::string_view sp_str)
 {
     if (sp_str.size() == 1)
     {
-        return sp_str;
+        return string(sp_str);
     }
-    string res("");
+    const auto tables = PinyinUtil::tables();
+    const SyllableTable &syllables = tables->syllables;
+    string res;
+    res.reserve(sp_str.size() * 3 / 2 + 1);
     string::size_type range_start = 0;
     while (range_start < sp_str.size())
     {
-        if ((range_start + 2) <= sp_str.size())
+        if (!res.empty())
         {
-            // Try to cut two chars to test
-            string cur_sp = sp_str.substr(range_start, 2);
-            if (quanpin_set.count(cvt_single_sp_to_pinyin(boost::algorithm::to_lower_copy(cur_sp))) > 0)
-            {
-                res = res + "'" + cur_sp;
-                range_start += 2;
-            }
-            else
-            {
-                res = res + "'" + cur_sp.substr(0, 1);
-                range_start += 1;
-            }
+            res += '\'';
+        }
+        // Try to cut two chars to test
+        if ((range_start + 2) <= sp_str.size() &&
+            syllables.shuangpin_id(static_cast<char>(tolower(sp_str[range_start])),
+                                   static_cast<char>(tolower(sp_str[range_start + 1]))) != SyllableTable::kInvalid)
+        {
+            res.append(sp_str.data() + range_start, 2);
+            range_start += 2;
         }
         else
         {
-            res = res + "'" + sp_str.substr(sp_str.size() - 1, 1);
+            res += sp_str[range_start];
             range_start += 1;
         }
     }
-    while (!res.empty() && res[0] == '\'')
-    {
-        res.erase(0, 1);
-    }
-    while (!res.empty() && res[res.size()] == '\'')
-    {
-        res.erase(res.size() - 1, 1);
-    }
     return res;
 }
 
@@ -296,20 +314,11 @@ string PinyinUtil::pinyin_segmentation(string sp_str)
  * @brief Get the first han char
  *
  * @param words
- * @return std::string
+ * @return std::string_view View into words
  */
-std::string PinyinUtil::get_first_han_char(const std::string &words)
+std::string_view PinyinUtil::get_first_han_char(std::string_view words)
 {
-    auto it = words.begin();
-    auto end = words.end();
-
-    if (it == end)
-        return "";
-
-    auto next = it;
-    utf8::next(next, end);
-
-    return std::string(it, next);
+    return Utf8Utils::first_char(words);
 }
 
 /**
@@ -318,40 +327,20 @@ std::string PinyinUtil::get_first_han_char(const std::string &words)
  * @param words UTF-8 string
  * @return string::size_type Char size
  */
-string::size_type PinyinUtil::get_first_char_size(string words)
+string::size_type PinyinUtil::get_first_char_size(std::string_view words)
 {
-    size_t cplen = 1;
-    // https://en.wikipedia.org/wiki/UTF-8#Description
-    if ((words[0] & 0xf8) == 0xf0)
-        cplen = 4;
-    else if ((words[0] & 0xf0) == 0xe0)
-        cplen = 3;
-    else if ((words[0] & 0xe0) == 0xc0)
-        cplen = 2;
-    if (cplen > words.length())
-        cplen = 1;
-    return cplen;
+    return words.empty() ? 1 : Utf8Utils::first_char_size(words);
 }
 
 /**
  * @brief Get the last han char
  *
  * @param words
- * @return std::string
+ * @return std::string_view View into words
  */
-std::string PinyinUtil::get_last_han_char(const std::string &words)
+std::string_view PinyinUtil::get_last_han_char(std::string_view words)
 {
-    auto it = words.begin();
-    auto end = words.end();
-
-    if (it == end)
-        return "";
-
-    auto rit = words.end();
-    auto prev = rit;
-    utf8::prior(prev, it);
-
-    return std::string(prev, rit);
+    return Utf8Utils::last_char(words);
 }
 
 /**
@@ -360,17 +349,9 @@ std::string PinyinUtil::get_last_han_char(const std::string &words)
  * @param words UTF-8 string
  * @return string::size_type Char size
  */
-string::size_type PinyinUtil::get_last_char_size(string words)
+string::size_type PinyinUtil::get_last_char_size(std::string_view words)
 {
-    size_t prev_index = 0, index = 0, cnt = 0;
-    while (index < words.size())
-    {
-        size_t cplen = get_first_char_size(words.substr(index, words.size() - index));
-        prev_index = index;
-        index += cplen;
-        cnt += 1;
-    }
-    return words.size() - prev_index;
+    return Utf8Utils::last_char_size(words);
 }
 
 /**
@@ -379,16 +360,9 @@ string::size_type PinyinUtil::get_last_char_size(string words)
  * @param words UTF-8 string
  * @return string::size_type Count of hanzi
  */
-string::size_type PinyinUtil::cnt_han_chars(string words)
+string::size_type PinyinUtil::cnt_han_chars(std::string_view words)
 {
-    size_t index = 0, cnt = 0;
-    while (index < words.size())
-    {
-        size_t cplen = get_first_char_size(words.substr(index, words.size() - index));
-        index += cplen;
-        cnt += 1;
-    }
-    return cnt;
+    return Utf8Utils::count_chars(words);
 }
 
 /**
@@ -397,9 +371,9 @@ string::size_type PinyinUtil::cnt_han_chars(string words)
  * @param str
  * @return string::size_type
  */
-string::size_type PinyinUtil::count_utf8_chars(const string &str)
+string::size_type PinyinUtil::count_utf8_chars(std::string_view str)
 {
-    return utf8::distance(str.begin(), str.end());
+    return Utf8Utils::count_chars(str);
 }
 
 /**
@@ -411,34 +385,36 @@ string::size_type PinyinUtil::count_utf8_chars(const string &str)
  * @param words UTF-8 string
  * @return string Helpcodes surrounded by ()
  */
-string PinyinUtil::compute_helpcodes(string words)
+string PinyinUtil::compute_helpcodes(std::string_view words)
 {
+    const auto tables = PinyinUtil::tables();
     string helpcodes("");
     if (cnt_han_chars(words) == 1)
     {
-        if (helpcode_keymap.count(words))
+        auto helpcode = tables->helpcodes.find(words);
+        if (!helpcode.empty())
         {
-            helpcodes += helpcode_keymap[words];
+            helpcodes += helpcode;
             helpcodes[1] = toupper(helpcodes[1]);
         }
     }
     else
     {
         // First
-        string firstHan = get_first_han_char(words);
-        if (helpcode_keymap.count(firstHan))
+        auto first_helpcode = tables->helpcodes.find(get_first_han_char(words));
+        if (!first_helpcode.empty())
         {
-            helpcodes += helpcode_keymap[firstHan].substr(0, 1);
+            helpcodes += first_helpcode[0];
         }
         else
         {
             return "";
         }
         // Second
-        string lastHan = get_last_han_char(words);
-        if (helpcode_keymap.count(lastHan))
+        auto last_helpcode = tables->helpcodes.find(get_last_han_char(words));
+        if (!last_helpcode.empty())
         {
-            helpcodes += helpcode_keymap[lastHan].substr(0, 1);
+            helpcodes += last_helpcode[0];
             helpcodes[1] = toupper(helpcodes[1]);
         }
         else
@@ -459,14 +435,9 @@ string PinyinUtil::compute_helpcodes(string words)
  * @param candidate UTF-8 string
  * @return string Pure hanzi string
  */
-string PinyinUtil::extract_preview(string candidate)
+string PinyinUtil::extract_preview(std::string_view candidate)
 {
-    size_t start_pos = candidate.find('(');
-    if (start_pos != string::npos)
-    {
-        return candidate.substr(0, start_pos);
-    }
-    return candidate;
+    return string(candidate.substr(0, candidate.find('(')));
 }
 
 /**
@@ -524,6 +495,36 @@ string PinyinUtil::convert_seg_shuangpin_to_seg_complete_pinyin(string seg_shang
     return res.substr(0, res.size() - 1);
 }
 
+/**
+ * @brief Convert one quanpin syllable to its two-key shuangpin code
+ *
+ * Found by searching the codes the syllable table resolved at load time, so the result always segments back to the
+ * same syllable.
+ *
+ * @param syllable Lowercase quanpin, ü written as v
+ * @return string Empty if syllable is not a known syllable
+ */
+string PinyinUtil::convert_complete_pinyin_to_shuangpin(string_view syllable)
+{
+    const auto tables = PinyinUtil::tables();
+    const int id = tables->syllables.id_of(syllable);
+    if (id == SyllableTable::kInvalid)
+    {
+        return "";
+    }
+    for (char first = 'a'; first <= 'z'; ++first)
+    {
+        for (char second = 'a'; second <= 'z'; ++second)
+        {
+            if (tables->syllables.shuangpin_id(first, second) == id)
+            {
+                return string{first, second};
+            }
+        }
+    }
+    return "";
+}
+
 /**
  * @brief 判断是否是全码辅助
  *
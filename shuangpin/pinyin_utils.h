@@ -1,7 +1,10 @@
 #pragma once
 
+#include "pinyin_tables.h"
+#include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <fstream>
 #include <algorithm>
@@ -12,7 +15,6 @@ class PinyinUtil
 {
   public:
     static std::string get_local_appdata_path();
-    static std::string local_appdata_path;
     static const std::string app_name;
 
     static std::unordered_map<std::string, std::string> sm_keymaps;
@@ -21,21 +23,25 @@ class PinyinUtil
     static std::unordered_map<std::string, std::string> zero_sm_keymaps_reversed;
     static std::unordered_map<std::string, std::string> ym_keymaps;
     static std::unordered_map<std::string, std::string> ym_keymaps_reversed;
-    static std::unordered_set<std::string> &quanpin_set;
-    static std::unordered_map<std::string, std::string> &helpcode_keymap;
+
+    // Tables currently in use, callers keep the pointer for the duration of one operation
+    static std::shared_ptr<const PinyinTables> tables();
+    static std::shared_ptr<const PinyinTables> load_tables();
+    static void publish_tables(std::shared_ptr<const PinyinTables> tables);
 
     static std::string cvt_single_sp_to_pinyin(std::string sp_str);
-    static std::string pinyin_segmentation(std::string sp_str);
-    static std::string get_first_han_char(const std::string &words);
-    static std::string::size_type get_first_char_size(std::string words);
-    static std::string get_last_han_char(const std::string &words);
-    static std::string::size_type get_last_char_size(std::string words);
-    static std::string::size_type cnt_han_chars(std::string words);
-    static std::string::size_type PinyinUtil::count_utf8_chars(const std::string &str);
-    static std::string compute_helpcodes(std::string words);
-    static std::string extract_preview(std::string candidate);
+    static std::string pinyin_segmentation(std::string_view sp_str);
+    static std::string_view get_first_han_char(std::string_view words);
+    static std::string::size_type get_first_char_size(std::string_view words);
+    static std::string_view get_last_han_char(std::string_view words);
+    static std::string::size_type get_last_char_size(std::string_view words);
+    static std::string::size_type cnt_han_chars(std::string_view words);
+    static std::string::size_type count_utf8_chars(std::string_view str);
+    static std::string compute_helpcodes(std::string_view words);
+    static std::string extract_preview(std::string_view candidate);
     static bool is_all_complete_pinyin(std::string pure_pinyin, std::string seg_pinyin);
     static std::string convert_seg_shuangpin_to_seg_complete_pinyin(std::string seg_shangpin);
+    static std::string convert_complete_pinyin_to_shuangpin(std::string_view syllable);
 
     static bool IsFullHelpMode(std::string pinyin);
 };
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "sentence_stream.h"
+#include "pinyin_utils.h"
+#include "utf8_utils.h"
+
+using namespace std;
+
+SentenceStream::SentenceStream(Decoder decoder) : decoder_(std::move(decoder))
+{
+}
+
+/**
+ * @brief Sentence of the whole input, frozen chunks followed by the decode of the trailing window
+ *
+ * @param pinyin Shuangpin keys
+ * @param syllables Segmentation of pinyin
+ * @return string
+ */
+string SentenceStream::decode(string_view pinyin, const vector<SyllableSpan> &syllables)
+{
+    sync_syllables(pinyin, syllables);
+    while (quanpin_.size() - (chunks_.empty() ? 0 : chunks_.back().end) > kChunkSyllables + kLookaheadSyllables)
+    {
+        if (!freeze_next_chunk())
+        { /* 解码器还没准备好或者打开失败，先不冻结，准备好之后的按键再从这里接着冻结 */
+            break;
+        }
+    }
+    const size_t tail_begin = chunks_.empty() ? 0 : chunks_.back().end;
+    return frozen_text_ + decode_range(tail_begin, quanpin_.size());
+}
+
+void SentenceStream::reset()
+{
+    shuangpin_.clear();
+    quanpin_.clear();
+    chunks_.clear();
+    frozen_text_.clear();
+}
+
+/**
+ * @brief Keep the syllables shared with the last call, convert only the new ones and drop chunks an edit reached
+ *
+ * @param pinyin
+ * @param syllables
+ */
+void SentenceStream::sync_syllables(string_view pinyin, const vector<SyllableSpan> &syllables)
+{
+    size_t common = 0;
+    while (common < shuangpin_.size() && common < syllables.size() &&
+           shuangpin_[common] == pinyin.substr(syllables[common].begin, syllables[common].length))
+    {
+        ++common;
+    }
+    shuangpin_.resize(common);
+    quanpin_.resize(common);
+    while (!chunks_.empty() && chunks_.back().end > common)
+    {
+        chunks_.pop_back();
+    }
+    frozen_text_.resize(chunks_.empty() ? 0 : chunks_.back().text_end);
+
+    for (size_t i = common; i < syllables.size(); ++i)
+    {
+        shuangpin_.emplace_back(pinyin.substr(syllables[i].begin, syllables[i].length));
+        quanpin_.push_back(PinyinUtil::convert_seg_shuangpin_to_seg_complete_pinyin(shuangpin_.back()));
+    }
+}
+
+/**
+ * @brief Decode and keep the next chunk
+ *
+ * @return bool false if the decoder returned nothing, the chunk is left to a later call then
+ */
+bool SentenceStream::freeze_next_chunk()
+{
+    const size_t begin = chunks_.empty() ? 0 : chunks_.back().end;
+    const size_t end = begin + kChunkSyllables;
+    /* 带上后面几个音节一起解码，一字一音节时截取前面这一段，切分点就是可信的 */
+    string text = decode_range(begin, end + kLookaheadSyllables);
+    if (Utf8Utils::count_chars(text) == kChunkSyllables + kLookaheadSyllables)
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < kChunkSyllables; ++i)
+        {
+            bytes += Utf8Utils::first_char_size(string_view(text).substr(bytes));
+        }
+        text.resize(bytes);
+        stats_.confident_cuts += 1;
+    }
+    else
+    {
+        text = decode_range(begin, end);
+    }
+    if (text.empty())
+    {
+        return false;
+    }
+    frozen_text_ += text;
+    chunks_.push_back(Chunk{end, frozen_text_.size()});
+    stats_.frozen_chunks += 1;
+    return true;
+}
+
+string SentenceStream::decode_range(size_t begin, size_t end)
+{
+    if (begin >= end)
+    {
+        return "";
+    }
+    string quanpin;
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (!quanpin.empty())
+        {
+            quanpin += '\'';
+        }
+        quanpin += quanpin_[i];
+    }
+    stats_.decoded_syllables += end - begin;
+    return decoder_(quanpin);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../core/pinyin_analysis.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Sentence decoding of long input in fixed-size chunks, only the trailing window is decoded per key
+ *
+ * Syllables are cut into chunks of kChunkSyllables from the front. A chunk is frozen once kLookaheadSyllables more
+ * syllables follow it: it is decoded together with the lookahead, and if the decoder produced one hanzi per
+ * syllable the hanzi of the chunk are kept, which lets the following words influence the cut. Frozen chunks are
+ * never decoded again unless an edit reaches into them, so the work per key is bounded by the window size no
+ * matter how long the input gets. Nothing is frozen while the decoder returns nothing, e.g. during its warm-up.
+ */
+class SentenceStream
+{
+  public:
+    static constexpr size_t kChunkSyllables = 8;
+    static constexpr size_t kLookaheadSyllables = 4;
+
+    // Decodes segmented quanpin like ni'hao into a sentence, empty if there is none
+    using Decoder = std::function<std::string(const std::string &)>;
+
+    struct Stats
+    {
+        size_t decoded_syllables = 0; // Syllables passed to the decoder, lookahead included
+        size_t frozen_chunks = 0;
+        size_t confident_cuts = 0; // Frozen chunks whose text came from the decode with lookahead
+    };
+
+    explicit SentenceStream(Decoder decoder);
+
+    std::string decode(std::string_view pinyin, const std::vector<SyllableSpan> &syllables);
+    void reset();
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+  private:
+    struct Chunk
+    {
+        size_t end = 0;      // Syllable index after the chunk
+        size_t text_end = 0; // Byte offset after the chunk's text in frozen_text_
+    };
+
+    void sync_syllables(std::string_view pinyin, const std::vector<SyllableSpan> &syllables);
+    bool freeze_next_chunk();
+    std::string decode_range(size_t begin, size_t end);
+
+    Decoder decoder_;
+    std::vector<std::string> shuangpin_; // Syllables of the last call
+    std::vector<std::string> quanpin_;   // Parallel to shuangpin_
+    std::vector<Chunk> chunks_;
+    std::string frozen_text_;
+    Stats stats_;
+};
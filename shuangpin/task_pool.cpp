@@ -0,0 +1,215 @@
+#include "task_pool.h"
+#include <algorithm>
+
+namespace
+{
+/* 当前线程所属的线程池和它的队列，工作线程提交的任务放进自己的队列 */
+thread_local const TaskPool *tls_pool = nullptr;
+thread_local size_t tls_index = 0;
+} // namespace
+
+size_t TaskPool::default_workers()
+{
+    const size_t cores = std::thread::hardware_concurrency();
+    return std::min<size_t>(cores > 1 ? cores - 1 : 0, 3);
+}
+
+TaskPool &TaskPool::shared()
+{
+    static TaskPool pool(default_workers());
+    return pool;
+}
+
+TaskPool::TaskPool(size_t workers)
+{
+    queues_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i)
+    {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    threads_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i)
+    {
+        threads_.emplace_back([this, i]() { work(i); });
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+size_t TaskPool::workers() const
+{
+    return threads_.size();
+}
+
+void TaskPool::push(Task task)
+{
+    const size_t index =
+        tls_pool == this ? tls_index : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++queued_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+/**
+ * @brief Take the newest task of a worker's own deque
+ *
+ * @param index
+ * @param task
+ * @return bool
+ */
+bool TaskPool::pop(size_t index, Task &task)
+{
+    Queue &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --queued_;
+    return true;
+}
+
+/**
+ * @brief Take the oldest task of another deque, starting after the thief's own
+ *
+ * @param thief Index of the stealing worker, or queues_.size() for a thread outside the pool
+ * @param task
+ * @return bool
+ */
+bool TaskPool::steal(size_t thief, Task &task)
+{
+    for (size_t i = 1; i <= queues_.size(); ++i)
+    {
+        Queue &queue = *queues_[(thief + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::execute(Task &task)
+{
+    std::exception_ptr error;
+    try
+    {
+        task.fn();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    task.group->finish(error);
+}
+
+void TaskPool::work(size_t index)
+{
+    tls_pool = this;
+    tls_index = index;
+    while (true)
+    {
+        Task task;
+        if (pop(index, task) || steal(index, task))
+        {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+        if (stopping_ && queued_ == 0)
+        {
+            return;
+        }
+    }
+}
+
+TaskPool::Group::Group(TaskPool &pool) : pool_(pool)
+{
+}
+
+TaskPool::Group::~Group()
+{
+    join();
+}
+
+void TaskPool::Group::run(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+    Task each{std::move(task), this};
+    if (pool_.workers() == 0)
+    {
+        execute(each);
+        return;
+    }
+    pool_.push(std::move(each));
+}
+
+void TaskPool::Group::wait()
+{
+    join();
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(error, error_);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * @brief Help with pending tasks, of this group or not, then sleep until the rest is done
+ *
+ * The wait always ends by taking the mutex, so the last finish() is out of the group before it can be destroyed.
+ */
+void TaskPool::Group::join()
+{
+    Task task;
+    while (pending_ > 0 && pool_.workers() > 0 && pool_.steal(pool_.queues_.size(), task))
+    {
+        execute(task);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void TaskPool::Group::finish(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error && !error_)
+    {
+        error_ = error;
+    }
+    if (--pending_ == 0)
+    {
+        done_.notify_all();
+    }
+}
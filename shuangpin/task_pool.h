@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A few worker threads for the independent queries of one keystroke
+ *
+ * Every worker owns a deque. A worker takes its newest task first and, once its own deque is empty, steals the
+ * oldest task of another worker, so a burst of queries spreads over the idle threads without a shared queue. Tasks
+ * are submitted through a Group, and the thread waiting on the group runs pending tasks itself instead of blocking,
+ * so a group always completes even when every worker is busy.
+ *
+ * A pool without workers runs every task inline.
+ */
+class TaskPool
+{
+  public:
+    // Leave one core to the thread that types
+    static size_t default_workers();
+    // One pool for the whole process with default_workers(), for the dictionaries and the candidate merger
+    static TaskPool &shared();
+
+    explicit TaskPool(size_t workers);
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+    ~TaskPool();
+
+    size_t workers() const;
+
+    // Tasks that are waited for together, the destructor waits too
+    class Group
+    {
+      public:
+        explicit Group(TaskPool &pool);
+        Group(const Group &) = delete;
+        Group &operator=(const Group &) = delete;
+        ~Group();
+
+        void run(std::function<void()> task);
+        // Run pending tasks until all tasks of the group are done, the first exception of a task is rethrown
+        void wait();
+
+      private:
+        friend class TaskPool;
+        void join();
+        void finish(std::exception_ptr error);
+
+      private:
+        TaskPool &pool_;
+        std::atomic<size_t> pending_{0};
+        std::mutex mutex_;
+        std::condition_variable done_;
+        std::exception_ptr error_;
+    };
+
+  private:
+    struct Task
+    {
+        std::function<void()> fn;
+        Group *group;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+    bool pop(size_t index, Task &task);
+    bool steal(size_t thief, Task &task);
+    static void execute(Task &task);
+    void work(size_t index);
+
+  private:
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_queue_{0}; // Round robin for tasks submitted from outside the pool
+    std::atomic<size_t> queued_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
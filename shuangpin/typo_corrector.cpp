@@ -0,0 +1,183 @@
+#include "typo_corrector.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+namespace
+{
+/* 每个字母在 QWERTY 键盘上的行和列，下一行比上一行向右错开半个键 */
+struct KeyPosition
+{
+    int row;
+    int column;
+};
+
+std::array<KeyPosition, 26> key_positions()
+{
+    const char *rows[] = {"qwertyuiop", "asdfghjkl", "zxcvbnm"};
+    std::array<KeyPosition, 26> positions{};
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; rows[row][column]; ++column)
+        {
+            positions[rows[row][column] - 'a'] = KeyPosition{row, column};
+        }
+    }
+    return positions;
+}
+} // namespace
+
+TypoCorrector::TypoCorrector(const KeyIndex &index) : index_(index)
+{
+}
+
+/**
+ * @brief Dictionary keys one edit away from code
+ *
+ * @param code Lowercase shuangpin keys
+ * @return std::vector<Correction>
+ */
+std::vector<TypoCorrector::Correction> TypoCorrector::correct(std::string_view code)
+{
+    code_ = code;
+    visited_ = 0;
+    found_.clear();
+    if (!index_.ready() || code.empty())
+    {
+        return {};
+    }
+    std::string key;
+    key.reserve(code.size() + 1);
+    walk_edits(index_.root(), 0, key);
+
+    /* 同一个 key 可能由不同的编辑得到，只留代价最小的一次 */
+    std::sort(found_.begin(), found_.end(), [](const Correction &a, const Correction &b) {
+        return a.key != b.key ? a.key < b.key : a.cost < b.cost;
+    });
+    found_.erase(std::unique(found_.begin(), found_.end(),
+                             [](const Correction &a, const Correction &b) { return a.key == b.key; }),
+                 found_.end());
+    std::sort(found_.begin(), found_.end(), [](const Correction &a, const Correction &b) {
+        return a.cost != b.cost ? a.cost < b.cost : a.best_weight > b.best_weight;
+    });
+    if (found_.size() > kMaxCorrections)
+    {
+        found_.resize(kMaxCorrections);
+    }
+    return std::move(found_);
+}
+
+bool TypoCorrector::adjacent(char a, char b)
+{
+    static const std::array<KeyPosition, 26> positions = key_positions();
+    if (a < 'a' || a > 'z' || b < 'a' || b > 'z' || a == b)
+    {
+        return false;
+    }
+    const KeyPosition &pa = positions[a - 'a'];
+    const KeyPosition &pb = positions[b - 'a'];
+    if (pa.row == pb.row)
+    {
+        return std::abs(pa.column - pb.column) == 1;
+    }
+    if (std::abs(pa.row - pb.row) != 1)
+    {
+        return false;
+    }
+    /* 下一行的第 i 个键挨着上一行的第 i 和第 i + 1 个键 */
+    const KeyPosition &upper = pa.row < pb.row ? pa : pb;
+    const KeyPosition &lower = pa.row < pb.row ? pb : pa;
+    return upper.column == lower.column || upper.column == lower.column + 1;
+}
+
+/**
+ * @brief Follow code from node with the edit still unspent, branching into every edit at every position
+ *
+ * @param node Reached by key, which equals code[0, pos)
+ * @param pos
+ * @param key
+ */
+void TypoCorrector::walk_edits(const KeyIndex::Node &node, size_t pos, std::string &key)
+{
+    if (!visit())
+    {
+        return;
+    }
+    const KeyIndex::Node *children = index_.children(node);
+    for (uint8_t i = 0; i < node.child_count; ++i)
+    {
+        const KeyIndex::Node &child = children[i];
+        key.push_back(child.letter);
+        if (pos < code_.size())
+        {
+            if (child.letter == code_[pos])
+            {
+                walk_edits(child, pos + 1, key);
+            }
+            else
+            { /* 按错了键 */
+                walk_exact(&child, pos + 1, key, adjacent(child.letter, code_[pos]) ? kAdjacentCost : kEditCost);
+            }
+        }
+        /* 漏按了 child.letter */
+        walk_exact(&child, pos, key, kEditCost);
+        key.pop_back();
+    }
+    if (pos >= code_.size())
+    {
+        return;
+    }
+    /* 多按了 code_[pos] */
+    walk_exact(&node, pos + 1, key, kEditCost);
+    /* 相邻两个键按反了 */
+    if (pos + 1 < code_.size() && code_[pos] != code_[pos + 1])
+    {
+        const KeyIndex::Node *first = index_.child(node, code_[pos + 1]);
+        const KeyIndex::Node *second = first ? index_.child(*first, code_[pos]) : nullptr;
+        if (second)
+        {
+            key.push_back(code_[pos + 1]);
+            key.push_back(code_[pos]);
+            walk_exact(second, pos + 2, key, kAdjacentCost);
+            key.resize(key.size() - 2);
+        }
+    }
+}
+
+/**
+ * @brief Follow code[pos, end) exactly from node, the edit is spent, record the key if it is in the dictionary
+ *
+ * @param node
+ * @param pos
+ * @param key Key of node
+ * @param cost Cost of the spent edit
+ */
+void TypoCorrector::walk_exact(const KeyIndex::Node *node, size_t pos, std::string &key, int cost)
+{
+    const size_t key_size = key.size();
+    for (; node && pos < code_.size() && visit(); ++pos)
+    {
+        node = index_.child(*node, code_[pos]);
+        key.push_back(code_[pos]);
+    }
+    if (node && pos == code_.size() && node->posting_count > 0 && key != code_)
+    {
+        std::vector<KeyIndex::Hit> hits;
+        index_.collect(*node, key, 1, hits);
+        if (!hits.empty())
+        {
+            found_.push_back(Correction{key, cost, hits.front().weight});
+        }
+    }
+    key.resize(key_size);
+}
+
+bool TypoCorrector::visit()
+{
+    if (visited_ >= kMaxVisitedNodes)
+    {
+        return false;
+    }
+    ++visited_;
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "key_index.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Dictionary keys within one edit of a typed code, found by walking the key index trie
+ *
+ * The typed code is matched as a Levenshtein automaton of distance 1 over the trie: the walk follows the code
+ * exactly, and at each position may spend its single edit on a substituted key, an extra key, a missed key or two
+ * swapped keys, after which only the exact remainder is followed. Substituting a key for one of its neighbours on the
+ * keyboard and swapping two keys are the cheap, common slips; any other edit costs twice as much.
+ *
+ * The walk stops after kMaxVisitedNodes trie nodes, so a lookup costs the same small budget whatever the code.
+ */
+class TypoCorrector
+{
+  public:
+    static constexpr size_t kMaxVisitedNodes = 4096;
+    static constexpr size_t kMaxCorrections = 8;
+    static constexpr int kAdjacentCost = 1;
+    static constexpr int kEditCost = 2;
+
+    struct Correction
+    {
+        std::string key;
+        int cost;        // kAdjacentCost or kEditCost
+        int best_weight; // Weight of the key's first word
+    };
+
+    explicit TypoCorrector(const KeyIndex &index);
+
+    // Keys other than code itself, sorted by cost, then by best_weight desc
+    std::vector<Correction> correct(std::string_view code);
+    // Trie nodes visited by the last call, at most kMaxVisitedNodes
+    size_t visited() const
+    {
+        return visited_;
+    }
+
+    static bool adjacent(char a, char b);
+
+  private:
+    void walk_edits(const KeyIndex::Node &node, size_t pos, std::string &key);
+    void walk_exact(const KeyIndex::Node *node, size_t pos, std::string &key, int cost);
+    bool visit();
+
+  private:
+    const KeyIndex &index_;
+    std::string_view code_;
+    size_t visited_ = 0;
+    std::vector<Correction> found_;
+};
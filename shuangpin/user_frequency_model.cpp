@@ -0,0 +1,280 @@
+#include "user_frequency_model.h"
+#include "atomic_file.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+constexpr char kMagic[4] = {'M', 'S', 'U', 'F'};
+constexpr uint32_t kVersion = 1;
+
+double to_double(uint64_t bits)
+{
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint64_t to_bits(double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+size_t round_up_pow2(size_t value)
+{
+    size_t res = 1;
+    while (res < value)
+    {
+        res <<= 1;
+    }
+    return res;
+}
+} // namespace
+
+UserFrequencyModel::UserFrequencyModel(size_t capacity, double half_life_days)
+    : slots_(new Slot[round_up_pow2(capacity)]), mask_(round_up_pow2(capacity) - 1),
+      half_life_minutes_(half_life_days * 24 * 60), base_minute_(now_minutes())
+{
+}
+
+/**
+ * @brief Record one commit of word under key
+ *
+ * @param key Shuangpin key
+ * @param word
+ */
+void UserFrequencyModel::record(std::string_view key, std::string_view word)
+{
+    Slot *slot = find_slot(make_tag(key, word), true);
+    if (!slot)
+    {
+        return; // Probe window full, drop the sample
+    }
+    const uint32_t now = now_minutes();
+    const double delta = growth(now);
+    uint64_t expected = slot->accumulated.load(std::memory_order_relaxed);
+    while (!slot->accumulated.compare_exchange_weak(expected, to_bits(to_double(expected) + delta),
+                                                    std::memory_order_relaxed))
+    {
+    }
+    slot->last_seen.store(now, std::memory_order_relaxed);
+    records_since_save_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void UserFrequencyModel::forget(std::string_view key, std::string_view word)
+{
+    Slot *slot = find_slot(make_tag(key, word), false);
+    if (slot)
+    {
+        slot->accumulated.store(to_bits(0.0), std::memory_order_relaxed);
+        slot->last_seen.store(0, std::memory_order_relaxed);
+        records_since_save_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+double UserFrequencyModel::score(std::string_view key, std::string_view word) const
+{
+    return score(key, word, now_minutes());
+}
+
+/**
+ * @brief Decayed commit count of word under key plus the recency bonus of its last commit
+ *
+ * One commit right now scores 1.0 + kRecencyBonus, the bonus halves every kRecencyHalfLifeMinutes.
+ *
+ * @param key
+ * @param word
+ * @param now Minutes
+ * @return double
+ */
+double UserFrequencyModel::score(std::string_view key, std::string_view word, uint32_t now) const
+{
+    if (size_.load(std::memory_order_relaxed) == 0)
+    {
+        return 0.0;
+    }
+    const Slot *slot = find_slot(make_tag(key, word), false);
+    if (!slot)
+    {
+        return 0.0;
+    }
+    const double count = to_double(slot->accumulated.load(std::memory_order_relaxed)) / growth(now);
+    const uint32_t last_seen = slot->last_seen.load(std::memory_order_relaxed);
+    if (last_seen == 0 || count <= 0.0)
+    {
+        return count;
+    }
+    const double age = now > last_seen ? static_cast<double>(now - last_seen) : 0.0;
+    return count + kRecencyBonus * std::exp2(-age / kRecencyHalfLifeMinutes);
+}
+
+/**
+ * @brief Load a snapshot, the stored values are rebased to the current landmark
+ *
+ * @param path
+ * @return bool
+ */
+bool UserFrequencyModel::load(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0, base_minute = 0;
+    uint64_t count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&base_minute), sizeof(base_minute));
+    file.read(reinterpret_cast<char *>(&count), sizeof(count));
+    if (!file || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version != kVersion)
+    {
+        return false;
+    }
+    const double rebase = std::exp2((static_cast<double>(base_minute) - base_minute_) / half_life_minutes_);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t tag = 0;
+        double accumulated = 0.0;
+        uint32_t last_seen = 0;
+        file.read(reinterpret_cast<char *>(&tag), sizeof(tag));
+        file.read(reinterpret_cast<char *>(&accumulated), sizeof(accumulated));
+        file.read(reinterpret_cast<char *>(&last_seen), sizeof(last_seen));
+        if (!file)
+        {
+            return false;
+        }
+        Slot *slot = find_slot(tag, true);
+        if (slot)
+        {
+            slot->accumulated.store(to_bits(accumulated * rebase), std::memory_order_relaxed);
+            slot->last_seen.store(last_seen, std::memory_order_relaxed);
+        }
+    }
+    records_since_save_.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Write a snapshot of every live slot, the file is replaced atomically
+ *
+ * @param path
+ * @return bool
+ */
+bool UserFrequencyModel::save(const std::string &path) const
+{
+    struct Record
+    {
+        uint64_t tag;
+        double accumulated;
+        uint32_t last_seen;
+    };
+    std::vector<Record> records;
+    records.reserve(size_.load(std::memory_order_relaxed));
+    for (size_t i = 0; i <= mask_; ++i)
+    {
+        const uint64_t tag = slots_[i].tag.load(std::memory_order_relaxed);
+        const double accumulated = to_double(slots_[i].accumulated.load(std::memory_order_relaxed));
+        if (tag != 0 && accumulated > 0.0)
+        {
+            records.push_back({tag, accumulated, slots_[i].last_seen.load(std::memory_order_relaxed)});
+        }
+    }
+
+    const bool saved = AtomicFile::replace(path, [&](std::ostream &file) {
+        const uint64_t count = records.size();
+        file.write(kMagic, sizeof(kMagic));
+        file.write(reinterpret_cast<const char *>(&kVersion), sizeof(kVersion));
+        file.write(reinterpret_cast<const char *>(&base_minute_), sizeof(base_minute_));
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        for (const auto &each : records)
+        {
+            file.write(reinterpret_cast<const char *>(&each.tag), sizeof(each.tag));
+            file.write(reinterpret_cast<const char *>(&each.accumulated), sizeof(each.accumulated));
+            file.write(reinterpret_cast<const char *>(&each.last_seen), sizeof(each.last_seen));
+        }
+        return static_cast<bool>(file);
+    });
+    if (!saved)
+    {
+        return false;
+    }
+    records_since_save_.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+size_t UserFrequencyModel::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+uint32_t UserFrequencyModel::records_since_save() const
+{
+    return records_since_save_.load(std::memory_order_relaxed);
+}
+
+uint32_t UserFrequencyModel::now_minutes()
+{
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<minutes>(system_clock::now().time_since_epoch()).count());
+}
+
+uint64_t UserFrequencyModel::make_tag(std::string_view key, std::string_view word)
+{
+    // FNV-1a over key, a separator and word
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto feed = [&hash](std::string_view data) {
+        for (const char ch : data)
+        {
+            hash ^= static_cast<unsigned char>(ch);
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    feed(key);
+    feed(std::string_view("\0", 1));
+    feed(word);
+    return hash == 0 ? 1 : hash;
+}
+
+UserFrequencyModel::Slot *UserFrequencyModel::find_slot(uint64_t tag, bool create) const
+{
+    size_t index = static_cast<size_t>(tag ^ (tag >> 32)) & mask_;
+    for (size_t probe = 0; probe < kMaxProbe; ++probe, index = (index + 1) & mask_)
+    {
+        Slot &slot = slots_[index];
+        uint64_t cur = slot.tag.load(std::memory_order_acquire);
+        if (cur == tag)
+        {
+            return &slot;
+        }
+        if (cur == 0)
+        {
+            if (!create)
+            {
+                return nullptr;
+            }
+            if (slot.tag.compare_exchange_strong(cur, tag, std::memory_order_acq_rel))
+            {
+                size_.fetch_add(1, std::memory_order_relaxed);
+                return &slot;
+            }
+            if (cur == tag)
+            {
+                return &slot;
+            }
+        }
+    }
+    return nullptr;
+}
+
+double UserFrequencyModel::growth(uint32_t minutes) const
+{
+    return std::exp2((static_cast<double>(minutes) - base_minute_) / half_life_minutes_);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief In-memory per-(key, word) usage counters with exponential time decay
+ *
+ * Counters live in a fixed-size open-addressing table of atomics, recording a commit is a slot claim plus a couple
+ * of atomic updates and never touches the database. Decay uses forward decay: every commit adds 2^(t / half_life)
+ * to the slot, and the decayed count at time t is that sum divided by 2^(t / half_life). Older commits thus fade
+ * out individually while recent ones dominate. On top of the count, the last commit of a slot adds a recency bonus
+ * that fades within hours, so a word chosen a moment ago wins over one with the same count chosen last week.
+ *
+ * Slots are identified by a 64-bit hash of (key, word), the words themselves are not stored.
+ */
+class UserFrequencyModel
+{
+  public:
+    explicit UserFrequencyModel(size_t capacity = 1 << 16, double half_life_days = 14.0);
+
+    void record(std::string_view key, std::string_view word);
+    void forget(std::string_view key, std::string_view word);
+    double score(std::string_view key, std::string_view word) const;
+    double score(std::string_view key, std::string_view word, uint32_t now) const;
+
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    size_t size() const;
+    uint32_t records_since_save() const;
+
+    static uint32_t now_minutes();
+
+  private:
+    struct Slot
+    {
+        std::atomic<uint64_t> tag{0};           // 0: empty
+        std::atomic<uint64_t> accumulated{0};   // double bits, sum of 2^(t / half_life)
+        std::atomic<uint32_t> last_seen{0};     // Minutes, 0: never, for the recency bonus
+    };
+
+    static uint64_t make_tag(std::string_view key, std::string_view word);
+    Slot *find_slot(uint64_t tag, bool create) const;
+    double growth(uint32_t minutes) const;
+
+  private:
+    static constexpr size_t kMaxProbe = 32;
+    static constexpr double kRecencyBonus = 0.5; // Added to the count of a commit right now
+    static constexpr double kRecencyHalfLifeMinutes = 60.0;
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    double half_life_minutes_;
+    uint32_t base_minute_; // Forward decay landmark, keeps the accumulated values in range
+    mutable std::atomic<size_t> size_{0};
+    mutable std::atomic<uint32_t> records_since_save_{0};
+};
@@ -0,0 +1,281 @@
+#include "user_lexicon.h"
+#include "atomic_file.h"
+#include "dictionary_snapshot.h"
+#include "spdlog/spdlog.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <fstream>
+
+UserLexicon::~UserLexicon()
+{
+    if (journal_)
+    {
+        std::fclose(journal_);
+    }
+}
+
+/**
+ * @brief Replay the journal, malformed lines are skipped so that a line torn by a crash loses only itself
+ *
+ * @param path
+ * @return bool false if the journal cannot be opened for appending
+ */
+bool UserLexicon::load(const std::string &path)
+{
+    path_ = path;
+    bool torn = false; // Last line has no newline, the process was killed while appending it
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            ++journal_lines_;
+            torn = file.eof();
+            std::vector<std::string_view> fields;
+            std::string_view rest = line;
+            while (true)
+            {
+                const size_t tab = rest.find('\t');
+                fields.push_back(rest.substr(0, tab));
+                if (tab == std::string_view::npos)
+                    break;
+                rest.remove_prefix(tab + 1);
+            }
+            if (fields.size() == 4 && fields[0] == "+")
+            {
+                int weight = 0;
+                try
+                {
+                    weight = std::stoi(std::string(fields[3]));
+                }
+                catch (const std::exception &)
+                {
+                    continue;
+                }
+                put(Entry{std::string(fields[1]), std::string(fields[2]), weight, false});
+            }
+            else if (fields.size() == 3 && fields[0] == "-")
+            {
+                put(Entry{std::string(fields[1]), std::string(fields[2]), 0, true});
+            }
+        }
+    }
+    if (journal_lines_ > size_ * 2 + 256)
+    {
+        if (compact())
+            torn = false;
+        else
+            spdlog::warn("Failed to compact user lexicon journal {}.", path);
+    }
+    journal_ = std::fopen(path.c_str(), "ab");
+    if (!journal_)
+    {
+        spdlog::error("Failed to open user lexicon journal {}.", path);
+        return false;
+    }
+    if (torn)
+    {
+        std::fputc('\n', journal_);
+    }
+    spdlog::info("User lexicon: {} entries from {} journal lines.", size_, journal_lines_);
+    return true;
+}
+
+/**
+ * @brief Add a word, or change the weight of one added before, a deleted word is restored
+ *
+ * @param key
+ * @param word
+ * @param weight
+ * @return bool false if the word is not valid for a journal line
+ */
+bool UserLexicon::add(const std::string &key, const std::string &word, int weight)
+{
+    if (key.empty() || word.find_first_of("\t\r\n") != std::string::npos)
+        return false;
+    put(Entry{key, word, weight, false});
+    return append(fmt::format("+\t{}\t{}\t{}\n", key, word, weight));
+}
+
+/**
+ * @brief Add words like add(), the journal lines are written and flushed together
+ *
+ * @param entries Deleted entries are not accepted
+ * @return bool false if an entry is not valid for a journal line, nothing is added then
+ */
+bool UserLexicon::add_all(const std::vector<Entry> &entries)
+{
+    std::string lines;
+    for (const auto &entry : entries)
+    {
+        if (entry.erased || entry.key.empty() || entry.word.find_first_of("\t\r\n") != std::string::npos)
+            return false;
+        lines += fmt::format("+\t{}\t{}\t{}\n", entry.key, entry.word, entry.weight);
+    }
+    for (const auto &entry : entries)
+    {
+        put(entry);
+    }
+    return entries.empty() || append(lines, entries.size());
+}
+
+bool UserLexicon::erase(const std::string &key, const std::string &word)
+{
+    if (key.empty() || word.find_first_of("\t\r\n") != std::string::npos)
+        return false;
+    put(Entry{key, word, 0, true});
+    return append(fmt::format("-\t{}\t{}\n", key, word));
+}
+
+UserLexicon::State UserLexicon::state(std::string_view key, std::string_view word) const
+{
+    if (const auto *entries = find(jianpin_of(key)))
+    {
+        for (const auto &entry : *entries)
+        {
+            if (entry.key == key && entry.word == word)
+                return entry.erased ? State::Erased : State::Added;
+        }
+    }
+    return State::Absent;
+}
+
+const std::vector<UserLexicon::Entry> *UserLexicon::find(std::string_view jp) const
+{
+    if (by_jp_.empty())
+        return nullptr;
+    const auto it = by_jp_.find(std::string(jp));
+    return it == by_jp_.end() ? nullptr : &it->second;
+}
+
+void UserLexicon::apply_to(DictionarySnapshot &snapshot) const
+{
+    for (const auto &[jp, entries] : by_jp_)
+    {
+        for (const auto &entry : entries)
+        {
+            if (entry.erased)
+                snapshot.remove_word(entry.key, entry.word);
+            else
+                snapshot.add_word(entry.key, jp, entry.word, entry.weight);
+        }
+    }
+}
+
+size_t UserLexicon::size() const
+{
+    return size_;
+}
+
+size_t UserLexicon::journal_lines() const
+{
+    return journal_lines_;
+}
+
+uint64_t UserLexicon::content_hash() const
+{
+    return content_hash_;
+}
+
+std::string UserLexicon::jianpin_of(std::string_view key)
+{
+    std::string jp;
+    for (size_t i = 0; i < key.size(); i += 2)
+        jp += key[i];
+    return jp;
+}
+
+/**
+ * @brief Replace the entry with the same key and word, keeping the jp group sorted by weight desc
+ *
+ * Deleted entries sort last, they are only looked up by key and word.
+ *
+ * @param entry
+ */
+void UserLexicon::put(Entry entry)
+{
+    auto &entries = by_jp_[jianpin_of(entry.key)];
+    const auto same = std::find_if(entries.begin(), entries.end(), [&entry](const Entry &each) {
+        return each.key == entry.key && each.word == entry.word;
+    });
+    if (same != entries.end())
+    {
+        content_hash_ ^= hash_entry(*same);
+        entries.erase(same);
+    }
+    else
+    {
+        ++size_;
+    }
+    content_hash_ ^= hash_entry(entry);
+    const auto rank = [](const Entry &each) { return each.erased ? -1 : each.weight; };
+    const auto pos = std::upper_bound(entries.begin(), entries.end(), rank(entry),
+                                      [&rank](int weight, const Entry &each) { return weight > rank(each); });
+    entries.insert(pos, std::move(entry));
+}
+
+/**
+ * @brief FNV-1a over the fields, then mixed so that XOR-ing the hashes of many entries does not cancel out
+ *
+ * @param entry
+ * @return uint64_t
+ */
+uint64_t UserLexicon::hash_entry(const Entry &entry)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const auto feed = [&hash](std::string_view bytes) {
+        for (const char ch : bytes)
+        {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 0x100000001b3ULL;
+        }
+        hash = (hash ^ 0xff) * 0x100000001b3ULL; // Not a byte of UTF-8, separates the fields
+    };
+    feed(entry.key);
+    feed(entry.word);
+    feed(entry.erased ? std::string("-") : std::to_string(entry.weight));
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool UserLexicon::append(const std::string &lines, size_t count)
+{
+    if (!journal_)
+        return false;
+    journal_lines_ += count;
+    /* 每次都刷到文件里，输入法进程随时可能被结束 */
+    return std::fwrite(lines.data(), 1, lines.size(), journal_) == lines.size() && std::fflush(journal_) == 0;
+}
+
+/**
+ * @brief Rewrite the journal with one line per entry, the file is replaced atomically
+ *
+ * @return bool
+ */
+bool UserLexicon::compact()
+{
+    size_t lines = 0;
+    const bool replaced = AtomicFile::replace(path_, [&](std::ostream &file) {
+        for (const auto &[jp, entries] : by_jp_)
+        {
+            for (const auto &entry : entries)
+            {
+                if (entry.erased)
+                    file << fmt::format("-\t{}\t{}\n", entry.key, entry.word);
+                else
+                    file << fmt::format("+\t{}\t{}\t{}\n", entry.key, entry.word, entry.weight);
+                ++lines;
+            }
+        }
+        return static_cast<bool>(file);
+    });
+    if (!replaced)
+    {
+        return false;
+    }
+    journal_lines_ = lines;
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class DictionarySnapshot;
+
+/**
+ * @brief Per-user words layered over the read-only system dictionary
+ *
+ * The system database is opened read-only and memory-mapped, so processes share its pages and an upgrade simply
+ * replaces the file. Words the user creates or imports and system words the user deletes live here instead: in
+ * memory, grouped by jianpin since every query shape of the system layer returns rows of a single jp, and in an
+ * append-only journal that is replayed on load.
+ *
+ * Journal lines are tab-separated, "+ key word weight" adds a word and "- key word" deletes one. The last line
+ * for a (key, word) wins. Once the journal holds many more lines than live entries it is rewritten on load.
+ *
+ * Not thread-safe, DictionaryUlPb serializes access with its reload mutex.
+ */
+class UserLexicon
+{
+  public:
+    static constexpr int kDefaultWeight = 10000;
+
+    struct Entry
+    {
+        std::string key;
+        std::string word;
+        int weight;  // Unused for deleted entries
+        bool erased; // Hides the system row with the same key and word
+    };
+
+    enum class State
+    {
+        Absent, // Only the system layer decides
+        Added,
+        Erased,
+    };
+
+    UserLexicon() = default;
+    UserLexicon(const UserLexicon &) = delete;
+    UserLexicon &operator=(const UserLexicon &) = delete;
+    ~UserLexicon();
+
+    // Replay the journal and keep it open for appending, a missing journal is an empty lexicon
+    bool load(const std::string &path);
+
+    bool add(const std::string &key, const std::string &word, int weight = kDefaultWeight);
+    // Add or re-weight many words with a single journal write, for bulk imports
+    bool add_all(const std::vector<Entry> &entries);
+    bool erase(const std::string &key, const std::string &word);
+    State state(std::string_view key, std::string_view word) const;
+
+    // Entries for one jianpin, sorted by weight desc, nullptr if there are none
+    const std::vector<Entry> *find(std::string_view jp) const;
+    // Put the added words into the snapshot's filter and index, and take the deleted ones out of the index
+    void apply_to(DictionarySnapshot &snapshot) const;
+
+    size_t size() const;
+    size_t journal_lines() const;
+    // Hash of the live entries independent of their order, unlike journal_lines() it survives a compaction
+    uint64_t content_hash() const;
+
+    // Initials of a shuangpin key, every other letter
+    static std::string jianpin_of(std::string_view key);
+
+  private:
+    void put(Entry entry);
+    static uint64_t hash_entry(const Entry &entry);
+    bool append(const std::string &lines, size_t count = 1);
+    bool compact();
+
+  private:
+    std::unordered_map<std::string, std::vector<Entry>> by_jp_;
+    size_t size_ = 0;
+    size_t journal_lines_ = 0;
+    uint64_t content_hash_ = 0; // XOR of hash_entry() over the entries
+    std::string path_;
+    std::FILE *journal_ = nullptr;
+};
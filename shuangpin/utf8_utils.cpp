@@ -0,0 +1,205 @@
+#include "utf8_utils.h"
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_UTILS_USE_SSE2 1
+#endif
+
+namespace Utf8Utils
+{
+namespace
+{
+inline unsigned popcount16(unsigned mask)
+{
+    unsigned cnt = 0;
+    while (mask)
+    {
+        mask &= mask - 1;
+        ++cnt;
+    }
+    return cnt;
+}
+} // namespace
+
+/**
+ * @brief Get first UTF-8 char size
+ *
+ * @param words UTF-8 string
+ * @return size_t Char size, 0 for empty input
+ */
+size_t first_char_size(std::string_view words)
+{
+    if (words.empty())
+        return 0;
+    size_t cplen = char_size(words[0]);
+    if (cplen > words.size())
+        cplen = 1;
+    return cplen;
+}
+
+/**
+ * @brief Get last UTF-8 char size by scanning back to the nearest lead byte, at most 4 bytes are touched
+ *
+ * @param words UTF-8 string
+ * @return size_t Char size, 0 for empty input
+ */
+size_t last_char_size(std::string_view words)
+{
+    if (words.empty())
+        return 0;
+    size_t start = words.size() - 1;
+    const size_t limit = words.size() >= 4 ? words.size() - 4 : 0;
+    while (start > limit && is_continuation(words[start]))
+    {
+        --start;
+    }
+    if (is_continuation(words[start]) || start + char_size(words[start]) != words.size())
+    {
+        return 1;
+    }
+    return words.size() - start;
+}
+
+std::string_view first_char(std::string_view words)
+{
+    return words.substr(0, first_char_size(words));
+}
+
+std::string_view last_char(std::string_view words)
+{
+    return words.substr(words.size() - last_char_size(words));
+}
+
+/**
+ * @brief Count UTF-8 chars, i.e. every byte that is not a continuation byte
+ *
+ * Uses SSE2 to classify 16 bytes per iteration where available.
+ *
+ * @param words UTF-8 string
+ * @return size_t
+ */
+size_t count_chars(std::string_view words)
+{
+    const char *data = words.data();
+    const size_t size = words.size();
+    size_t continuation = 0;
+    size_t index = 0;
+#ifdef UTF8_UTILS_USE_SSE2
+    const __m128i mask = _mm_set1_epi8(static_cast<char>(0xc0));
+    const __m128i tag = _mm_set1_epi8(static_cast<char>(0x80));
+    for (; index + 16 <= size; index += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index));
+        const __m128i matched = _mm_cmpeq_epi8(_mm_and_si128(chunk, mask), tag);
+        continuation += popcount16(static_cast<unsigned>(_mm_movemask_epi8(matched)));
+    }
+#endif
+    for (; index < size; ++index)
+    {
+        continuation += is_continuation(data[index]);
+    }
+    return size - continuation;
+}
+
+/**
+ * @brief Decode the first codepoint
+ *
+ * @param words UTF-8 string
+ * @param size Out: bytes consumed, 0 for empty input
+ * @return char32_t
+ */
+char32_t decode(std::string_view words, size_t &size)
+{
+    size = first_char_size(words);
+    if (size == 0)
+        return 0;
+    const unsigned char lead = static_cast<unsigned char>(words[0]);
+    if (size == 1)
+        return lead < 0x80 ? lead : 0xfffd;
+    char32_t codepoint = lead & (0x7f >> size);
+    for (size_t i = 1; i < size; ++i)
+    {
+        if (!is_continuation(words[i]))
+        {
+            size = i;
+            return 0xfffd;
+        }
+        codepoint = (codepoint << 6) | (static_cast<unsigned char>(words[i]) & 0x3f);
+    }
+    return codepoint;
+}
+
+/**
+ * @brief Append the UTF-16 encoding of words, characters outside the BMP become surrogate pairs
+ *
+ * @param words UTF-8 string
+ * @param out
+ */
+void append_utf16(std::string_view words, std::u16string &out)
+{
+    size_t index = 0;
+    while (index < words.size())
+    {
+        size_t size = 0;
+        const char32_t codepoint = decode(words.substr(index), size);
+        index += size;
+        if (codepoint < 0x10000)
+        {
+            out += static_cast<char16_t>(codepoint);
+        }
+        else
+        {
+            out += static_cast<char16_t>(0xd800 + ((codepoint - 0x10000) >> 10));
+            out += static_cast<char16_t>(0xdc00 + ((codepoint - 0x10000) & 0x3ff));
+        }
+    }
+}
+
+/**
+ * @brief Append the UTF-8 encoding of text, unpaired surrogates become U+FFFD
+ *
+ * @param text UTF-16 string
+ * @param out
+ */
+void append_utf8(std::u16string_view text, std::string &out)
+{
+    for (size_t index = 0; index < text.size(); ++index)
+    {
+        char32_t codepoint = text[index];
+        if (codepoint >= 0xd800 && codepoint < 0xdc00 && index + 1 < text.size() && text[index + 1] >= 0xdc00 &&
+            text[index + 1] < 0xe000)
+        {
+            codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (text[index + 1] - 0xdc00);
+            ++index;
+        }
+        else if (codepoint >= 0xd800 && codepoint < 0xe000)
+        {
+            codepoint = 0xfffd;
+        }
+
+        if (codepoint < 0x80)
+        {
+            out += static_cast<char>(codepoint);
+        }
+        else if (codepoint < 0x800)
+        {
+            out += static_cast<char>(0xc0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3f));
+        }
+        else if (codepoint < 0x10000)
+        {
+            out += static_cast<char>(0xe0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codepoint & 0x3f));
+        }
+        else
+        {
+            out += static_cast<char>(0xf0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codepoint & 0x3f));
+        }
+    }
+}
+} // namespace Utf8Utils
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Allocation-free UTF-8 helpers working on std::string_view
+ *
+ * The input is assumed to be well-formed UTF-8 (dictionary words, helpcode keys). Malformed lead bytes are treated
+ * as single-byte characters so that iteration always makes progress.
+ */
+namespace Utf8Utils
+{
+inline bool is_continuation(char ch)
+{
+    return (static_cast<unsigned char>(ch) & 0xc0) == 0x80;
+}
+
+/**
+ * @brief Byte length of the character starting with the given lead byte
+ *
+ * @param lead
+ * @return size_t 1 ~ 4
+ */
+inline size_t char_size(char lead)
+{
+    const unsigned char ch = static_cast<unsigned char>(lead);
+    // https://en.wikipedia.org/wiki/UTF-8#Description
+    if ((ch & 0xf8) == 0xf0)
+        return 4;
+    if ((ch & 0xf0) == 0xe0)
+        return 3;
+    if ((ch & 0xe0) == 0xc0)
+        return 2;
+    return 1;
+}
+
+size_t first_char_size(std::string_view words);
+size_t last_char_size(std::string_view words);
+std::string_view first_char(std::string_view words);
+std::string_view last_char(std::string_view words);
+size_t count_chars(std::string_view words);
+char32_t decode(std::string_view words, size_t &size);
+// Transcode, appending to out, so a buffer reused across calls does not allocate once it is large enough
+void append_utf16(std::string_view words, std::u16string &out);
+void append_utf8(std::u16string_view text, std::string &out);
+
+/**
+ * @brief Call fn with a view of each character in order
+ */
+template <typename Fn> void for_each_char(std::string_view words, Fn &&fn)
+{
+    size_t index = 0;
+    while (index < words.size())
+    {
+        size_t cplen = char_size(words[index]);
+        if (cplen > words.size() - index)
+            cplen = 1;
+        fn(words.substr(index, cplen));
+        index += cplen;
+    }
+}
+} // namespace Utf8Utils
@@ -0,0 +1,222 @@
+#include "warm_cache.h"
+#include "atomic_file.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+constexpr char kMagic[4] = {'M', 'S', 'W', 'C'};
+constexpr uint32_t kVersion = 1;
+
+template <typename T> void write_pod(std::ostream &file, T value)
+{
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> bool read_pod(std::ifstream &file, T &value)
+{
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+void write_string(std::ostream &file, std::string_view str)
+{
+    write_pod(file, static_cast<uint32_t>(str.size()));
+    file.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+bool read_string(std::ifstream &file, std::string &str)
+{
+    uint32_t size = 0;
+    if (!read_pod(file, size) || size > (1u << 16))
+    {
+        return false;
+    }
+    str.resize(size);
+    return static_cast<bool>(file.read(str.data(), size));
+}
+} // namespace
+
+/**
+ * @brief Read the entries written by save, nothing is kept if the file is missing, corrupt or stale
+ *
+ * @param path
+ * @param fingerprint Fingerprint of the dictionary the entries have to come from
+ * @return bool
+ */
+bool WarmCache::load(const std::string &path, uint64_t fingerprint)
+{
+    entries_.clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    uint64_t saved_fingerprint = 0;
+    file.read(magic, sizeof(magic));
+    if (!file || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || !read_pod(file, version) ||
+        version != kVersion || !read_pod(file, saved_fingerprint) || !read_pod(file, count))
+    {
+        return false;
+    }
+    if (saved_fingerprint != fingerprint)
+    {
+        spdlog::info("Warm cache {} was written for another dictionary, skipped.", path);
+        return false;
+    }
+    std::vector<Entry> entries(std::min<size_t>(count, kMaxEntries));
+    for (auto &entry : entries)
+    {
+        uint32_t rows = 0;
+        if (!read_string(file, entry.sequence) || !read_string(file, entry.segmentation) || !read_pod(file, rows) ||
+            rows > (1u << 16))
+        {
+            return false;
+        }
+        entry.candidates.resize(rows);
+        for (auto &[key, word, weight] : entry.candidates)
+        {
+            if (!read_string(file, key) || !read_string(file, word) || !read_pod(file, weight))
+            {
+                return false;
+            }
+        }
+    }
+    entries_ = std::move(entries);
+    for (const auto &entry : entries_)
+    {
+        restored_.insert(PackedKey(entry.sequence));
+    }
+    return true;
+}
+
+/**
+ * @brief Write the entries through AtomicFile, so that processes never read a half-written file
+ *
+ * @param path
+ * @param fingerprint
+ * @param entries
+ * @return bool
+ */
+bool WarmCache::save(const std::string &path, uint64_t fingerprint, const std::vector<Entry> &entries)
+{
+    return AtomicFile::replace(path, [&](std::ostream &file) {
+        file.write(kMagic, sizeof(kMagic));
+        write_pod(file, kVersion);
+        write_pod(file, fingerprint);
+        write_pod(file, static_cast<uint32_t>(entries.size()));
+        for (const auto &entry : entries)
+        {
+            write_string(file, entry.sequence);
+            write_string(file, entry.segmentation);
+            write_pod(file, static_cast<uint32_t>(entry.candidates.size()));
+            for (const auto &[key, word, weight] : entry.candidates)
+            {
+                write_string(file, key);
+                write_string(file, word);
+                write_pod(file, weight);
+            }
+        }
+        return static_cast<bool>(file);
+    });
+}
+
+const std::vector<WarmCache::Entry> &WarmCache::entries() const
+{
+    return entries_;
+}
+
+void WarmCache::release_entries()
+{
+    entries_.clear();
+    entries_.shrink_to_fit();
+}
+
+/**
+ * @brief Count a lookup, and log the hit rate once the first kLoggedLookups lookups are in
+ *
+ * @param key
+ * @param sequence
+ * @param segmentation
+ * @param hit
+ */
+void WarmCache::record_lookup(const PackedKey &key, std::string_view sequence, std::string_view segmentation, bool hit)
+{
+    auto it = tracked_.find(key);
+    if (it == tracked_.end())
+    {
+        if (tracked_.size() >= kMaxTracked)
+        {
+            age();
+        }
+        it = tracked_.emplace(key, Tracked{Code{std::string(sequence), std::string(segmentation)}, 0}).first;
+    }
+    ++it->second.lookups;
+
+    if (logged_lookups_ < kLoggedLookups)
+    {
+        ++logged_lookups_;
+        logged_hits_ += hit;
+        logged_restored_hits_ += hit && restored_.count(key);
+        if (logged_lookups_ == kLoggedLookups)
+        {
+            spdlog::info("Cache hit rate over the first {} lookups: {:.1f}%, {:.1f}% from {} restored entries.",
+                         kLoggedLookups, 100.0 * logged_hits_ / kLoggedLookups,
+                         100.0 * logged_restored_hits_ / kLoggedLookups, restored_.size());
+            restored_ = {};
+        }
+    }
+}
+
+std::vector<WarmCache::Code> WarmCache::hottest(size_t count) const
+{
+    std::vector<const Tracked *> order;
+    order.reserve(tracked_.size());
+    for (const auto &[key, tracked] : tracked_)
+    {
+        order.push_back(&tracked);
+    }
+    count = std::min(count, order.size());
+    std::partial_sort(order.begin(), order.begin() + count, order.end(),
+                      [](const Tracked *a, const Tracked *b) { return a->lookups > b->lookups; });
+    std::vector<Code> codes;
+    codes.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        codes.push_back(order[i]->code);
+    }
+    return codes;
+}
+
+/**
+ * @brief Forget the colder half of the tracked codes and halve the counts of the rest, so that old habits fade
+ *
+ */
+void WarmCache::age()
+{
+    std::vector<uint32_t> counts;
+    counts.reserve(tracked_.size());
+    for (const auto &[key, tracked] : tracked_)
+    {
+        counts.push_back(tracked.lookups);
+    }
+    std::nth_element(counts.begin(), counts.begin() + counts.size() / 2, counts.end());
+    const uint32_t median = counts[counts.size() / 2];
+    for (auto it = tracked_.begin(); it != tracked_.end();)
+    {
+        it = it->second.lookups < median ? tracked_.erase(it) : std::next(it);
+    }
+    /* 计数相同的码很多时，按中位数删不掉一半 */
+    for (auto it = tracked_.begin(); it != tracked_.end() && tracked_.size() > kMaxTracked / 2;)
+    {
+        it = it->second.lookups == median ? tracked_.erase(it) : std::next(it);
+    }
+    for (auto &[key, tracked] : tracked_)
+    {
+        tracked.lookups = (tracked.lookups + 1) / 2;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "packed_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Hottest pure pinyin cache entries, carried over to the next process
+ *
+ * Every host process starts with empty caches, so the user's most frequent codes would pay for SQL again in every
+ * app. The engine counts lookups per code, and from time to time writes the cached candidates of the hottest codes
+ * to a small versioned binary file. The file is tagged with a fingerprint of the dictionary it was built from, the
+ * system database and the user lexicon, and is only restored while the fingerprint matches.
+ *
+ * The first kLoggedLookups lookups after a restore are counted, and the hit rate is logged once together with the
+ * share served by restored entries.
+ */
+class WarmCache
+{
+  public:
+    static constexpr size_t kMaxEntries = 64;
+    static constexpr size_t kMaxTracked = 512;
+    static constexpr size_t kLoggedLookups = 200;
+
+    using WordItem = std::tuple<std::string, std::string, int>;
+
+    struct Entry
+    {
+        std::string sequence;
+        std::string segmentation;
+        std::vector<WordItem> candidates;
+    };
+
+    struct Code
+    {
+        std::string sequence;
+        std::string segmentation;
+    };
+
+    // Restore the entries of path if it was written for the same dictionary, they stay in entries() until released
+    bool load(const std::string &path, uint64_t fingerprint);
+    static bool save(const std::string &path, uint64_t fingerprint, const std::vector<Entry> &entries);
+
+    const std::vector<Entry> &entries() const;
+    void release_entries();
+
+    // Count a lookup of the pure pinyin cache
+    void record_lookup(const PackedKey &key, std::string_view sequence, std::string_view segmentation, bool hit);
+    // The most looked-up codes, hottest first
+    std::vector<Code> hottest(size_t count) const;
+
+  private:
+    struct Tracked
+    {
+        Code code;
+        uint32_t lookups;
+    };
+
+    void age();
+
+  private:
+    std::vector<Entry> entries_;
+    std::unordered_map<PackedKey, Tracked> tracked_;
+    std::unordered_set<PackedKey> restored_; // Keys restored from the file, until the hit rate is logged
+    size_t logged_lookups_ = 0;
+    size_t logged_hits_ = 0;
+    size_t logged_restored_hits_ = 0;
+};
@@ -0,0 +1,211 @@
+//
+// 对比分表布局和单表 without rowid 布局的查询计划和延迟，覆盖全拼、简拼和带一个简拼的通配查询三种形状。
+// 单表库不存在时先从分表库迁移一份。
+//
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "shuangpin/dictionary_schema.h"
+
+using namespace std;
+
+struct Sample
+{
+    string key;
+    string jp;
+};
+
+enum class Shape
+{
+    Exact,
+    Jianpin,
+    Wildcard,
+};
+
+sqlite3 *open_db(const string &path)
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        fmt::println("Failed to open {}: {}", path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return nullptr;
+    }
+    DictionarySchema::apply_connection_pragmas(db);
+    return db;
+}
+
+// A few random codes of every table, so all lengths and initials are represented
+vector<Sample> collect_samples(sqlite3 *db, size_t per_table)
+{
+    vector<string> tables;
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, "select name from sqlite_master where type = 'table' and name like 'tbl_%';", -1, &stmt, 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        tables.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+
+    vector<Sample> samples;
+    for (const auto &table : tables)
+    {
+        const string sql = fmt::format("select key, jp from {} order by random() limit {};", table, per_table);
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            samples.push_back(Sample{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)),
+                                     reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1))});
+        }
+        sqlite3_finalize(stmt);
+    }
+    return samples;
+}
+
+// Same shapes and table choice as DictionaryUlPb::build_sql
+string build_query(const Sample &sample, Shape shape, bool unified)
+{
+    const size_t word_len = sample.jp.size();
+    const string table = unified ? string(DictionarySchema::kUnifiedTable)
+                                 : fmt::format("tbl_{}_{}", word_len >= 8 ? "others" : to_string(word_len),
+                                               sample.key[0]);
+    switch (shape)
+    {
+    case Shape::Exact:
+        return fmt::format("select {} from {} where key = '{}' order by weight desc limit 80;",
+                           DictionarySchema::kColumns, table, sample.key);
+    case Shape::Jianpin:
+        return fmt::format("select {} from {} where jp = '{}' order by weight desc limit 80;",
+                           DictionarySchema::kColumns, table, sample.jp);
+    case Shape::Wildcard: {
+        string pattern = sample.key;
+        pattern[pattern.size() - 1] = unified ? '?' : '_'; // Last syllable typed as jianpin
+        return fmt::format("select {} from {} where key {} '{}' order by weight desc limit 80;",
+                           DictionarySchema::kColumns, table, unified ? "glob" : "like", pattern);
+    }
+    }
+    return "";
+}
+
+void print_plan(sqlite3 *db, const string &sql)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, ("explain query plan " + sql).c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        fmt::println("    {}", sqlite3_errmsg(db));
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        fmt::println("    {}", reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3)));
+    }
+    sqlite3_finalize(stmt);
+}
+
+vector<double> measure(sqlite3 *db, const vector<string> &queries, int rounds, size_t &rows)
+{
+    vector<double> samples;
+    samples.reserve(queries.size() * rounds);
+    rows = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (const auto &sql : queries)
+        {
+            auto start = chrono::steady_clock::now();
+            sqlite3_stmt *stmt;
+            sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                rows += round == 0;
+            }
+            sqlite3_finalize(stmt);
+            auto end = chrono::steady_clock::now();
+            samples.push_back(chrono::duration<double, micro>(end - start).count());
+        }
+    }
+    return samples;
+}
+
+void report(const string &name, vector<double> &samples, size_t rows)
+{
+    sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double sample : samples)
+    {
+        total += sample;
+    }
+    fmt::println("  {:<8} mean {:>8.1f} us  p50 {:>8.1f} us  p99 {:>8.1f} us  rows {}", name, total / samples.size(),
+                 samples[samples.size() / 2], samples[samples.size() * 99 / 100], rows);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fmt::println("Usage: {} <sharded.db> <unified.db>", argv[0]);
+        return 2;
+    }
+    const string sharded_path = argv[1];
+    const string unified_path = argv[2];
+    const int rounds = 20;
+    if (!filesystem::exists(unified_path))
+    {
+        DictionarySchema::MigrationStats stats;
+        if (!DictionarySchema::migrate(sharded_path, unified_path, stats))
+        {
+            return 1;
+        }
+    }
+
+    sqlite3 *sharded = open_db(sharded_path);
+    sqlite3 *unified = open_db(unified_path);
+    if (!sharded || !unified)
+    {
+        return 1;
+    }
+    const vector<Sample> samples = collect_samples(sharded, 20);
+    fmt::println("{} sampled codes, {} rounds", samples.size(), rounds);
+
+    const pair<Shape, const char *> shapes[] = {
+        {Shape::Exact, "exact"},
+        {Shape::Jianpin, "jianpin"},
+        {Shape::Wildcard, "wildcard"},
+    };
+    for (const auto &[shape, name] : shapes)
+    {
+        vector<string> sharded_queries;
+        vector<string> unified_queries;
+        for (const auto &sample : samples)
+        {
+            if (shape == Shape::Wildcard && sample.jp.size() < 2)
+            {
+                continue; // A single syllable typed as jianpin is a jianpin query
+            }
+            sharded_queries.push_back(build_query(sample, shape, false));
+            unified_queries.push_back(build_query(sample, shape, true));
+        }
+        if (sharded_queries.empty())
+        {
+            continue;
+        }
+        fmt::println("==== {} ====", name);
+        fmt::println("  sharded plan:");
+        print_plan(sharded, sharded_queries.front());
+        fmt::println("  unified plan:");
+        print_plan(unified, unified_queries.front());
+        size_t sharded_rows = 0;
+        size_t unified_rows = 0;
+        auto sharded_samples = measure(sharded, sharded_queries, rounds, sharded_rows);
+        auto unified_samples = measure(unified, unified_queries, rounds, unified_rows);
+        report("sharded", sharded_samples, sharded_rows);
+        report("unified", unified_samples, unified_rows);
+    }
+
+    sqlite3_close(sharded);
+    sqlite3_close(unified);
+    return 0;
+}
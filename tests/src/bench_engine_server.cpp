@@ -0,0 +1,126 @@
+//
+// 对比进程内查询和引擎服务模式的延迟，同时检查两种模式返回的候选一致。
+//
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "server/engine_server.h"
+#include "providers/remote_candidate_provider.h"
+#ifdef _WIN32
+#include "providers/provider_registry.h"
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+// Stands in for the dictionary where the engine is not available, 80 candidates per query like a full page
+class SyntheticProvider : public ICandidateProvider
+{
+  public:
+    vector<WordItem> query(const QueryRequest &request) override
+    {
+        vector<WordItem> result;
+        for (int i = 0; i < 80; ++i)
+        {
+            result.emplace_back(request.normalized_input, fmt::format("候选词{}", i), 10000 - i);
+        }
+        return result;
+    }
+    void reset_cache() override
+    {
+    }
+};
+#endif
+
+QueryRequest make_request(const string &input)
+{
+    QueryRequest request;
+    request.scheme = SchemeType::Shuangpin;
+    request.raw_input = input;
+    request.normalized_input = input;
+    request.valid = true;
+    for (char c : input)
+    {
+        request.key_strokes.push_back(KeyStroke{static_cast<UINT>(c - 'a' + 'A'), 0, static_cast<WCHAR>(c)});
+    }
+    return request;
+}
+
+void report(const string &name, vector<double> &samples)
+{
+    sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double sample : samples)
+    {
+        total += sample;
+    }
+    fmt::println("{:<12} mean {:>8.1f} us  p50 {:>8.1f} us  p99 {:>8.1f} us", name, total / samples.size(),
+                 samples[samples.size() / 2], samples[samples.size() * 99 / 100]);
+}
+
+template <typename Provider> vector<double> measure(Provider &provider, const vector<QueryRequest> &requests, int rounds)
+{
+    vector<double> samples;
+    samples.reserve(requests.size() * rounds);
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (const auto &request : requests)
+        {
+            auto start = chrono::steady_clock::now();
+            auto result = provider.query(request);
+            auto end = chrono::steady_clock::now();
+            samples.push_back(chrono::duration<double, micro>(end - start).count());
+        }
+    }
+    return samples;
+}
+
+int main(int argc, char *argv[])
+{
+    const string default_path = EngineProtocol::default_socket_path();
+    const string socket_path = argc > 1 ? argv[1] : default_path.empty() ? string() : default_path + ".bench";
+    const int rounds = 200;
+#ifdef _WIN32
+    ProviderRegistry provider_registry(ProviderRegistry::EngineMode::InProcess);
+    ICandidateProvider &local = provider_registry.resolve(SchemeType::Shuangpin);
+#else
+    SyntheticProvider local;
+#endif
+
+    EngineServer server(socket_path, [&local](SchemeType) -> ICandidateProvider & { return local; });
+    if (!server.open())
+    {
+        return 1;
+    }
+    thread server_thread([&server]() { server.run(); });
+    RemoteCandidateProvider remote(socket_path);
+
+    vector<QueryRequest> requests;
+    for (const string input : {"ni", "nihk", "nihkma", "wodeuiji", "jintmktmfp"})
+    {
+        requests.push_back(make_request(input));
+    }
+
+    int status = 0;
+    for (const auto &request : requests)
+    {
+        if (local.query(request) != remote.query(request))
+        {
+            fmt::println("Mismatch between in-process and server results for {}", request.normalized_input);
+            status = 1;
+        }
+    }
+
+    auto in_process = measure(local, requests, rounds);
+    auto server_mode = measure(remote, requests, rounds);
+    report("in-process", in_process);
+    report("server", server_mode);
+
+    server.stop();
+    server_thread.join();
+    return status;
+}
@@ -0,0 +1,222 @@
+//
+// 批量导入的吞吐量：生成一份词表，其中一部分是词库里已有的词，分别用逐条造词的方式（查重、逐行写日志并刷盘）
+// 和 LexiconImporter 导入到两份空的用户词库里，系统词库只读打开，输出每秒行数。
+//
+#include <fmt/core.h>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "shuangpin/dictionary_schema.h"
+#include "shuangpin/lexicon_importer.h"
+#include "shuangpin/pinyin_utils.h"
+#include "shuangpin/user_lexicon.h"
+
+using namespace std;
+
+struct Word
+{
+    string value;
+    string quanpin; // ni'hao
+    int weight;
+};
+
+string encode_utf8(char32_t cp)
+{
+    string out;
+    out += static_cast<char>(0xE0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+    return out;
+}
+
+// Random words, plus some rows already in the database so that updates are exercised too
+vector<Word> generate_lexicon(sqlite3 *db, size_t count)
+{
+    mt19937 rng(42);
+    const auto tables = PinyinUtil::tables();
+    vector<string> syllables;
+    for (size_t id = 0; id < tables->syllables.size(); ++id)
+    {
+        syllables.push_back(tables->syllables.spelling(static_cast<int>(id)));
+    }
+
+    vector<string> tables_in_db;
+    sqlite3_stmt *stmt;
+    if (DictionarySchema::detect(db) == DictionarySchema::Layout::Unified)
+    {
+        tables_in_db.push_back(DictionarySchema::kUnifiedTable);
+    }
+    else
+    {
+        sqlite3_prepare_v2(db, "select name from sqlite_master where type = 'table' and name like 'tbl_%';", -1, &stmt,
+                           0);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            tables_in_db.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    vector<Word> words;
+    for (const auto &table : tables_in_db)
+    {
+        const string sql = fmt::format("select key, value, weight from {} order by random() limit {};", table,
+                                       count / 10 / tables_in_db.size() + 1);
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const string key = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            string quanpin;
+            for (size_t i = 0; i + 1 < key.size(); i += 2)
+            {
+                quanpin += (quanpin.empty() ? "" : "'") + PinyinUtil::cvt_single_sp_to_pinyin(key.substr(i, 2));
+            }
+            const int bump = static_cast<int>(rng() % 2) * 1000; // Half of them raise the weight
+            words.push_back(Word{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)), quanpin,
+                                 sqlite3_column_int(stmt, 2) + bump});
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    while (words.size() < count)
+    {
+        const size_t len = 2 + rng() % 3;
+        Word word{"", "", static_cast<int>(rng() % 20000)};
+        for (size_t i = 0; i < len; ++i)
+        {
+            word.value += encode_utf8(static_cast<char32_t>(0x4E00 + rng() % 0x5000));
+            word.quanpin += (i == 0 ? "" : "'") + syllables[rng() % syllables.size()];
+        }
+        words.push_back(std::move(word));
+    }
+    shuffle(words.begin(), words.end(), rng);
+    return words;
+}
+
+// One word at a time like create_word: existence check in both layers, then one flushed journal line
+size_t import_row_by_row(sqlite3 *db, UserLexicon &lexicon, const vector<Word> &words)
+{
+    const bool unified = DictionarySchema::detect(db) == DictionarySchema::Layout::Unified;
+    size_t inserted = 0;
+    for (const auto &word : words)
+    {
+        string key;
+        string jp;
+        size_t pos = 0;
+        while (pos <= word.quanpin.size())
+        {
+            size_t next = word.quanpin.find('\'', pos);
+            next = next == string::npos ? word.quanpin.size() : next;
+            key += PinyinUtil::convert_complete_pinyin_to_shuangpin(word.quanpin.substr(pos, next - pos));
+            pos = next + 1;
+        }
+        for (size_t i = 0; i < key.size(); i += 2)
+        {
+            jp += key[i];
+        }
+        const string table = unified ? string(DictionarySchema::kUnifiedTable)
+                                     : fmt::format("tbl_{}_{}", jp.size() >= 8 ? "others" : to_string(jp.size()),
+                                                   key[0]);
+        sqlite3_stmt *stmt;
+        const string check = fmt::format("select 1 from {} where key = '{}' and value = '{}';", table, key, word.value);
+        sqlite3_prepare_v2(db, check.c_str(), -1, &stmt, 0);
+        const bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        if (exists || lexicon.state(key, word.value) == UserLexicon::State::Added)
+        {
+            continue;
+        }
+        lexicon.add(key, word.value, word.weight);
+        ++inserted;
+    }
+    return inserted;
+}
+
+sqlite3 *open_readonly(const string &path)
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        fmt::println("Failed to open {}: {}", path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return nullptr;
+    }
+    DictionarySchema::apply_connection_pragmas(db);
+    return db;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fmt::println("Usage: {} <dictionary.db> [rows]", argv[0]);
+        return 2;
+    }
+    const string db_path = argv[1];
+    const size_t rows = argc > 2 ? stoul(argv[2]) : 500000;
+    const size_t row_by_row_sample = min<size_t>(rows, 2000);
+    const string lexicon_path = db_path + ".lexicon.txt";
+    const string bulk_path = db_path + ".bulk.journal";
+    const string row_by_row_path = db_path + ".rowbyrow.journal";
+    filesystem::remove(bulk_path);
+    filesystem::remove(row_by_row_path);
+
+    sqlite3 *db = open_readonly(db_path);
+    if (!db)
+    {
+        return 1;
+    }
+    const vector<Word> words = generate_lexicon(db, rows);
+    {
+        FILE *file = fopen(lexicon_path.c_str(), "wb");
+        for (const auto &word : words)
+        {
+            fmt::print(file, "{}\t{}\t{}\n", word.value, word.quanpin, word.weight);
+        }
+        fclose(file);
+    }
+    fmt::println("{} words in {}", words.size(), lexicon_path);
+
+    LexiconImporter::Stats again;
+    { /* 日志文件在用户词库关闭后才能删除 */
+        UserLexicon bulk_lexicon;
+        UserLexicon row_lexicon;
+        if (!bulk_lexicon.load(bulk_path) || !row_lexicon.load(row_by_row_path))
+        {
+            sqlite3_close(db);
+            return 1;
+        }
+
+        auto start = chrono::steady_clock::now();
+        const vector<Word> sample(words.begin(), words.begin() + row_by_row_sample);
+        const size_t inserted = import_row_by_row(db, row_lexicon, sample);
+        const double row_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        fmt::println("row by row  {:>8} words  {:>8} inserted  {:>10.0f} rows/s", sample.size(), inserted,
+                     sample.size() / row_seconds);
+
+        LexiconImporter importer(db, DictionarySchema::detect(db), bulk_lexicon);
+        LexiconImporter::Stats stats;
+        if (!importer.import_files({lexicon_path}, stats))
+        {
+            sqlite3_close(db);
+            return 1;
+        }
+        fmt::println("bulk        {:>8} words  {:>8} inserted  {:>10.0f} rows/s  (parse {:.0f} ms, write {:.0f} ms)",
+                     stats.lines, stats.inserted, stats.rows_per_second(), stats.parse_ms, stats.write_ms);
+        fmt::println("            {} updated, {} unchanged, {} duplicates, {} rejected", stats.updated,
+                     stats.unchanged, stats.duplicates, stats.rejected);
+
+        /* 同一份词表再导一次不应有任何写入 */
+        importer.import_files({lexicon_path}, again);
+        fmt::println("re-import   {} inserted, {} updated", again.inserted, again.updated);
+    }
+
+    sqlite3_close(db);
+    filesystem::remove(bulk_path);
+    filesystem::remove(row_by_row_path);
+    filesystem::remove(lexicon_path);
+    return again.inserted == 0 && again.updated == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+//
+// 对比 SQLite 词库（DictionaryUlPb 用的快照：连接、页缓存、过滤器和 key 索引）和 CompactDictionary 的内存占用，
+// 顺带用同一批编码对比首页候选的延迟，并检查两边给出的首页是否一致。
+// 紧凑词库用 dict_compact 从同一个数据库生成。
+//
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "shuangpin/compact_dictionary.h"
+#include "shuangpin/dictionary_schema.h"
+#include "shuangpin/dictionary_snapshot.h"
+
+using namespace std;
+
+constexpr size_t kPageSize = 80; // DictionaryUlPb::default_candicate_page_limit
+
+struct Sample
+{
+    string key;
+    string jp;
+};
+
+struct Page
+{
+    vector<string> values;
+    vector<int> weights;
+};
+
+vector<Sample> collect_samples(sqlite3 *db, bool unified, size_t count)
+{
+    vector<Sample> samples;
+    sqlite3_stmt *stmt;
+    const string sql = unified ? fmt::format("select key, jp from {} order by random() limit {};",
+                                             DictionarySchema::kUnifiedTable, count)
+                               : "select name from sqlite_master where type = 'table' and name like 'tbl_%';";
+    vector<string> tables;
+    sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        if (unified)
+        {
+            samples.push_back(Sample{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)),
+                                     reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1))});
+        }
+        else
+        {
+            tables.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+        }
+    }
+    sqlite3_finalize(stmt);
+    for (const auto &table : tables)
+    {
+        const string table_sql =
+            fmt::format("select key, jp from {} order by random() limit {};", table, count / tables.size() + 1);
+        sqlite3_prepare_v2(db, table_sql.c_str(), -1, &stmt, 0);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            samples.push_back(Sample{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)),
+                                     reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1))});
+        }
+        sqlite3_finalize(stmt);
+    }
+    return samples;
+}
+
+// Same table choice as DictionaryUlPb::choose_tbl
+Page query_sqlite(sqlite3 *db, bool unified, const Sample &sample, bool jianpin)
+{
+    const size_t word_len = sample.jp.size();
+    const string table = unified ? string(DictionarySchema::kUnifiedTable)
+                                 : fmt::format("tbl_{}_{}", word_len >= 8 ? "others" : to_string(word_len),
+                                               sample.key[0]);
+    const string sql = fmt::format("select {} from {} where {} = '{}' order by weight desc limit {};",
+                                   DictionarySchema::kColumns, table, jianpin ? "jp" : "key",
+                                   jianpin ? sample.jp : sample.key, kPageSize);
+    Page page;
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        page.values.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)));
+        page.weights.push_back(sqlite3_column_int(stmt, 3));
+    }
+    sqlite3_finalize(stmt);
+    return page;
+}
+
+Page query_compact(const CompactDictionary &dict, const Sample &sample, bool jianpin)
+{
+    Page page;
+    const auto hits = jianpin ? dict.lookup_jianpin(sample.jp, 0, kPageSize) : dict.lookup(sample.key, 0, kPageSize);
+    for (const auto &hit : hits)
+    {
+        page.values.emplace_back(hit.value);
+        page.weights.push_back(hit.weight);
+    }
+    return page;
+}
+
+// Rows of equal weight may come in any order, so pages are compared as sorted lists, weights up to quantization
+bool same_page(Page a, Page b)
+{
+    if (a.values.size() != b.values.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.weights.size(); ++i)
+    {
+        if (abs(a.weights[i] - b.weights[i]) > max(1, a.weights[i] / 1000))
+        {
+            return false;
+        }
+    }
+    sort(a.values.begin(), a.values.end());
+    sort(b.values.begin(), b.values.end());
+    return a.values == b.values;
+}
+
+string kib(size_t bytes)
+{
+    return fmt::format("{:>10.1f} KiB", bytes / 1024.0);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fmt::println("Usage: {} <dictionary.db> <dictionary.compact>", argv[0]);
+        return 2;
+    }
+    const string db_path = argv[1];
+    const string compact_path = argv[2];
+
+    /* SQLite 侧：和 DictionaryUlPb 预热完成后一样，带索引的快照加上热门编码的页 */
+    const sqlite3_int64 heap_before = sqlite3_memory_used();
+    auto snapshot = DictionarySnapshot::open(db_path, 1, nullptr, kPageSize);
+    if (!snapshot->ok())
+    {
+        return 1;
+    }
+    snapshot->prefetch_hot_keys(kPageSize);
+    const bool unified = snapshot->layout() == DictionarySchema::Layout::Unified;
+    const vector<Sample> samples = collect_samples(snapshot->db(), unified, 2000);
+
+    CompactDictionary dict;
+    if (!dict.open(compact_path))
+    {
+        fmt::println("Failed to open {}, build it with dict_compact first", compact_path);
+        return 1;
+    }
+
+    double sqlite_us = 0;
+    double compact_us = 0;
+    size_t mismatches = 0;
+    for (const bool jianpin : {false, true})
+    {
+        for (const auto &sample : samples)
+        {
+            auto start = chrono::steady_clock::now();
+            const Page expected = query_sqlite(snapshot->db(), unified, sample, jianpin);
+            auto middle = chrono::steady_clock::now();
+            const Page actual = query_compact(dict, sample, jianpin);
+            auto end = chrono::steady_clock::now();
+            sqlite_us += chrono::duration<double, micro>(middle - start).count();
+            compact_us += chrono::duration<double, micro>(end - middle).count();
+            mismatches += same_page(expected, actual) ? 0 : 1;
+        }
+    }
+    const size_t sqlite_heap = static_cast<size_t>(sqlite3_memory_used() - heap_before);
+    const size_t sqlite_highwater = static_cast<size_t>(sqlite3_memory_highwater(0));
+    const size_t filter = snapshot->key_filter().memory_usage();
+    const size_t index = snapshot->key_index().memory_usage();
+    const size_t db_size = filesystem::file_size(db_path);
+
+    fmt::println("{} sampled codes, exact and jianpin, page size {}", samples.size(), kPageSize);
+    fmt::println("==== SQLite ({}) ====", unified ? "unified" : "sharded");
+    fmt::println("  sqlite heap       {}  (highwater {})", kib(sqlite_heap), kib(sqlite_highwater));
+    fmt::println("  key filter        {}", kib(filter));
+    fmt::println("  key index         {}", kib(index));
+    fmt::println("  private total     {}", kib(sqlite_heap + filter + index));
+    fmt::println("  database file     {}  (mapped up to {} KiB, shared)", kib(db_size),
+                 DictionarySchema::kMmapSize / 1024);
+
+    const auto footprint = dict.footprint();
+    fmt::println("==== Compact ({} entries, {} keys) ====", dict.entry_count(), dict.key_count());
+    fmt::println("  keys              {}", kib(footprint.keys));
+    fmt::println("  key starts        {}", kib(footprint.key_starts));
+    fmt::println("  value ids         {}", kib(footprint.values));
+    fmt::println("  weights           {}", kib(footprint.weights));
+    fmt::println("  string pool       {}", kib(footprint.pool));
+    fmt::println("  jianpin           {}", kib(footprint.jianpin));
+    fmt::println("  private total     {}", kib(0));
+    fmt::println("  mapped file       {}  (shared, faulted in per page)", kib(footprint.total));
+
+    const size_t queries = samples.size() * 2;
+    fmt::println("==== First page ====");
+    fmt::println("  sqlite  mean {:>8.1f} us", sqlite_us / queries);
+    fmt::println("  compact mean {:>8.1f} us", compact_us / queries);
+    fmt::println("  {} of {} pages differ", mismatches, queries);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -4,11 +4,47 @@
 #include <Windows.h>
 #include <fmt/core.h>
 #include "fmt/base.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <thread>
 #include "core/ime_session.h"
+#include "providers/association_provider.h"
+#include "providers/candidate_merger.h"
+#include "providers/pinyin_candidate_provider.h"
+#include "schemes/shuangpin_scheme.h"
+#include "shuangpin/cache_dependency_index.h"
 
 using namespace std;
 
+/* 统计全局堆分配次数，用来检查按键热路径上还剩下多少次堆分配 */
+static std::atomic<size_t> global_allocations{0};
+
+void *operator new(size_t size)
+{
+    ++global_allocations;
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
 void print_candidates(const std::vector<WordItem> &result)
 {
     for (const auto &[code, word, weight] : result)
@@ -17,6 +53,28 @@ void print_candidates(const std::vector<WordItem> &result)
     }
 }
 
+/* 临时的用户数据目录，选词频率、用户词库和热缓存写在这里，不碰真实的用户数据；要在词库实例之前构造 */
+struct TestUserDir
+{
+    explicit TestUserDir(const string &name)
+        : path(std::filesystem::temp_directory_path() / ("metasequoia_test_" + name))
+    {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TestUserDir()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+    }
+    string str() const
+    {
+        return path.string();
+    }
+
+    std::filesystem::path path;
+};
+
 void feed_sequence(ImeSession &session, const vector<UINT> &sequence, const vector<WCHAR> &wch_sequence = {})
 {
     for (int i = 0; i < sequence.size(); ++i)
@@ -83,11 +141,420 @@ void test_dynamic_switch()
     print_candidates(session.get_candidates());
 }
 
+void test_key_burst()
+{
+    ImeSession session(SchemeType::Shuangpin);
+    const vector<KeyStroke> burst{{'C', 0, 'c'}, {'E', 0, 'e'}, {'L', 0, 'l'}, {'I', 0, 'i'}, {'U', 0, 'u'}, {'I', 0, 'i'}};
+
+    fmt::println("==== Key Burst ====");
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    session.handle_keys(burst);
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    fmt::println("Preedit: {}", session.get_preedit());
+    fmt::println("Time: {} us", duration.count());
+    print_candidates(session.get_candidates());
+
+    fmt::println("==== Adaptive Coalescing ====");
+    session.reset();
+    session.set_coalesce_threshold(std::chrono::milliseconds(30));
+    feed_sequence(session, {'N', 'I', 'H', 'K'}, {'n', 'i', 'h', 'k'});
+    fmt::println("Pending refresh: {}", session.has_pending_refresh());
+    session.flush();
+    print_candidates(session.get_candidates());
+}
+
+void test_association()
+{
+    fmt::println("==== Association ====");
+    const string table_path = "bigram_test.dat";
+    BigramTable::build(
+        {
+            {"我们", "一起", 30},
+            {"我们", "的", 120},
+            {"我们", "都是", 45},
+            {"们", "的", 10},
+            {"一起", "努力", 80},
+        },
+        table_path);
+
+    AssociationProvider provider(table_path);
+    QueryRequest request;
+    request.context = "我们";
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    auto result = provider.query(request);
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    fmt::println("Time: {} us", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    print_candidates(result);
+
+    request.context = "他们";
+    fmt::println("Back off to last char:");
+    print_candidates(provider.query(request));
+
+    /* A copy whose first word points past the text pool must be rejected */
+    const string corrupted_path = "bigram_test_corrupted.dat";
+    {
+        std::ifstream in(table_path, std::ios::binary);
+        string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const uint32_t text_offset = 0xffffff00u;
+        std::memcpy(&bytes[24 + 8], &text_offset, sizeof(text_offset)); // Header, then WordEntry::hash
+        std::ofstream(corrupted_path, std::ios::binary | std::ios::trunc) << bytes;
+    }
+    BigramTable corrupted;
+    fmt::println("Corrupted table opened: {}", corrupted.open(corrupted_path));
+}
+
+/* 固定返回一张列表的来源，用来检查合并的顺序和去重 */
+class FixedProvider : public ICandidateProvider
+{
+  public:
+    explicit FixedProvider(vector<WordItem> list) : list_(std::move(list))
+    {
+    }
+    vector<WordItem> query(const QueryRequest &) override
+    {
+        return list_;
+    }
+    void reset_cache() override
+    {
+    }
+
+  private:
+    vector<WordItem> list_;
+};
+
+void test_candidate_merger()
+{
+    fmt::println("==== Candidate Merger ====");
+    QueryRequest request;
+    request.valid = true;
+
+    /* 造词后插进序列缓存的词，全码的结果里又出现了一次 */
+    FixedProvider pinyin({{"nihk", "你好", 1}, {"nihk", "拟好", 1}, {"nihk", "你好", 100}, {"ni", "你", 50}});
+    CandidateMerger single;
+    single.add_source(pinyin);
+    fmt::println("Single source:");
+    print_candidates(single.query(request));
+
+    FixedProvider other({{"nihk", "你好", 1}, {"nihk", "泥壕", 1}});
+    CandidateMerger merger(4);
+    merger.add_source(pinyin, 1.0);
+    merger.add_source(other, 0.5);
+    fmt::println("Two sources, limit 4:");
+    print_candidates(merger.query(request));
+}
+
+void test_dictionary_reload()
+{
+    fmt::println("==== Dictionary Reload ====");
+    ImeSession session(SchemeType::Shuangpin);
+    feed_sequence(session, {'N', 'I'}, {'n', 'i'});
+    /* 启动时的预热也算一次加载，等它完成才能再开始一次 */
+    while (session.is_reloading_dictionary())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    fmt::println("Reload started: {}", session.reload_dictionary());
+    /* Keys typed during the reload are served by the old snapshot */
+    feed_sequence(session, {'H', 'K'}, {'h', 'k'});
+    print_candidates(session.get_candidates());
+    while (session.is_reloading_dictionary())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    session.reset();
+    feed_sequence(session, {'N', 'I', 'H', 'K'}, {'n', 'i', 'h', 'k'});
+    print_candidates(session.get_candidates());
+}
+
+void test_warm_up()
+{
+    fmt::println("==== Warm-up ====");
+    TestUserDir user_dir("warm_up");
+    auto start = std::chrono::steady_clock::now();
+    DictionaryUlPb dict(user_dir.str());
+    dict.handleVkCode('N', 0);
+    dict.handleVkCode('I', 0);
+    auto first_key = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    fmt::println("First candidates after {} ms while warming: {}", first_key.count(),
+                 dict.get_cur_candiate_list().size());
+    while (dict.readiness() == DictionaryUlPb::Readiness::Warming)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto ready = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    fmt::println("Ready after {} ms: {}", ready.count(), dict.readiness() == DictionaryUlPb::Readiness::Ready);
+}
+
+void test_allocations()
+{
+    fmt::println("==== Allocations per key ====");
+    TestUserDir user_dir("allocations");
+    DictionaryUlPb dict(user_dir.str());
+    const vector<UINT> sequence{'N', 'I', 'H', 'K', 'M', 'A'};
+    /* 第一遍填充缓存，第二遍是稳定状态 */
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        dict.reset_state();
+        for (UINT vk : sequence)
+        {
+            const size_t before = global_allocations;
+            dict.handleVkCode(vk, 0);
+            fmt::println("Pass {} key {}: {} heap allocations, {} candidates", pass, static_cast<char>(vk),
+                         global_allocations - before, dict.get_cur_candiate_list().size());
+        }
+    }
+    const auto &stats = dict.get_key_arena_stats();
+    fmt::println("Key arena: {} keys, {} overflow allocations ({} bytes)", stats.keys, stats.overflow_allocations,
+                 stats.overflow_bytes);
+}
+
+void test_long_input()
+{
+    fmt::println("==== Long input ====");
+    /* 和 ImeSession 一样，每个按键都由 scheme 生成请求，provider 重置状态后重放整个输入 */
+    ShuangpinScheme scheme;
+    PinyinCandidateProvider provider;
+    const string keys = "woxihrhuanzheyigecuzifajmfvuuazhqhezhenggedoufeichangshuzvnihkshijieyiqieshunli";
+    vector<WordItem> candidates;
+    size_t decoded_before = 0;
+    for (size_t i = 0; i < keys.size() * 3; ++i)
+    {
+        const UINT vk = static_cast<UINT>(keys[i % keys.size()] - ('a' - 'A'));
+        auto start = std::chrono::steady_clock::now();
+        scheme.handle_key(vk, 0, 0);
+        candidates = provider.query(scheme.build_request());
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        if ((i + 1) % 40 == 0)
+        {
+            /* 每 40 个按键解码的音节数应当大致不变，而不是随输入长度增长 */
+            const size_t decoded = provider.sentence_stream_stats().decoded_syllables;
+            fmt::println("Key {}: {} us, {} syllables decoded in the last 40 keys", i + 1, elapsed.count(),
+                         decoded - decoded_before);
+            decoded_before = decoded;
+        }
+    }
+    if (!candidates.empty())
+    {
+        fmt::println("Sentence: {}", std::get<1>(candidates.front()));
+    }
+}
+
+void test_parallel_series()
+{
+    fmt::println("==== Parallel prefix queries ====");
+    TestUserDir user_dir("parallel_series");
+    DictionaryUlPb dict(user_dir.str());
+    while (dict.readiness() == DictionaryUlPb::Readiness::Warming)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    /* 每个按键都有好几个没缓存的前缀，这些查询在线程池里并行 */
+    const string keys = "zhongguorenminjiefangjun";
+    long long slowest = 0;
+    for (char key : keys)
+    {
+        auto start = std::chrono::steady_clock::now();
+        dict.handleVkCode(static_cast<UINT>(key - ('a' - 'A')), 0);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        slowest = std::max<long long>(slowest, elapsed.count());
+    }
+    fmt::println("Slowest key: {} us, {} candidates", slowest, dict.get_cur_candiate_list().size());
+}
+
+void test_progressive_refresh()
+{
+    fmt::println("==== Progressive refresh ====");
+    ImeSession session(SchemeType::Shuangpin);
+    size_t updates = 0;
+    session.set_update_callback([&updates]() { ++updates; });
+    /* 预算很紧，首屏只有全码的结果，前缀和整句等到 refine */
+    session.set_latency_budget(std::chrono::microseconds(1));
+    feed_sequence(session, {'W', 'O', 'M', 'F', 'D', 'E'});
+    fmt::println("First page: {} candidates, pending refinement: {}", session.get_candidates().size(),
+                 session.has_pending_refinement());
+    session.refine();
+    fmt::println("Refined: {} candidates, {} updates", session.get_candidates().size(), updates);
+    session.set_latency_budget(std::chrono::microseconds(0));
+}
+
+void test_user_lexicon()
+{
+    fmt::println("==== User lexicon ====");
+    TestUserDir user_dir("user_lexicon");
+    {
+        DictionaryUlPb dict(user_dir.str());
+        while (dict.readiness() == DictionaryUlPb::Readiness::Warming)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        auto count = [&dict](const string &word) {
+            const auto candidates = dict.generate("nihk", "ni'hk");
+            return std::count_if(candidates.begin(), candidates.end(),
+                                 [&word](const auto &cand) { return std::get<1>(cand) == word; });
+        };
+        auto weight_of = [&dict](const string &word) {
+            const auto candidates = dict.generate("nihk", "ni'hk");
+            const auto it = std::find_if(candidates.begin(), candidates.end(),
+                                         [&word](const auto &cand) { return std::get<1>(cand) == word; });
+            return it == candidates.end() ? -1 : std::get<2>(*it);
+        };
+        /* 新词和删词都只进用户层，系统词库不变 */
+        dict.create_word("nihk", "拟好看");
+        fmt::println("Created: {}", count("拟好看"));
+        dict.delete_by_pinyin_and_word("nihk", "拟好看");
+        fmt::println("Deleted: {}", count("拟好看"));
+        const int system_weight = weight_of("你好");
+        dict.delete_by_pinyin_and_word("nihk", "你好");
+        fmt::println("System word hidden: {}", count("你好") == 0);
+        /* 恢复的系统词保留系统里的权重 */
+        dict.create_word("nihk", "你好");
+        fmt::println("System word restored: {}, weight {} -> {}", count("你好"), system_weight, weight_of("你好"));
+    }
+}
+
+void test_warm_cache()
+{
+    fmt::println("==== Warm cache across restarts ====");
+    const vector<UINT> sequence{'N', 'I', 'H', 'K', 'M', 'A'};
+    /* 第一个实例退出时写出最常查的编码，第二个实例启动时读回来，命中率打在日志里 */
+    TestUserDir user_dir("warm_cache");
+    for (int run = 0; run < 2; ++run)
+    {
+        DictionaryUlPb dict(user_dir.str());
+        while (dict.readiness() == DictionaryUlPb::Readiness::Warming)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (UINT vk : sequence)
+        {
+            dict.handleVkCode(vk, 0);
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        fmt::println("Run {}: {} us for {} keys", run, elapsed.count(), sequence.size());
+    }
+}
+
+void test_utf16_page()
+{
+    fmt::println("==== UTF-16 candidate page ====");
+    ImeSession session(SchemeType::Shuangpin);
+    feed_sequence(session, {'N', 'I', 'H', 'K'});
+    const auto &page = session.get_candidate_page_utf16(0, 9);
+    fmt::println("Page: {} of {} candidates", page.size(), session.get_candidates().size());
+    /* 同一页再取一次不用重新转码 */
+    const size_t before = global_allocations;
+    session.get_candidate_page_utf16(0, 9);
+    fmt::println("Repeat: {} heap allocations", global_allocations - before);
+}
+
+void test_typo_correction()
+{
+    fmt::println("==== Typo correction ====");
+    TestUserDir user_dir("typo_correction");
+    DictionaryUlPb dict(user_dir.str());
+    /* 纠错走键索引，要等预热建好索引 */
+    while (dict.readiness() == DictionaryUlPb::Readiness::Warming)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto type = [&dict](const string &keys) {
+        dict.reset_state();
+        for (char key : keys)
+        {
+            dict.handleVkCode(static_cast<UINT>(key - ('a' - 'A')), 0);
+        }
+        return dict.get_cur_candiate_list();
+    };
+    /* nihj 是 nihk 按偏了一个键，纠错的候选排在完全匹配的候选后面，前缀的候选之前 */
+    auto is_correction = [](const WordItem &cand) {
+        const string &code = std::get<0>(cand);
+        return code.size() == 4 && code != "nihj";
+    };
+    auto candidates = type("nihj");
+    fmt::println("Off: {} corrected candidates", std::count_if(candidates.begin(), candidates.end(), is_correction));
+    dict.set_typo_correction(true);
+    candidates = type("nihj");
+    const auto first = std::find_if(candidates.begin(), candidates.end(), is_correction);
+    const bool exact_first =
+        std::all_of(candidates.begin(), first, [](const auto &cand) { return std::get<0>(cand) == "nihj"; });
+    fmt::println("On: {} corrected candidates, first at {}, only exact candidates before it: {}",
+                 std::count_if(candidates.begin(), candidates.end(), is_correction), first - candidates.begin(),
+                 exact_first);
+    const auto nihk = std::find_if(candidates.begin(), candidates.end(),
+                                   [](const auto &cand) { return std::get<0>(cand) == "nihk"; });
+    fmt::println("Corrected to nihk: {}", nihk != candidates.end() ? std::get<1>(*nihk) : string("none"));
+
+    /* 会话的开关随请求带给 provider */
+    ImeSession session(SchemeType::Shuangpin);
+    session.set_typo_correction(true);
+    feed_sequence(session, {'N', 'I', 'H', 'J'});
+    fmt::println("Session request asks for corrections: {}", session.get_request().typo_correction);
+}
+
+void test_cache_invalidation()
+{
+    fmt::println("==== Cache invalidation ====");
+    /* 反向索引只交出受影响的缓存条目 */
+    CacheDependencyIndex index;
+    index.add(CacheDependencyIndex::Cache::Series, PackedKey("nihk"), "ni'hk");
+    index.add(CacheDependencyIndex::Cache::Pinyin, PackedKey("ni"), "ni");
+    index.add(CacheDependencyIndex::Cache::Series, PackedKey("mali"), "ma'li");
+    index.add(CacheDependencyIndex::Cache::Series, PackedKey("nihj"), "ni'hj");
+    index.add_corrections(CacheDependencyIndex::Cache::Series, PackedKey("nihj"), "nihj");
+    const auto taken = index.take("nihk");
+    fmt::println("Word under nihk: {} cached lists dropped, {} records left", taken.size(), index.size());
+
+    /* 造词、删词、调权重之后，缓存里的列表不能再给出旧的结果 */
+    TestUserDir user_dir("cache_invalidation");
+    DictionaryUlPb dict(user_dir.str());
+    while (dict.readiness() == DictionaryUlPb::Readiness::Warming)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto position = [&dict](const string &keys, const string &word) {
+        dict.reset_state();
+        for (char key : keys)
+        {
+            dict.handleVkCode(static_cast<UINT>(key - ('a' - 'A')), 0);
+        }
+        const auto &candidates = dict.get_cur_candiate_list();
+        const auto it = std::find_if(candidates.begin(), candidates.end(),
+                                     [&word](const auto &cand) { return std::get<1>(cand) == word; });
+        return it == candidates.end() ? -1 : static_cast<int>(it - candidates.begin());
+    };
+    fmt::println("Before: 拟好 at {}", position("nihk", "拟好"));
+    dict.create_word("nihk", "拟好");
+    fmt::println("Created: 拟好 at {}", position("nihk", "拟好"));
+    for (int i = 0; i < 3; ++i)
+    {
+        dict.update_weight_by_pinyin_and_word("nihk", "拟好");
+    }
+    fmt::println("Chosen three times: 拟好 at {}", position("nihk", "拟好"));
+    dict.delete_by_pinyin_and_word("nihk", "拟好");
+    fmt::println("Deleted: 拟好 at {}", position("nihk", "拟好"));
+}
+
 int main(int argc, char *argv[])
 {
     test_shuangpin_session();
     test_shuangpin_session02();
     // test_quanpin_session();
     test_dynamic_switch();
+    test_key_burst();
+    test_association();
+    test_candidate_merger();
+    test_dictionary_reload();
+    test_warm_up();
+    test_allocations();
+    test_long_input();
+    test_parallel_series();
+    test_progressive_refresh();
+    test_user_lexicon();
+    test_warm_cache();
+    test_utf16_page();
+    test_typo_correction();
+    test_cache_invalidation();
     return 0;
 }
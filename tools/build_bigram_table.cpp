@@ -0,0 +1,119 @@
+//
+// 从分好词的语料统计相邻词的次数，生成联想用的 bigram.dat。语料是 UTF-8 文本，一行一句，词之间用空白分开，
+// 标点等非汉字的词会切断前后的搭配。不给输出路径时直接装到引擎读取的 %LOCALAPPDATA%\MetasequoiaImeTsf\bigram.dat。
+//
+#include "shuangpin/bigram_table.h"
+#include "shuangpin/pinyin_utils.h"
+#include "shuangpin/utf8_utils.h"
+#include <fmt/core.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+bool is_han(char32_t ch)
+{
+    return (ch >= 0x4e00 && ch <= 0x9fff) || (ch >= 0x3400 && ch <= 0x4dbf) || (ch >= 0x20000 && ch <= 0x2ebef);
+}
+
+bool is_han_word(string_view word)
+{
+    size_t index = 0;
+    while (index < word.size())
+    {
+        size_t size = 0;
+        if (!is_han(Utf8Utils::decode(word.substr(index), size)))
+        {
+            return false;
+        }
+        index += size;
+    }
+    return !word.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        fmt::print(stderr, "Usage: {} <segmented_corpus.txt> [bigram.dat]\n", argv[0]);
+        return 2;
+    }
+    string output;
+    if (argc == 3)
+    {
+        output = argv[2];
+    }
+    else
+    {
+        const filesystem::path dir = filesystem::path(PinyinUtil::get_local_appdata_path()) / PinyinUtil::app_name;
+        error_code ec;
+        filesystem::create_directories(dir, ec);
+        output = (dir / "bigram.dat").string();
+    }
+    const auto start = chrono::steady_clock::now();
+    ifstream corpus(argv[1], ios::binary);
+    if (!corpus.is_open())
+    {
+        fmt::print(stderr, "Failed to open {}\n", argv[1]);
+        return 1;
+    }
+
+    /* 上一个词整词统计一次，多字词再按最后一个字统计一次，供查不到整词时回退 */
+    unordered_map<string, uint32_t> counts; // previous word '\t' next word -> count
+    size_t lines = 0;
+    string line;
+    while (getline(corpus, line))
+    {
+        ++lines;
+        istringstream words(line);
+        string prev, word;
+        while (words >> word)
+        {
+            if (!is_han_word(word))
+            {
+                prev.clear();
+                continue;
+            }
+            if (!prev.empty())
+            {
+                ++counts[prev + '\t' + word];
+                const string_view last = Utf8Utils::last_char(prev);
+                if (last.size() < prev.size())
+                {
+                    ++counts[string(last) + '\t' + word];
+                }
+            }
+            prev = std::move(word);
+        }
+    }
+
+    vector<BigramTable::BigramCount> bigrams;
+    bigrams.reserve(counts.size());
+    for (const auto &[pair_text, count] : counts)
+    {
+        const size_t tab = pair_text.find('\t');
+        bigrams.emplace_back(pair_text.substr(0, tab), pair_text.substr(tab + 1), count);
+    }
+    counts.clear();
+
+    if (!BigramTable::build(bigrams, output))
+    {
+        fmt::print(stderr, "Failed to write {}\n", output);
+        return 1;
+    }
+    BigramTable table;
+    if (!table.open(output))
+    {
+        fmt::print(stderr, "Failed to map {}\n", output);
+        return 1;
+    }
+    const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    fmt::print("{} lines read, {} bigrams, {} words, written to {}, {} ms\n", lines, bigrams.size(), table.word_count(),
+               output, elapsed.count());
+    return 0;
+}
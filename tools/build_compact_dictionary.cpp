@@ -0,0 +1,83 @@
+//
+// 把词库（分表或单表布局都可以）转换成 CompactDictionary 的只读文件，给内存紧张的部署用。源库只读。
+//
+#include "shuangpin/compact_dictionary.h"
+#include "shuangpin/dictionary_schema.h"
+#include <fmt/core.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+
+using namespace std;
+
+vector<string> list_tables(sqlite3 *db)
+{
+    vector<string> tables;
+    if (DictionarySchema::detect(db) == DictionarySchema::Layout::Unified)
+    {
+        tables.push_back(DictionarySchema::kUnifiedTable);
+        return tables;
+    }
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, "select name from sqlite_master where type = 'table' and name like 'tbl_%';", -1, &stmt, 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        tables.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    return tables;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fmt::print(stderr, "Usage: {} <dictionary.db> <dictionary.compact>\n", argv[0]);
+        return 2;
+    }
+    const auto start = chrono::steady_clock::now();
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(argv[1], &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        fmt::print(stderr, "Failed to open {}: {}\n", argv[1], sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return 1;
+    }
+    vector<CompactDictionary::Row> rows;
+    for (const auto &table : list_tables(db))
+    {
+        sqlite3_stmt *stmt;
+        const string sql = fmt::format("select {} from {};", DictionarySchema::kColumns, table);
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const char *key = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            const char *jp = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            const char *value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+            if (key && jp && value)
+            {
+                rows.push_back(CompactDictionary::Row{key, jp, value, sqlite3_column_int(stmt, 3)});
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+
+    const size_t row_count = rows.size();
+    if (!CompactDictionary::build(rows, argv[2]))
+    {
+        fmt::print(stderr, "Failed to write {}\n", argv[2]);
+        return 1;
+    }
+    CompactDictionary dict;
+    if (!dict.open(argv[2]))
+    {
+        fmt::print(stderr, "Failed to map {}\n", argv[2]);
+        return 1;
+    }
+    const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    fmt::print("{} rows read, {} entries, {} keys, {} bytes, {} ms\n", row_count, dict.entry_count(), dict.key_count(),
+               dict.footprint().total, elapsed.count());
+    return 0;
+}
@@ -0,0 +1,27 @@
+//
+// 把分表的词库（tbl_{len}_{initial}）迁移成单表 without rowid 布局。源库只读，目标文件必须不存在，
+// 迁移完成后用目标文件替换 cutted_flyciku_with_jp.db 即可，引擎打开时会自动识别布局。
+//
+#include "shuangpin/dictionary_schema.h"
+#include <fmt/core.h>
+#include <chrono>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fmt::print(stderr, "Usage: {} <sharded.db> <unified.db>\n", argv[0]);
+        return 2;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    DictionarySchema::MigrationStats stats;
+    if (!DictionarySchema::migrate(argv[1], argv[2], stats))
+    {
+        return 1;
+    }
+    const auto elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    fmt::print("{} tables, {} rows read, {} rows written, {} ms\n", stats.tables, stats.rows_read, stats.rows_written,
+               elapsed.count());
+    return 0;
+}